@@ -0,0 +1,528 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../src/ggpicture.h"
+
+// In-process benchmark of the library kernels on synthetic images. Inputs are
+// generated from a fixed seed, so runs on different machines or commits time
+// exactly the same pixels.
+
+#define MAX_SIZES 16
+#define MAX_CHANNELS 4
+// Angle of the rotate_angle kernels, which keep the input size
+#define BENCH_ANGLE 7.0
+#define MAX_SAMPLES 1000
+#define MAX_COUNTED_THREADS 256
+
+typedef struct {
+    const char *label;
+    const char *name;
+    int in_place; // 0 for kernels that write a differently sized image
+    int arg;
+} bench_kernel;
+
+static const bench_kernel kernels[] = {
+    {"brightness:20", "brightness", 1, 20},
+    {"contrast:30", "contrast", 1, 30},
+    {"saturation:40", "saturation", 1, 40},
+    {"bw", "bw", 1, 0},
+    {"vintage", "vintage", 1, 0},
+    {"blur:3", "blur", 1, 3},
+    {"blur:40", "blur", 1, 40},
+    {"rotate_r", "rotate_r", 0, GG_ROTATE_RIGHT},
+    {"rotate_f", "rotate_f", 0, GG_ROTATE_FLIP},
+    {"rotate:7", "rotate_angle", 0, GG_INTERP_BILINEAR},
+    {"rotate:7:bicubic", "rotate_angle", 0, GG_INTERP_BICUBIC},
+    {"mirror_hv", "mirror", 1, GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL},
+    {"mirror_h", "mirror", 1, GG_MIRROR_HORIZONTAL},
+    {"pixelate:8", "pixelate", 0, 8},
+};
+
+#define KERNEL_COUNT ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+typedef struct {
+    double sizes[MAX_SIZES]; // megapixels
+    int size_count;
+    int channels[MAX_CHANNELS];
+    int channel_count;
+    const char *filter;
+    int min_reps;
+    double budget; // seconds per kernel and size, after min_reps
+    int csv;
+    int counters;
+} bench_options;
+
+// Hardware counters read around each timed run
+enum { COUNT_CYCLES, COUNT_INSTRUCTIONS, COUNT_LLC_MISSES, COUNT_BRANCH_MISSES, COUNTER_KINDS };
+
+static const struct {
+    const char *name;
+    uint64_t config;
+} counter_events[COUNTER_KINDS] = {
+    {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+    {"LLC misses", PERF_COUNT_HW_CACHE_MISSES},
+    {"branch misses", PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// One counter of each kind on every thread of the process, so the worker
+// pool is counted along with the main thread. fds is -1 for kinds the CPU or
+// the perf_event_paranoid setting does not allow.
+typedef struct {
+    int threads;
+    int fds[MAX_COUNTED_THREADS][COUNTER_KINDS];
+    double totals[COUNTER_KINDS];
+    int available[COUNTER_KINDS];
+} counter_set;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int open_counter(pid_t tid, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Scale for multiplexing when more events are open than the PMU has counters
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+}
+
+static void counters_close(counter_set *set) {
+    for (int t = 0; t < set->threads; t++) {
+        for (int k = 0; k < COUNTER_KINDS; k++) {
+            if (set->fds[t][k] >= 0) {
+                close(set->fds[t][k]);
+            }
+        }
+    }
+    set->threads = 0;
+}
+
+// Open counters on every current thread. Returns the number of kinds that
+// could be opened; errno tells why when it is 0.
+static int counters_open(counter_set *set) {
+    set->threads = 0;
+    for (int k = 0; k < COUNTER_KINDS; k++) {
+        set->available[k] = 1;
+        set->totals[k] = 0.0;
+    }
+
+    DIR *tasks = opendir("/proc/self/task");
+    if (tasks == NULL) {
+        return 0;
+    }
+    struct dirent *entry;
+    int error = 0;
+    while ((entry = readdir(tasks)) != NULL && set->threads < MAX_COUNTED_THREADS) {
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        if (tid <= 0) {
+            continue;
+        }
+        int *fds = set->fds[set->threads++];
+        for (int k = 0; k < COUNTER_KINDS; k++) {
+            fds[k] = set->available[k] ? open_counter(tid, counter_events[k].config) : -1;
+            if (fds[k] < 0 && errno != ESRCH) {
+                // A kind that fails on one thread is left out everywhere
+                error = errno;
+                set->available[k] = 0;
+            }
+        }
+    }
+    closedir(tasks);
+
+    int available = 0;
+    for (int k = 0; k < COUNTER_KINDS; k++) {
+        available += set->available[k];
+    }
+    if (available == 0) {
+        counters_close(set);
+        errno = error;
+    }
+    return available;
+}
+
+static void counters_control(counter_set *set, unsigned long request) {
+    for (int t = 0; t < set->threads; t++) {
+        for (int k = 0; k < COUNTER_KINDS; k++) {
+            if (set->fds[t][k] >= 0 && set->available[k]) {
+                ioctl(set->fds[t][k], request, 0);
+            }
+        }
+    }
+}
+
+static void counters_start(counter_set *set) {
+    counters_control(set, PERF_EVENT_IOC_RESET);
+    counters_control(set, PERF_EVENT_IOC_ENABLE);
+}
+
+// Stop counting and add this run's counts to the totals
+static void counters_stop(counter_set *set) {
+    counters_control(set, PERF_EVENT_IOC_DISABLE);
+    for (int t = 0; t < set->threads; t++) {
+        for (int k = 0; k < COUNTER_KINDS; k++) {
+            uint64_t values[3]; // value, time enabled, time running
+            if (set->fds[t][k] < 0 || !set->available[k] ||
+                read(set->fds[t][k], values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0) {
+                continue;
+            }
+            set->totals[k] += (double)values[0] * ((double)values[1] / (double)values[2]);
+        }
+    }
+}
+
+// Smooth gradients with some xorshift noise on top, roughly like a photo:
+// flat areas, edges and texture, without being trivially compressible.
+static void fill_synthetic(gg_image *img, unsigned int seed) {
+    unsigned int state = seed * 2654435761u + 1;
+
+    for (int y = 0; y < img->height; y++) {
+        unsigned char *row = img->pixels + (ptrdiff_t)y * img->stride;
+        for (int x = 0; x < img->width; x++) {
+            for (int c = 0; c < img->channels; c++) {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                int base = (x * (c + 1) * 255 / img->width + y * 255 / img->height) / 2;
+                int value = base + (int)(state & 31) - 16;
+                row[x * img->channels + c] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+            }
+        }
+    }
+}
+
+static int run_kernel(const bench_kernel *kernel, gg_image *img, gg_image *out) {
+    if (strcmp(kernel->name, "brightness") == 0) {
+        return gg_brightness(img, kernel->arg);
+    } else if (strcmp(kernel->name, "contrast") == 0) {
+        return gg_contrast(img, kernel->arg);
+    } else if (strcmp(kernel->name, "saturation") == 0) {
+        return gg_saturation(img, kernel->arg);
+    } else if (strcmp(kernel->name, "bw") == 0) {
+        return gg_black_and_white(img);
+    } else if (strcmp(kernel->name, "vintage") == 0) {
+        return gg_vintage(img);
+    } else if (strcmp(kernel->name, "blur") == 0) {
+        return gg_blur(img, kernel->arg);
+    } else if (strcmp(kernel->name, "rotate_angle") == 0) {
+        return gg_rotate_angle(img, out, BENCH_ANGLE, kernel->arg, NULL);
+    } else if (strncmp(kernel->name, "rotate", 6) == 0) {
+        return gg_rotate(img, out, kernel->arg);
+    } else if (strcmp(kernel->name, "pixelate") == 0) {
+        return gg_pixelate(img, out, kernel->arg);
+    } else if (strcmp(kernel->name, "mirror") == 0) {
+        return gg_mirror(img, kernel->arg);
+    }
+    return GG_ERR_ARGUMENT;
+}
+
+static int output_size(const bench_kernel *kernel, const gg_image *img, int *width, int *height) {
+    if (strcmp(kernel->name, "rotate_angle") == 0) {
+        return gg_angle_rotated_size(img, BENCH_ANGLE, GG_BOUNDS_KEEP, width, height);
+    }
+    if (strncmp(kernel->name, "rotate", 6) == 0) {
+        return gg_rotated_size(img, kernel->arg, width, height);
+    }
+    return gg_pixelated_size(img, kernel->arg, width, height);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int count, double p) {
+    int rank = (int)ceil(p / 100.0 * count);
+    return sorted[rank < 1 ? 0 : rank - 1];
+}
+
+static int kernel_selected(const bench_options *options, const bench_kernel *kernel) {
+    if (options->filter == NULL) {
+        return 1;
+    }
+    size_t len = strlen(kernel->name);
+    for (const char *f = options->filter; *f != '\0';) {
+        if (strncmp(f, kernel->name, len) == 0 && (f[len] == ',' || f[len] == '\0')) {
+            return 1;
+        }
+        f = strchr(f, ',');
+        if (f == NULL) {
+            break;
+        }
+        f++;
+    }
+    return 0;
+}
+
+static counter_set counter_storage;
+static int counters_reported = 0;
+
+// Open counters for the next kernel, or return NULL (explaining why once) if
+// perf events are not available here
+static counter_set *counter_set_for_kernel(counter_set *set) {
+    if (counters_open(set) > 0) {
+        return set;
+    }
+    if (!counters_reported) {
+        int denied = errno == EACCES || errno == EPERM;
+        fprintf(stderr, "Note: Hardware counters are unavailable (%s)%s.\n", strerror(errno),
+                denied ? "; lower /proc/sys/kernel/perf_event_paranoid to allow them" : "");
+        counters_reported = 1;
+    }
+    return NULL;
+}
+
+// Cycles, LLC misses and branch misses per pixel and instructions per cycle,
+// "-" (or empty in CSV) for counters that could not be read
+static void print_counters(const counter_set *set, double pixels, int csv) {
+    double values[4] = {NAN, NAN, NAN, NAN};
+    if (set != NULL && set->available[COUNT_CYCLES] && set->totals[COUNT_CYCLES] > 0) {
+        values[0] = set->totals[COUNT_CYCLES] / pixels;
+        if (set->available[COUNT_INSTRUCTIONS]) {
+            values[2] = set->totals[COUNT_INSTRUCTIONS] / set->totals[COUNT_CYCLES];
+        }
+    }
+    if (set != NULL && set->available[COUNT_LLC_MISSES]) {
+        values[1] = set->totals[COUNT_LLC_MISSES] / pixels;
+    }
+    if (set != NULL && set->available[COUNT_BRANCH_MISSES]) {
+        values[3] = set->totals[COUNT_BRANCH_MISSES] / pixels;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (csv) {
+            isnan(values[i]) ? printf(",") : printf(",%.5f", values[i]);
+        } else {
+            isnan(values[i]) ? printf(" %10s", "-") : printf(" %10.4f", values[i]);
+        }
+    }
+}
+
+static int bench_size(const bench_options *options, double megapixels, int channels) {
+    int width = (int)lround(sqrt(megapixels * 1e6 * 4.0 / 3.0));
+    int height = (int)lround(megapixels * 1e6 / width);
+
+    gg_image pristine, work;
+    if (gg_image_create(&pristine, width, height, channels) != GG_OK ||
+        gg_image_create(&work, width, height, channels) != GG_OK) {
+        printf("Error: Could not allocate a %dx%dx%d image.\n", width, height, channels);
+        gg_image_free(&pristine);
+        return 1;
+    }
+    fill_synthetic(&pristine, (unsigned int)(megapixels * 1000) * 8 + channels);
+    size_t bytes = (size_t)width * height * channels;
+
+    double *samples = malloc(MAX_SAMPLES * sizeof(*samples));
+    if (samples == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        gg_image_free(&pristine);
+        gg_image_free(&work);
+        return 1;
+    }
+
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        const bench_kernel *kernel = &kernels[k];
+        if (!kernel_selected(options, kernel)) {
+            continue;
+        }
+
+        gg_image out = {0, 0, 0, 0, NULL};
+        if (!kernel->in_place) {
+            int out_width, out_height;
+            if (output_size(kernel, &pristine, &out_width, &out_height) != GG_OK ||
+                gg_image_create(&out, out_width, out_height, channels) != GG_OK) {
+                printf("Error: Could not allocate the output of %s.\n", kernel->name);
+                continue;
+            }
+        }
+
+        // One untimed run faults in every page of the buffers and starts
+        // the worker threads the counters are then opened on
+        memcpy(work.pixels, pristine.pixels, bytes);
+        run_kernel(kernel, &work, &out);
+
+        counter_set *counters = options->counters ? counter_set_for_kernel(&counter_storage) : NULL;
+
+        int count = 0;
+        double total = 0.0;
+        while (count < MAX_SAMPLES && (count < options->min_reps || total < options->budget)) {
+            memcpy(work.pixels, pristine.pixels, bytes);
+            if (counters != NULL) {
+                counters_start(counters);
+            }
+            double start = now_seconds();
+            int err = run_kernel(kernel, &work, &out);
+            double elapsed = now_seconds() - start;
+            if (counters != NULL) {
+                counters_stop(counters);
+            }
+            if (err != GG_OK) {
+                printf("Error: %s failed: %s.\n", kernel->name, gg_strerror(err));
+                break;
+            }
+            samples[count++] = elapsed;
+            total += elapsed;
+        }
+        gg_image_free(&out);
+        if (count == 0) {
+            continue;
+        }
+
+        qsort(samples, count, sizeof(*samples), compare_doubles);
+        double median = percentile(samples, count, 50.0);
+        double p99 = percentile(samples, count, 99.0);
+        double throughput = bytes / median / 1e6;
+
+        if (options->csv) {
+            printf("%s,%g,%d,%d,%d,%d,%.6f,%.6f,%.1f", kernel->label, megapixels, width, height, channels, count,
+                   median * 1e3, p99 * 1e3, throughput);
+        } else {
+            printf("%-16s %7g %5dx%-5d %d %6d %12.3f %12.3f %10.1f", kernel->label, megapixels, width, height, channels,
+                   count, median * 1e3, p99 * 1e3, throughput);
+        }
+        if (options->counters) {
+            print_counters(counters, (double)count * width * height, options->csv);
+        }
+        printf("\n");
+        if (counters != NULL) {
+            counters_close(counters);
+        }
+        fflush(stdout);
+    }
+
+    free(samples);
+    gg_image_free(&pristine);
+    gg_image_free(&work);
+    return 0;
+}
+
+static void print_usage(void) {
+    printf("Usage: ./build/run_bench [options]\n");
+    printf("  --sizes <mp,...>       Image sizes in megapixels (default 1,10,100).\n");
+    printf("  --channels <c,...>     Channel counts (default 3,4).\n");
+    printf("  --kernels <name,...>   Only run these kernels: brightness, contrast, saturation, bw,\n");
+    printf("                         vintage, blur, rotate_r, rotate_f, rotate_angle, mirror,\n");
+    printf("                         pixelate.\n");
+    printf("  --reps <n>             Minimum timed runs per kernel and size (default 5).\n");
+    printf("  --budget <seconds>     Keep sampling until this much time is spent (default 1).\n");
+    printf("  --threads <n>          Worker threads; 0 (default) uses one per CPU.\n");
+    printf("  --csv                  Print comma-separated values instead of a table.\n");
+    printf("  --counters             Also read hardware counters (perf events) and report cycles,\n");
+    printf("                         LLC misses and branch misses per pixel and IPC.\n");
+}
+
+// Parse a comma-separated list of positive numbers
+static int parse_list(const char *text, double *values, int max_count, int *count) {
+    *count = 0;
+    while (*text != '\0') {
+        char *end;
+        double value = strtod(text, &end);
+        if (end == text || value <= 0 || *count == max_count || (*end != ',' && *end != '\0')) {
+            return 1;
+        }
+        values[(*count)++] = value;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return *count == 0;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options options = {{1, 10, 100}, 3, {3, 4}, 2, NULL, 5, 1.0, 0, 0};
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--csv") == 0) {
+            options.csv = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--counters") == 0) {
+            options.counters = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--help") == 0) {
+            print_usage();
+            return 0;
+        }
+        if (value == NULL) {
+            printf("Error: Unknown option or missing value: %s\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+        i++;
+
+        if (strcmp(argv[i - 1], "--sizes") == 0) {
+            if (parse_list(value, options.sizes, MAX_SIZES, &options.size_count) != 0) {
+                printf("Error: Invalid size list %s.\n", value);
+                return 1;
+            }
+        } else if (strcmp(argv[i - 1], "--channels") == 0) {
+            double channels[MAX_CHANNELS];
+            if (parse_list(value, channels, MAX_CHANNELS, &options.channel_count) != 0) {
+                printf("Error: Invalid channel list %s.\n", value);
+                return 1;
+            }
+            for (int c = 0; c < options.channel_count; c++) {
+                options.channels[c] = (int)channels[c];
+                if (options.channels[c] < 3 || options.channels[c] > 4) {
+                    printf("Error: Channel counts must be 3 or 4.\n");
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i - 1], "--kernels") == 0) {
+            options.filter = value;
+        } else if (strcmp(argv[i - 1], "--reps") == 0) {
+            options.min_reps = atoi(value);
+            if (options.min_reps <= 0 || options.min_reps > MAX_SAMPLES) {
+                printf("Error: --reps must be between 1 and %d.\n", MAX_SAMPLES);
+                return 1;
+            }
+        } else if (strcmp(argv[i - 1], "--budget") == 0) {
+            options.budget = atof(value);
+        } else if (strcmp(argv[i - 1], "--threads") == 0) {
+            gg_set_threads(atoi(value));
+        } else {
+            printf("Error: Unknown option %s.\n", argv[i - 1]);
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (options.csv) {
+        printf("kernel,megapixels,width,height,channels,runs,median_ms,p99_ms,mb_per_s%s\n",
+               options.counters ? ",cycles_per_px,llc_misses_per_px,ipc,branch_misses_per_px" : "");
+    } else {
+        printf("ggpicture kernel benchmark: %d threads, ISA level %d\n", gg_threads(), gg_cpu_isa());
+        printf("%-16s %7s %11s %s %6s %12s %12s %10s", "kernel", "MP", "size", "c", "runs", "median ms",
+               "p99 ms", "MB/s");
+        if (options.counters) {
+            printf(" %10s %10s %10s %10s", "cyc/px", "LLC/px", "IPC", "brmiss/px");
+        }
+        printf("\n");
+    }
+
+    int failed = 0;
+    for (int s = 0; s < options.size_count; s++) {
+        for (int c = 0; c < options.channel_count; c++) {
+            failed |= bench_size(&options, options.sizes[s], options.channels[c]);
+        }
+    }
+    return failed;
+}
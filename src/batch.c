@@ -0,0 +1,528 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "image_processing.h"
+#include "stats.h"
+
+// Extensions stb_image can decode
+static const char *const image_extensions[] = {"bmp", "png", "jpg", "jpeg", "tga", "gif", "psd", "pnm", "ppm", "pgm"};
+
+static int has_image_extension(const char *file_name) {
+    const char *dot = strrchr(file_name, '.');
+    if (dot == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(image_extensions) / sizeof(image_extensions[0]); i++) {
+        if (strcasecmp(dot + 1, image_extensions[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Join base_dir and a relative path; absolute paths are copied as they are
+static int resolve_path(const char *base_dir, const char *path, char *out, size_t size) {
+    int written = path[0] == '/' ? snprintf(out, size, "%s", path) : snprintf(out, size, "%s/%s", base_dir, path);
+    if (written < 0 || (size_t)written >= size) {
+        printf("Error: Path too long: %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+static int add_input(batch_list *list, int *capacity, const char *base_dir, const char *path) {
+    char full_path[MAX_PATH];
+    if (resolve_path(base_dir, path, full_path, sizeof(full_path)) != 0) {
+        return 1;
+    }
+
+    if (list->count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        char **inputs = realloc(list->inputs, new_capacity * sizeof(*inputs));
+        if (inputs == NULL) {
+            printf("Error: Memory allocation failed.\n");
+            return 1;
+        }
+        list->inputs = inputs;
+        *capacity = new_capacity;
+    }
+
+    list->inputs[list->count] = strdup(full_path);
+    if (list->inputs[list->count] == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        return 1;
+    }
+    list->count++;
+    return 0;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int collect_directory(const char *dir_path, batch_list *list, int *capacity) {
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        printf("Error: Could not open directory %s.\n", dir_path);
+        return 1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || !has_image_extension(entry->d_name)) {
+            continue;
+        }
+
+        char full_path[MAX_PATH];
+        struct stat file_stat;
+        if (resolve_path(dir_path, entry->d_name, full_path, sizeof(full_path)) != 0 ||
+            stat(full_path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            continue;
+        }
+        if (add_input(list, capacity, dir_path, entry->d_name) != 0) {
+            closedir(dir);
+            return 1;
+        }
+    }
+    closedir(dir);
+
+    // readdir order is arbitrary; sorting keeps {index} stable between runs
+    qsort(list->inputs, list->count, sizeof(*list->inputs), compare_paths);
+    return 0;
+}
+
+static int collect_manifest(const char *manifest_path, const char *base_dir, batch_list *list, int *capacity) {
+    FILE *manifest = fopen(manifest_path, "r");
+    if (manifest == NULL) {
+        printf("Error: Could not open manifest %s.\n", manifest_path);
+        return 1;
+    }
+
+    char line[MAX_PATH];
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        // Trim surrounding whitespace, including the newline
+        char *start = line;
+        while (*start == ' ' || *start == '\t') {
+            start++;
+        }
+        size_t len = strlen(start);
+        while (len > 0 && (start[len - 1] == '\n' || start[len - 1] == '\r' ||
+                           start[len - 1] == ' ' || start[len - 1] == '\t')) {
+            start[--len] = '\0';
+        }
+
+        if (len == 0 || start[0] == '#') {
+            continue;
+        }
+        if (add_input(list, capacity, base_dir, start) != 0) {
+            fclose(manifest);
+            return 1;
+        }
+    }
+    fclose(manifest);
+    return 0;
+}
+
+int batch_collect(const char *source, const char *base_dir, batch_list *list) {
+    list->count = 0;
+    list->inputs = NULL;
+    list->outputs = NULL;
+
+    char source_path[MAX_PATH];
+    struct stat source_stat;
+    if (resolve_path(base_dir, source, source_path, sizeof(source_path)) != 0) {
+        return 1;
+    }
+    if (stat(source_path, &source_stat) != 0) {
+        printf("Error: %s does not exist.\n", source_path);
+        return 1;
+    }
+
+    int capacity = 0;
+    int result = S_ISDIR(source_stat.st_mode) ? collect_directory(source_path, list, &capacity)
+                                              : collect_manifest(source_path, base_dir, list, &capacity);
+    if (result != 0) {
+        batch_list_free(list);
+        return 1;
+    }
+    if (list->count == 0) {
+        printf("Error: No input images found in %s.\n", source_path);
+        return 1;
+    }
+    return 0;
+}
+
+// Expand the template for one input into out
+static int expand_template(const char *output_template, const char *input, int index, char *out, size_t size) {
+    const char *base = strrchr(input, '/');
+    base = base ? base + 1 : input;
+    const char *dot = strrchr(base, '.');
+    int name_len = dot ? (int)(dot - base) : (int)strlen(base);
+    const char *ext = dot ? dot + 1 : "";
+
+    size_t used = 0;
+    for (const char *t = output_template; *t != '\0';) {
+        int written;
+        if (strncmp(t, "{name}", 6) == 0) {
+            written = snprintf(out + used, size - used, "%.*s", name_len, base);
+            t += 6;
+        } else if (strncmp(t, "{ext}", 5) == 0) {
+            written = snprintf(out + used, size - used, "%s", ext);
+            t += 5;
+        } else if (strncmp(t, "{index}", 7) == 0) {
+            written = snprintf(out + used, size - used, "%d", index);
+            t += 7;
+        } else if (*t == '{') {
+            printf("Error: Unknown placeholder in output template %s. Use {name}, {ext} or {index}.\n", output_template);
+            return 1;
+        } else {
+            written = snprintf(out + used, size - used, "%c", *t);
+            t++;
+        }
+
+        if (written < 0 || (size_t)written >= size - used) {
+            printf("Error: Output path too long for %s.\n", input);
+            return 1;
+        }
+        used += written;
+    }
+    return 0;
+}
+
+// An input file by device and inode, which find it under any name
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    int index;
+} file_identity;
+
+static int compare_identities(const void *a, const void *b) {
+    const file_identity *x = a, *y = b;
+    if (x->dev != y->dev) {
+        return x->dev < y->dev ? -1 : 1;
+    }
+    return (x->ino > y->ino) - (x->ino < y->ino);
+}
+
+// Refuse outputs that already exist as one of the inputs, whatever the
+// spelling or position: the encoder of one file can run while the decoder of
+// another is still reading it.
+static int check_overwrites(const batch_list *list) {
+    file_identity *inputs = malloc(list->count * sizeof(*inputs));
+    if (inputs == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        return 1;
+    }
+    int known = 0;
+    for (int i = 0; i < list->count; i++) {
+        struct stat file_stat;
+        if (stat(list->inputs[i], &file_stat) == 0) {
+            inputs[known].dev = file_stat.st_dev;
+            inputs[known].ino = file_stat.st_ino;
+            inputs[known++].index = i;
+        }
+    }
+    qsort(inputs, known, sizeof(*inputs), compare_identities);
+
+    for (int i = 0; i < list->count; i++) {
+        struct stat file_stat;
+        if (stat(list->outputs[i], &file_stat) != 0) {
+            continue;
+        }
+        file_identity key = {file_stat.st_dev, file_stat.st_ino, 0};
+        const file_identity *input = bsearch(&key, inputs, known, sizeof(*inputs), compare_identities);
+        if (input != NULL) {
+            printf("Error: Output %s would overwrite the input %s.\n", list->outputs[i], list->inputs[input->index]);
+            free(inputs);
+            return 1;
+        }
+    }
+    free(inputs);
+    return 0;
+}
+
+int batch_name_outputs(batch_list *list, const char *output_template, const char *base_dir) {
+    list->outputs = calloc(list->count, sizeof(*list->outputs));
+    if (list->outputs == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        return 1;
+    }
+
+    for (int i = 0; i < list->count; i++) {
+        char name[MAX_PATH], full_path[MAX_PATH];
+        if (expand_template(output_template, list->inputs[i], i, name, sizeof(name)) != 0 ||
+            resolve_path(base_dir, name, full_path, sizeof(full_path)) != 0) {
+            return 1;
+        }
+        list->outputs[i] = strdup(full_path);
+        if (list->outputs[i] == NULL) {
+            printf("Error: Memory allocation failed.\n");
+            return 1;
+        }
+    }
+
+    if (check_overwrites(list) != 0) {
+        return 1;
+    }
+
+    // Two inputs mapping to one output would race on the same file
+    char **sorted = malloc(list->count * sizeof(*sorted));
+    if (sorted == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        return 1;
+    }
+    memcpy(sorted, list->outputs, list->count * sizeof(*sorted));
+    qsort(sorted, list->count, sizeof(*sorted), compare_paths);
+    for (int i = 1; i < list->count; i++) {
+        if (strcmp(sorted[i - 1], sorted[i]) == 0) {
+            printf("Error: Several inputs would be saved to %s. Add {name} or {index} to the output template.\n",
+                   sorted[i]);
+            free(sorted);
+            return 1;
+        }
+    }
+    free(sorted);
+    return 0;
+}
+
+void batch_list_free(batch_list *list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->inputs[i]);
+        if (list->outputs != NULL) {
+            free(list->outputs[i]);
+        }
+    }
+    free(list->inputs);
+    free(list->outputs);
+    list->inputs = NULL;
+    list->outputs = NULL;
+    list->count = 0;
+}
+
+// One file on its way through the stages
+struct batch_item {
+    int index;
+    gg_image image;
+};
+
+// Fixed-capacity FIFO handing images from one stage to the next. Producers
+// block while it is full and consumers while it is empty; once every producer
+// has finished, consumers drain what is left and then get NULL.
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    struct batch_item **items;
+    int capacity;
+    int head;
+    int count;
+    int producers;
+} batch_queue;
+
+static int queue_init(batch_queue *q, int capacity, int producers) {
+    q->items = malloc(capacity * sizeof(*q->items));
+    if (q->items == NULL) {
+        return 1;
+    }
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    q->producers = producers;
+    return 0;
+}
+
+static void queue_destroy(batch_queue *q) {
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->items);
+}
+
+static void queue_push(batch_queue *q, struct batch_item *item) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == q->capacity) {
+        pthread_cond_wait(&q->not_full, &q->mutex);
+    }
+    q->items[(q->head + q->count) % q->capacity] = item;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static struct batch_item *queue_pop(batch_queue *q) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == 0 && q->producers > 0) {
+        pthread_cond_wait(&q->not_empty, &q->mutex);
+    }
+
+    struct batch_item *item = NULL;
+    if (q->count > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return item;
+}
+
+static void queue_producer_done(batch_queue *q) {
+    pthread_mutex_lock(&q->mutex);
+    if (--q->producers == 0) {
+        pthread_cond_broadcast(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
+struct batch_run {
+    const batch_list *list;
+    const pipeline *p;
+    struct batch_item *items;
+    int next_input;
+    int saved;
+    batch_queue decoded;   // decode -> process
+    batch_queue processed; // process -> encode
+};
+
+static void *decode_worker(void *arg) {
+    struct batch_run *run = arg;
+
+    for (;;) {
+        int i = __atomic_fetch_add(&run->next_input, 1, __ATOMIC_RELAXED);
+        if (i >= run->list->count) {
+            break;
+        }
+        struct batch_item *item = &run->items[i];
+        if (load_image(run->list->inputs[i], &item->image) == 0) {
+            queue_push(&run->decoded, item);
+        }
+    }
+
+    queue_producer_done(&run->decoded);
+    return NULL;
+}
+
+// Runs on the shared pool, one item per processing worker. Kernels called
+// from here stay on the calling thread: the workers already keep every core
+// busy with a different image.
+static void process_worker(void *ctx, int start, int end) {
+    struct batch_run *run = ctx;
+
+    for (int w = start; w < end; w++) {
+        struct batch_item *item;
+        while ((item = queue_pop(&run->decoded)) != NULL) {
+            int err = stats_run_pipeline(run->p, &item->image);
+            if (err != GG_OK) {
+                printf("Error: %s: %s.\n", run->list->inputs[item->index], gg_strerror(err));
+                gg_image_free(&item->image);
+                continue;
+            }
+            queue_push(&run->processed, item);
+        }
+        queue_producer_done(&run->processed);
+    }
+}
+
+static void *encode_worker(void *arg) {
+    struct batch_run *run = arg;
+    char done[64];
+    snprintf(done, sizeof(done), "Processed (%d stages)", run->p->count);
+
+    struct batch_item *item;
+    while ((item = queue_pop(&run->processed)) != NULL) {
+        if (save_image(&item->image, run->list->outputs[item->index], "processed", done) == 0) {
+            __atomic_fetch_add(&run->saved, 1, __ATOMIC_RELAXED);
+        }
+        gg_image_free(&item->image);
+    }
+    return NULL;
+}
+
+// Start up to count threads running fn and return how many started
+static int start_stage(pthread_t *threads, int count, void *(*fn)(void *), struct batch_run *run) {
+    int started = 0;
+    while (started < count && pthread_create(&threads[started], NULL, fn, run) == 0) {
+        started++;
+    }
+    return started;
+}
+
+// Decoding, processing and encoding each run on their own workers, joined by
+// bounded queues, so disk and codec work overlaps with the kernels and at
+// most a few decoded images per worker are held in memory at a time.
+int process_batch(const char *source, const pipeline *p, const char *output_template, const char *base_dir) {
+    batch_list list;
+    if (batch_collect(source, base_dir, &list) != 0) {
+        return 1;
+    }
+    if (batch_name_outputs(&list, output_template, base_dir) != 0) {
+        batch_list_free(&list);
+        return 1;
+    }
+
+    int processors = gg_threads();
+    int coders = (processors + 1) / 2;
+    struct batch_run run = {0};
+    run.list = &list;
+    run.p = p;
+    run.items = calloc(list.count, sizeof(*run.items));
+    pthread_t *decoders = malloc(coders * sizeof(*decoders));
+    pthread_t *encoders = malloc(coders * sizeof(*encoders));
+    int queues = run.items != NULL && decoders != NULL && encoders != NULL &&
+                 queue_init(&run.decoded, 2 * processors, coders) == 0;
+    if (queues && queue_init(&run.processed, 2 * processors, processors) != 0) {
+        queue_destroy(&run.decoded);
+        queues = 0;
+    }
+    if (!queues) {
+        printf("Error: Memory allocation failed.\n");
+        free(run.items);
+        free(decoders);
+        free(encoders);
+        batch_list_free(&list);
+        return 1;
+    }
+    for (int i = 0; i < list.count; i++) {
+        run.items[i].index = i;
+    }
+
+    int encoding = start_stage(encoders, coders, encode_worker, &run);
+    int decoding = encoding > 0 ? start_stage(decoders, coders, decode_worker, &run) : 0;
+    for (int i = decoding; i < coders; i++) {
+        queue_producer_done(&run.decoded);
+    }
+    if (encoding == 0) {
+        printf("Error: Could not start the batch threads.\n");
+    }
+
+    // The calling thread takes part in processing through the pool
+    if (encoding > 0) {
+        gg_parallel_for(processors, 1, process_worker, &run);
+    }
+
+    for (int i = 0; i < decoding; i++) {
+        pthread_join(decoders[i], NULL);
+    }
+    for (int i = 0; i < encoding; i++) {
+        pthread_join(encoders[i], NULL);
+    }
+
+    printf("Batch finished: %d of %d images processed.\n", run.saved, list.count);
+    int failed = run.saved != list.count;
+
+    queue_destroy(&run.decoded);
+    queue_destroy(&run.processed);
+    free(run.items);
+    free(decoders);
+    free(encoders);
+    batch_list_free(&list);
+    return failed;
+}
@@ -0,0 +1,34 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include "pipeline.h"
+
+#define BATCH_DEFAULT_TEMPLATE "{name}_gogi.bmp"
+
+// Input and output paths of a batch run, in processing order
+typedef struct {
+    int count;
+    char **inputs;
+    char **outputs;
+} batch_list;
+
+// Collect the inputs named by source: every image file in a directory, sorted
+// by name, or every line of a manifest file (blank lines and lines starting
+// with '#' are skipped). Relative paths are resolved against base_dir.
+int batch_collect(const char *source, const char *base_dir, batch_list *list);
+
+// Fill list->outputs from an output name template. {name} is the input file
+// name without its extension, {ext} the extension and {index} the position in
+// the batch. Relative results are resolved against base_dir. Fails if two
+// inputs would be written to the same file or any output is one of the
+// inputs under any name.
+int batch_name_outputs(batch_list *list, const char *output_template, const char *base_dir);
+
+void batch_list_free(batch_list *list);
+
+// Decode, run the pipeline on and encode every input, several files at a time.
+// source and relative output names are resolved against base_dir.
+int process_batch(const char *source, const pipeline *p, const char *output_template, const char *base_dir);
+
+#endif
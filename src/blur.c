@@ -0,0 +1,554 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ggpicture_internal.h"
+
+#ifdef GG_X86
+#include <immintrin.h>
+#endif
+
+// Both blur passes reduce to the same primitive: for j in [start, end), out[j]
+// is the weighted sum of taps[t][j] over t, truncated to a byte. The
+// horizontal pass points the taps at the same row shifted by whole pixels, the
+// vertical pass at neighbouring rows. Every implementation accumulates in
+// float, multiplies before adding and walks the taps in ascending order, so
+// all of them produce the same bytes as the original per-pixel loop.
+typedef void (*blur_taps_fn)(unsigned char *out, const unsigned char *const *taps,
+                             const float *weights, int ntaps, int start, int end);
+
+static void blur_taps_scalar(unsigned char *out, const unsigned char *const *taps,
+                             const float *weights, int ntaps, int start, int end) {
+    for (int j = start; j < end; j++) {
+        float value = 0.0f;
+        for (int t = 0; t < ntaps; t++) {
+            value += taps[t][j] * weights[t];
+        }
+        out[j] = (unsigned char)(value);
+    }
+}
+
+#ifdef GG_X86
+
+__attribute__((target("sse2")))
+static void blur_taps_sse2(unsigned char *out, const unsigned char *const *taps,
+                           const float *weights, int ntaps, int start, int end) {
+    const __m128i zero = _mm_setzero_si128();
+    int j = start;
+
+    for (; j + 16 <= end; j += 16) {
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        __m128 acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+
+        for (int t = 0; t < ntaps; t++) {
+            __m128 w = _mm_set1_ps(weights[t]);
+            __m128i px = _mm_loadu_si128((const __m128i *)(taps[t] + j));
+            __m128i lo = _mm_unpacklo_epi8(px, zero);
+            __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), w));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), w));
+            acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), w));
+            acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), w));
+        }
+
+        // Truncate like the scalar cast; sums stay within 0..255 so the
+        // saturating packs never clip
+        __m128i words_lo = _mm_packs_epi32(_mm_cvttps_epi32(acc0), _mm_cvttps_epi32(acc1));
+        __m128i words_hi = _mm_packs_epi32(_mm_cvttps_epi32(acc2), _mm_cvttps_epi32(acc3));
+        _mm_storeu_si128((__m128i *)(out + j), _mm_packus_epi16(words_lo, words_hi));
+    }
+
+    blur_taps_scalar(out, taps, weights, ntaps, j, end);
+}
+
+__attribute__((target("avx2")))
+static void blur_taps_avx2(unsigned char *out, const unsigned char *const *taps,
+                           const float *weights, int ntaps, int start, int end) {
+    int j = start;
+
+    for (; j + 32 <= end; j += 32) {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+
+        for (int t = 0; t < ntaps; t++) {
+            __m256 w = _mm256_set1_ps(weights[t]);
+            __m128i lo = _mm_loadu_si128((const __m128i *)(taps[t] + j));
+            __m128i hi = _mm_loadu_si128((const __m128i *)(taps[t] + j + 16));
+
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(lo)), w));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))), w));
+            acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(hi)), w));
+            acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))), w));
+        }
+
+        // The packs work per 128-bit lane, leaving 4-byte groups in the order
+        // 0,2,4,6,1,3,5,7; one cross-lane permute restores memory order.
+        __m256i words_lo = _mm256_packs_epi32(_mm256_cvttps_epi32(acc0), _mm256_cvttps_epi32(acc1));
+        __m256i words_hi = _mm256_packs_epi32(_mm256_cvttps_epi32(acc2), _mm256_cvttps_epi32(acc3));
+        __m256i bytes = _mm256_packus_epi16(words_lo, words_hi);
+        bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *)(out + j), bytes);
+    }
+
+    blur_taps_sse2(out, taps, weights, ntaps, j, end);
+}
+
+GG_TARGET_AVX512
+static void blur_taps_avx512(unsigned char *out, const unsigned char *const *taps,
+                             const float *weights, int ntaps, int start, int end) {
+    int j = start;
+
+    for (; j + 64 <= end; j += 64) {
+        __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+
+        for (int t = 0; t < ntaps; t++) {
+            __m512 w = _mm512_set1_ps(weights[t]);
+            for (int q = 0; q < 4; q++) {
+                __m128i px = _mm_loadu_si128((const __m128i *)(taps[t] + j + 16 * q));
+                acc[q] = _mm512_add_ps(acc[q], _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(px)), w));
+            }
+        }
+
+        // The narrowing conversion keeps memory order and saturates like the packs
+        for (int q = 0; q < 4; q++) {
+            __m512i values = _mm512_max_epi32(_mm512_cvttps_epi32(acc[q]), _mm512_setzero_si512());
+            _mm_storeu_si128((__m128i *)(out + j + 16 * q), _mm512_cvtusepi32_epi8(values));
+        }
+    }
+
+    blur_taps_avx2(out, taps, weights, ntaps, j, end);
+}
+
+static const blur_taps_fn blur_taps_versions[GG_ISA_COUNT] = {
+    blur_taps_scalar, blur_taps_sse2, blur_taps_avx2, blur_taps_avx512,
+};
+
+#else
+
+static const blur_taps_fn blur_taps_versions[GG_ISA_COUNT] = {
+    blur_taps_scalar, blur_taps_scalar, blur_taps_scalar, blur_taps_scalar,
+};
+
+#endif
+
+// Horizontal pass for one row. Pixels closer than radius to either edge drop
+// the taps that fall outside the row, exactly like the original loop; the rest
+// have every tap in range and go through the vector primitive.
+static GG_ALWAYS_INLINE void blur_row_horizontal(unsigned char *out, const unsigned char *in, int width,
+                                                 const int channels, const float *kernel, int radius,
+                                                 const unsigned char **taps, blur_taps_fn blur_taps) {
+    int inner_start = radius < width ? radius : width;
+    int inner_end = width - radius > inner_start ? width - radius : inner_start;
+
+    for (int x = 0; x < width; x++) {
+        if (x == inner_start && inner_end > inner_start) {
+            int kernel_size = 2 * radius + 1;
+            for (int k = 0; k < kernel_size; k++) {
+                taps[k] = in + (inner_start - radius + k) * channels;
+            }
+            blur_taps(out + inner_start * channels, taps, kernel, kernel_size,
+                      0, (inner_end - inner_start) * channels);
+            x = inner_end - 1;
+            continue;
+        }
+        for (int c = 0; c < channels; c++) {
+            float value = 0.0f;
+            for (int k = -radius; k <= radius; k++) {
+                int xk = x + k;
+                if (xk >= 0 && xk < width) {
+                    value += in[xk * channels + c] * kernel[k + radius];
+                }
+            }
+            out[x * channels + c] = (unsigned char)(value);
+        }
+    }
+}
+
+// Number of box passes used by the approximation. Three passes already keep
+// the result within a few levels of the true Gaussian.
+#define BOX_PASSES 3
+
+// State shared by the row bands of one blur. Scratch buffers are allocated
+// per band, and a band that cannot get them sets failed instead of running.
+struct blur_job {
+    gg_image *img;
+    gg_image *temp;
+    const float *kernel;
+    int radius;
+    blur_taps_fn blur_taps;
+    int channels;
+    int radii[BOX_PASSES];
+    int pad;
+    int failed;
+};
+
+static GG_ALWAYS_INLINE void blur_exact_horizontal_body(void *ctx, int start, int end, const int channels) {
+    struct blur_job *job = ctx;
+    const unsigned char **taps = malloc((2 * job->radius + 1) * sizeof(*taps));
+    if (taps == NULL) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (int y = start; y < end; y++) {
+        blur_row_horizontal(ROW(job->temp, y), ROW(job->img, y), job->img->width, channels, job->kernel,
+                            job->radius, taps, job->blur_taps);
+    }
+    free(taps);
+}
+
+GG_CHANNEL_VERSIONS(blur_exact_horizontal, struct blur_job);
+
+// Rows outside the image are skipped, so near the top and bottom edges the
+// tap list is simply shorter
+static void blur_exact_vertical(void *ctx, int start, int end) {
+    struct blur_job *job = ctx;
+    int radius = job->radius;
+    int height = job->img->height;
+    int kernel_size = 2 * radius + 1;
+    const unsigned char **taps = malloc(kernel_size * sizeof(*taps));
+    if (taps == NULL) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (int y = start; y < end; y++) {
+        int first = y - radius < 0 ? radius - y : 0;
+        int last = y + radius >= height ? radius + (height - 1 - y) : kernel_size - 1;
+        for (int k = first; k <= last; k++) {
+            taps[k - first] = ROW(job->temp, y - radius + k);
+        }
+        job->blur_taps(ROW(job->img, y), taps, job->kernel + first, last - first + 1,
+                       0, job->img->width * job->img->channels);
+    }
+    free(taps);
+}
+
+// Direct convolution with the full 2 * radius + 1 tap Gaussian
+static int blur_exact(gg_image *img, int radius) {
+    int width = img->width;
+    int height = img->height;
+    int channels = img->channels;
+
+    int kernel_size = 2 * radius + 1;
+    float *kernel = malloc(kernel_size * sizeof(float));
+    if (kernel == NULL) {
+        return GG_ERR_ALLOC;
+    }
+
+    float sigma = radius / 2.0f;
+    float sum = 0.0f;
+
+    for (int i = 0; i < kernel_size; i++) {
+        float x = i - radius;
+        kernel[i] = expf(-x * x / (2.0f * sigma * sigma));
+        sum += kernel[i];
+    }
+
+    for (int i = 0; i < kernel_size; i++) {
+        kernel[i] /= sum;
+    }
+
+    gg_image temp;
+    if (gg_image_create(&temp, width, height, channels) != GG_OK) {
+        free(kernel);
+        return GG_ERR_ALLOC;
+    }
+
+    struct blur_job job = {0};
+    job.img = img;
+    job.temp = &temp;
+    job.kernel = kernel;
+    job.radius = radius;
+    job.blur_taps = GG_DISPATCH(blur_taps_versions);
+    job.channels = channels;
+
+    int grain = GG_ROW_GRAIN((size_t)width * channels * kernel_size);
+    gg_parallel_for(height, grain, GG_FOR_CHANNELS(blur_exact_horizontal_channel_versions, channels), &job);
+    if (!job.failed) {
+        gg_parallel_for(height, grain, blur_exact_vertical, &job);
+    }
+
+    free(kernel);
+    gg_image_free(&temp);
+
+    return job.failed ? GG_ERR_ALLOC : GG_OK;
+}
+
+// Radii of BOX_PASSES successive box filters whose combined variance matches
+// the given one (W. Jarosz / P. Kovesi, "Fast almost-Gaussian filtering").
+static void box_radii_for_variance(float variance, int radii[BOX_PASSES]) {
+    float ideal = sqrtf(12.0f * variance / BOX_PASSES + 1.0f);
+    int lower = (int)floorf(ideal);
+    if (lower % 2 == 0) {
+        lower--;
+    }
+    int upper = lower + 2;
+
+    float m_ideal = (12.0f * variance - BOX_PASSES * lower * lower - 4.0f * BOX_PASSES * lower - 3.0f * BOX_PASSES) /
+                    (-4.0f * lower - 4.0f);
+    int m = (int)roundf(m_ideal);
+
+    for (int i = 0; i < BOX_PASSES; i++) {
+        radii[i] = ((i < m ? lower : upper) - 1) / 2;
+    }
+}
+
+// Variance of the kernel blur_exact builds. It is cut off at radius = 2 sigma
+// and renormalized, so it is noticeably narrower than sigma^2 suggests, and
+// matching this value keeps both modes visually interchangeable.
+static float exact_kernel_variance(int radius) {
+    float sigma = radius / 2.0f;
+    float sum = 0.0f, moment = 0.0f;
+
+    for (int k = -radius; k <= radius; k++) {
+        float weight = expf(-(float)(k * k) / (2.0f * sigma * sigma));
+        sum += weight;
+        moment += weight * k * k;
+    }
+    return moment / sum;
+}
+
+// Width in bytes of the column strips the vertical box passes work on
+#define BOX_STRIP 64
+
+// Box filter with 16.16 fixed-point division and rounding
+#define BOX_SCALE(box_radius) ((65536u + (2u * (box_radius) + 1) / 2) / (2u * (box_radius) + 1))
+#define BOX_AVERAGE(sum, scale) ((unsigned char)(((sum) * (scale) + 32768u) >> 16))
+
+// One box pass over n pixels of lanes interleaved samples each, spaced step
+// bytes apart. The buffers carry enough zero padding that every output closer
+// than box_radius to either end is outside the support of the blur so far, so
+// those are simply zero and the running sums need no bounds checks. With lanes
+// and step constant, every channel of a pixel is averaged in the same
+// iteration and the sums stay in registers.
+static GG_ALWAYS_INLINE void box_pass(unsigned char *out, const unsigned char *in, int n, const int lanes,
+                                      const int step, int box_radius) {
+    unsigned int scale = BOX_SCALE(box_radius);
+    unsigned int sums[4] = {0};
+    int x = 0;
+
+    for (; x < box_radius && x < n; x++) {
+        for (int c = 0; c < lanes; c++) {
+            out[x * step + c] = 0;
+        }
+    }
+    for (int k = 0; k < 2 * box_radius + 1 && k < n; k++) {
+        for (int c = 0; c < lanes; c++) {
+            sums[c] += in[k * step + c];
+        }
+    }
+    for (; x < n - box_radius; x++) {
+        const unsigned char *entering = in + (x + box_radius + 1) * step;
+        const unsigned char *leaving = in + (x - box_radius) * step;
+        int has_entering = x + box_radius + 1 < n;
+        for (int c = 0; c < lanes; c++) {
+            out[x * step + c] = BOX_AVERAGE(sums[c], scale);
+            sums[c] += has_entering ? entering[c] : 0;
+            sums[c] -= leaving[c];
+        }
+    }
+    for (; x < n; x++) {
+        for (int c = 0; c < lanes; c++) {
+            out[x * step + c] = 0;
+        }
+    }
+}
+
+// One box pass along a line of whole pixels. Up to four channels go through
+// box_pass together; wider pixels one channel at a time.
+static GG_ALWAYS_INLINE void box_pass_line(unsigned char *out, const unsigned char *in, int n, const int channels,
+                                           int box_radius) {
+    if (channels <= 4) {
+        box_pass(out, in, n, channels, channels, box_radius);
+        return;
+    }
+    for (int c = 0; c < channels; c++) {
+        box_pass(out + c, in + c, n, 1, channels, box_radius);
+    }
+}
+
+// Same as box_pass, run on all BOX_STRIP-wide columns of a strip at once so
+// the inner loop walks contiguous bytes and vectorizes
+static GG_ALWAYS_INLINE void box_pass_strip(unsigned char *out, const unsigned char *in, int rows, int bytes,
+                           int box_radius, unsigned int *sums) {
+    unsigned int scale = BOX_SCALE(box_radius);
+    int y = 0;
+
+    memset(sums, 0, bytes * sizeof(*sums));
+    for (; y < box_radius && y < rows; y++) {
+        memset(out + y * BOX_STRIP, 0, bytes);
+    }
+    for (int k = 0; k < 2 * box_radius + 1 && k < rows; k++) {
+        for (int i = 0; i < bytes; i++) {
+            sums[i] += in[k * BOX_STRIP + i];
+        }
+    }
+    for (; y < rows - box_radius; y++) {
+        unsigned char *dst = out + y * BOX_STRIP;
+        const unsigned char *entering = in + (y + box_radius + 1) * BOX_STRIP;
+        const unsigned char *leaving = in + (y - box_radius) * BOX_STRIP;
+        int has_entering = y + box_radius + 1 < rows;
+
+        for (int i = 0; i < bytes; i++) {
+            dst[i] = BOX_AVERAGE(sums[i], scale);
+            sums[i] += has_entering ? entering[i] : 0;
+            sums[i] -= leaving[i];
+        }
+    }
+    for (; y < rows; y++) {
+        memset(out + y * BOX_STRIP, 0, bytes);
+    }
+}
+
+static GG_ALWAYS_INLINE void box_approx_rows_body(void *ctx, int start, int end, const int channels) {
+    struct blur_job *job = ctx;
+    gg_image *img = job->img;
+    int row_bytes = img->width * channels;
+    int pad = job->pad;
+    size_t line_bytes = (size_t)(img->width + 2 * pad) * channels;
+
+    unsigned char *line_a = malloc(line_bytes);
+    unsigned char *line_b = malloc(line_bytes);
+    if (line_a == NULL || line_b == NULL) {
+        free(line_a);
+        free(line_b);
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    memset(line_a, 0, line_bytes);
+    for (int y = start; y < end; y++) {
+        int line_len = img->width + 2 * pad;
+        memcpy(line_a + pad * channels, ROW(img, y), row_bytes);
+        box_pass_line(line_b, line_a, line_len, channels, job->radii[0]);
+        box_pass_line(line_a, line_b, line_len, channels, job->radii[1]);
+        box_pass_line(line_b, line_a, line_len, channels, job->radii[2]);
+        memcpy(ROW(img, y), line_b + pad * channels, row_bytes);
+        memset(line_a, 0, line_bytes);
+    }
+
+    free(line_a);
+    free(line_b);
+}
+
+GG_CHANNEL_VERSIONS(box_approx_rows, struct blur_job);
+
+// Each item is one BOX_STRIP-byte column strip
+static GG_ALWAYS_INLINE void box_approx_strips_body(void *ctx, int start, int end) {
+    struct blur_job *job = ctx;
+    gg_image *img = job->img;
+    int height = img->height;
+    int row_bytes = img->width * img->channels;
+    int pad = job->pad;
+    int strip_rows = height + 2 * pad;
+
+    unsigned char *strip_a = malloc((size_t)strip_rows * BOX_STRIP);
+    unsigned char *strip_b = malloc((size_t)strip_rows * BOX_STRIP);
+    unsigned int *sums = malloc(BOX_STRIP * sizeof(*sums));
+    if (strip_a == NULL || strip_b == NULL || sums == NULL) {
+        free(strip_a);
+        free(strip_b);
+        free(sums);
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (int x0 = start * BOX_STRIP; x0 < end * BOX_STRIP && x0 < row_bytes; x0 += BOX_STRIP) {
+        int bytes = row_bytes - x0 < BOX_STRIP ? row_bytes - x0 : BOX_STRIP;
+
+        memset(strip_a, 0, (size_t)strip_rows * BOX_STRIP);
+        for (int y = 0; y < height; y++) {
+            memcpy(strip_a + (size_t)(pad + y) * BOX_STRIP, ROW(img, y) + x0, bytes);
+        }
+        box_pass_strip(strip_b, strip_a, strip_rows, bytes, job->radii[0], sums);
+        box_pass_strip(strip_a, strip_b, strip_rows, bytes, job->radii[1], sums);
+        box_pass_strip(strip_b, strip_a, strip_rows, bytes, job->radii[2], sums);
+        for (int y = 0; y < height; y++) {
+            memcpy(ROW(img, y) + x0, strip_b + (size_t)(pad + y) * BOX_STRIP, bytes);
+        }
+    }
+
+    free(strip_a);
+    free(strip_b);
+    free(sums);
+}
+
+GG_ROW_KERNEL_VERSIONS(box_approx_strips);
+
+// Gaussian approximated by BOX_PASSES box filters per direction. Each box is a
+// running sum, so the cost per pixel does not depend on the radius. The
+// passes run on zero-extended copies (one line at a time horizontally, one
+// narrow column strip at a time vertically), which makes the cascade equal to
+// a single convolution of the zero-padded image -- the same border treatment
+// as the exact blur -- without a full-size temporary image.
+static int blur_box_approx(gg_image *img, int radius) {
+    struct blur_job job = {0};
+    job.img = img;
+    job.channels = img->channels;
+    box_radii_for_variance(exact_kernel_variance(radius), job.radii);
+
+    int max_radius = 0;
+    for (int i = 0; i < BOX_PASSES; i++) {
+        job.pad += job.radii[i];
+        max_radius = job.radii[i] > max_radius ? job.radii[i] : max_radius;
+    }
+    job.pad += max_radius;
+
+    // Horizontal passes in bands of rows, then vertical passes in bands of strips
+    size_t row_bytes = (size_t)img->width * img->channels;
+    gg_parallel_for(img->height, GG_ROW_GRAIN(row_bytes), GG_FOR_CHANNELS(box_approx_rows_channel_versions, img->channels),
+                    &job);
+    if (!job.failed) {
+        int strips = (int)((row_bytes + BOX_STRIP - 1) / BOX_STRIP);
+        gg_parallel_for(strips, GG_ROW_GRAIN((size_t)img->height * BOX_STRIP), GG_DISPATCH(box_approx_strips_versions),
+                        &job);
+    }
+
+    return job.failed ? GG_ERR_ALLOC : GG_OK;
+}
+
+int gg_blur_ex(gg_image *img, int radius, int mode) {
+    if (img->channels < 3) {
+        return GG_ERR_CHANNELS;
+    }
+    if (radius <= 0) {
+        return GG_ERR_ARGUMENT;
+    }
+
+    if (mode == GG_BLUR_AUTO) {
+        mode = radius > GG_BLUR_APPROX_THRESHOLD ? GG_BLUR_APPROX : GG_BLUR_EXACT;
+    }
+    if (mode == GG_BLUR_APPROX) {
+        return blur_box_approx(img, radius);
+    }
+    if (mode == GG_BLUR_EXACT) {
+        return blur_exact(img, radius);
+    }
+    return GG_ERR_ARGUMENT;
+}
+
+int gg_blur_halo(int radius, int mode) {
+    if (radius <= 0) {
+        return 0;
+    }
+    if (mode == GG_BLUR_AUTO) {
+        mode = radius > GG_BLUR_APPROX_THRESHOLD ? GG_BLUR_APPROX : GG_BLUR_EXACT;
+    }
+    if (mode != GG_BLUR_APPROX) {
+        return radius;
+    }
+
+    // Each box pass widens the support by its own radius
+    int radii[BOX_PASSES];
+    int halo = 0;
+    box_radii_for_variance(exact_kernel_variance(radius), radii);
+    for (int i = 0; i < BOX_PASSES; i++) {
+        halo += radii[i];
+    }
+    return halo;
+}
+
+int gg_blur(gg_image *img, int radius) {
+    return gg_blur_ex(img, radius, GG_BLUR_AUTO);
+}
@@ -0,0 +1,674 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "bmp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BMP_X86 1
+#endif
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_V4_HEADER_SIZE 108
+#define BMP_BI_RGB 0
+#define BMP_BI_BITFIELDS 3
+
+// The staging buffer is written out in blocks of this size. It is a multiple
+// of every common logical block size, as O_DIRECT requires.
+#define BMP_WRITE_BLOCK (4 * 1024 * 1024)
+#define BMP_WRITE_ALIGN 4096
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static uint32_t read_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t read_u16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static void write_u32(unsigned char *p, uint32_t value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+static void write_u16(unsigned char *p, uint16_t value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+// Pixel array layout of an uncompressed 24-bit BMP
+typedef struct {
+    int width;
+    int rows;
+    int top_down;
+    size_t row_size;
+    size_t pixel_offset;
+} bmp_layout;
+
+// Check the headers (at least the file and info header) of a file of the
+// given length
+static int parse_layout(const unsigned char *data, size_t length, bmp_layout *layout) {
+    if (length < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M') {
+        return 1;
+    }
+
+    const unsigned char *info = data + BMP_FILE_HEADER_SIZE;
+    uint32_t pixel_offset = read_u32(data + 10);
+    uint32_t info_size = read_u32(info);
+    int32_t width = (int32_t)read_u32(info + 4);
+    int32_t height = (int32_t)read_u32(info + 8);
+    uint16_t planes = read_u16(info + 12);
+    uint16_t bits = read_u16(info + 14);
+    uint32_t compression = read_u32(info + 16);
+
+    // OS/2 core headers and anything with a palette, masks or compression go to stb
+    if (info_size < BMP_INFO_HEADER_SIZE || planes != 1 || bits != 24 || compression != BMP_BI_RGB) {
+        return 1;
+    }
+    if (width <= 0 || height == 0 || height == INT32_MIN) {
+        return 1;
+    }
+
+    layout->width = width;
+    layout->top_down = height < 0;
+    layout->rows = layout->top_down ? -height : height;
+    layout->row_size = ((size_t)width * 3 + 3) & ~(size_t)3;
+    layout->pixel_offset = pixel_offset;
+    if (pixel_offset > length || (length - pixel_offset) / layout->row_size < (size_t)layout->rows) {
+        return 1;
+    }
+    return 0;
+}
+
+// Describe the pixel array of a mapped file
+static int parse_bmp(const unsigned char *data, size_t length, gg_image *image) {
+    bmp_layout layout;
+    if (parse_layout(data, length, &layout) != 0) {
+        return 1;
+    }
+
+    unsigned char *pixels = (unsigned char *)data + layout.pixel_offset;
+    if (layout.top_down) {
+        gg_image_wrap(image, pixels, layout.width, layout.rows, 3, (ptrdiff_t)layout.row_size);
+    } else {
+        gg_image_wrap(image, pixels + (layout.rows - 1) * layout.row_size, layout.width, layout.rows, 3,
+                      -(ptrdiff_t)layout.row_size);
+    }
+    return 0;
+}
+
+int bmp_map(const char *file_name, bmp_mapping *map) {
+    map->base = NULL;
+    map->length = 0;
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return 1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+
+    size_t length = (size_t)file_stat.st_size;
+    void *base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return 1;
+    }
+
+    if (parse_bmp(base, length, &map->image) != 0) {
+        munmap(base, length);
+        return 1;
+    }
+
+    // The rotations read every row in each block, so ask for all of it up front
+    madvise(base, length, MADV_WILLNEED);
+    map->base = base;
+    map->length = length;
+    return 0;
+}
+
+void bmp_unmap(bmp_mapping *map) {
+    if (map->base != NULL) {
+        munmap(map->base, map->length);
+    }
+    map->base = NULL;
+    map->length = 0;
+    map->image.pixels = NULL;
+}
+
+// Swap the first and third byte of each of count 3- or 4-byte pixels. out may
+// equal in.
+typedef void (*swap_fn)(unsigned char *out, const unsigned char *in, int count);
+
+static void swap_rb3_scalar(unsigned char *out, const unsigned char *in, int count) {
+    for (int x = 0; x < count; x++) {
+        unsigned char first = in[0];
+        out[1] = in[1];
+        out[0] = in[2];
+        out[2] = first;
+        in += 3;
+        out += 3;
+    }
+}
+
+static void swap_rb4_scalar(unsigned char *out, const unsigned char *in, int count) {
+    for (int x = 0; x < count; x++) {
+        unsigned char first = in[0];
+        out[1] = in[1];
+        out[3] = in[3];
+        out[0] = in[2];
+        out[2] = first;
+        in += 4;
+        out += 4;
+    }
+}
+
+#ifdef BMP_X86
+
+// Four pixels at a time as 32-bit lanes: keep G and A, exchange R and B
+__attribute__((target("sse2")))
+static void swap_rb4_sse2(unsigned char *out, const unsigned char *in, int count) {
+    const __m128i keep = _mm_set1_epi32((int)0xff00ff00);
+    const __m128i low = _mm_set1_epi32(0xff);
+    int x = 0;
+
+    for (; x + 4 <= count; x += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(in + x * 4));
+        __m128i swapped = _mm_or_si128(_mm_and_si128(px, keep),
+                                       _mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 16), low),
+                                                    _mm_slli_epi32(_mm_and_si128(px, low), 16)));
+        _mm_storeu_si128((__m128i *)(out + x * 4), swapped);
+    }
+    swap_rb4_scalar(out + x * 4, in + x * 4, count - x);
+}
+
+__attribute__((target("avx2")))
+static void swap_rb4_avx2(unsigned char *out, const unsigned char *in, int count) {
+    const __m256i order = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                           2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(in + x * 4));
+        _mm256_storeu_si256((__m256i *)(out + x * 4), _mm256_shuffle_epi8(px, order));
+    }
+    swap_rb4_scalar(out + x * 4, in + x * 4, count - x);
+}
+
+// Eight pixels per step: each 128-bit lane holds four pixels (12 bytes) plus
+// four bytes that pass through unchanged. The lanes are loaded and stored 12
+// bytes apart, so the pass-through bytes land on bytes that the next store
+// overwrites, and both loads happen before either store, which keeps it safe
+// in place.
+__attribute__((target("avx2")))
+static void swap_rb3_avx2(unsigned char *out, const unsigned char *in, int count) {
+    const __m256i order = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15,
+                                           2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+    int x = 0;
+
+    // The second lane touches bytes up to 3 * x + 28
+    for (; 3 * x + 28 <= 3 * count; x += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in + x * 3));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in + x * 3 + 12));
+        __m256i swapped = _mm256_shuffle_epi8(_mm256_set_m128i(hi, lo), order);
+        _mm_storeu_si128((__m128i *)(out + x * 3), _mm256_castsi256_si128(swapped));
+        _mm_storeu_si128((__m128i *)(out + x * 3 + 12), _mm256_extracti128_si256(swapped, 1));
+    }
+    swap_rb3_scalar(out + x * 3, in + x * 3, count - x);
+}
+
+#endif
+
+static swap_fn select_swap(int channels) {
+    int isa = gg_cpu_isa();
+    (void)isa;
+#ifdef BMP_X86
+    if (isa >= GG_ISA_AVX2) {
+        return channels == 4 ? swap_rb4_avx2 : swap_rb3_avx2;
+    }
+    if (isa >= GG_ISA_SSE2 && channels == 4) {
+        return swap_rb4_sse2;
+    }
+#endif
+    return channels == 4 ? swap_rb4_scalar : swap_rb3_scalar;
+}
+
+// Headers laid out exactly like stbi_write_bmp's: a 40-byte info header for
+// 24-bit files, a 108-byte V4 header with channel masks for 32-bit ones
+static size_t build_header(unsigned char *header, int width, int height, int out_channels, size_t row_size) {
+    size_t info_size = out_channels == 4 ? BMP_V4_HEADER_SIZE : BMP_INFO_HEADER_SIZE;
+    size_t header_size = BMP_FILE_HEADER_SIZE + info_size;
+    unsigned char *info = header + BMP_FILE_HEADER_SIZE;
+
+    memset(header, 0, header_size);
+    header[0] = 'B';
+    header[1] = 'M';
+    write_u32(header + 2, (uint32_t)(header_size + row_size * height));
+    write_u32(header + 10, (uint32_t)header_size);
+
+    write_u32(info, (uint32_t)info_size);
+    write_u32(info + 4, (uint32_t)width);
+    write_u32(info + 8, (uint32_t)height);
+    write_u16(info + 12, 1);
+    write_u16(info + 14, (uint16_t)(out_channels * 8));
+    if (out_channels == 4) {
+        write_u32(info + 16, BMP_BI_BITFIELDS);
+        write_u32(info + 40, 0x00ff0000);
+        write_u32(info + 44, 0x0000ff00);
+        write_u32(info + 48, 0x000000ff);
+        write_u32(info + 52, 0xff000000);
+    }
+    return header_size;
+}
+
+// Convert one image row into file layout: B, G, R(, A) followed by zero padding
+static void encode_row(unsigned char *out, const unsigned char *in, int width, int channels, size_t row_size,
+                       int bgr, swap_fn swap) {
+    size_t bytes;
+
+    if (channels >= 3) {
+        bytes = (size_t)width * channels;
+        if (bgr) {
+            memcpy(out, in, bytes);
+        } else {
+            swap(out, in, width);
+        }
+    } else {
+        // Gray (and gray + alpha, whose alpha BMP cannot keep) goes to all three
+        for (int x = 0; x < width; x++) {
+            out[3 * x] = out[3 * x + 1] = out[3 * x + 2] = in[x * channels];
+        }
+        bytes = (size_t)width * 3;
+    }
+    memset(out + bytes, 0, row_size - bytes);
+}
+
+static int write_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int writev_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        // Skip what was written, including a partly written entry
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return 0;
+}
+
+// Rows that already have the file's layout go out straight from the image
+// with writev, bottom row first, without being copied
+static int write_rows_vectored(int fd, const unsigned char *header, size_t header_size, const gg_image *img,
+                               size_t row_size) {
+    static const unsigned char padding[4] = {0, 0, 0, 0};
+    size_t row_bytes = (size_t)img->width * img->channels;
+    struct iovec iov[IOV_MAX];
+    int count = 0;
+
+    iov[count].iov_base = (void *)header;
+    iov[count++].iov_len = header_size;
+
+    for (int y = img->height - 1; y >= 0; y--) {
+        if (count + 2 > IOV_MAX) {
+            if (writev_all(fd, iov, count) != 0) {
+                return 1;
+            }
+            count = 0;
+        }
+        iov[count].iov_base = img->pixels + (ptrdiff_t)y * img->stride;
+        iov[count++].iov_len = row_bytes;
+        if (row_size > row_bytes) {
+            iov[count].iov_base = (void *)padding;
+            iov[count++].iov_len = row_size - row_bytes;
+        }
+    }
+    return writev_all(fd, iov, count);
+}
+
+// Hand a finished block to the kernel. With BMP_WRITE_DONTNEED the block is
+// queued for writeback right away and the one before it, which has had time
+// to reach the disk, is dropped from the page cache.
+static int flush_block(int fd, const unsigned char *data, size_t length, off_t offset, int flags,
+                       off_t *previous) {
+    if (write_all(fd, data, length) != 0) {
+        return 1;
+    }
+    if (flags & BMP_WRITE_DONTNEED) {
+        sync_file_range(fd, offset, (off_t)length, SYNC_FILE_RANGE_WRITE);
+        if (offset > *previous) {
+            sync_file_range(fd, *previous, offset - *previous,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd, *previous, offset - *previous, POSIX_FADV_DONTNEED);
+            *previous = offset;
+        }
+    }
+    return 0;
+}
+
+// Rows are converted into a large aligned buffer that is written out whole
+// blocks at a time. Only the final partial block is written with O_DIRECT
+// switched off, since direct I/O needs block-sized writes.
+static int write_rows_buffered(int fd, const unsigned char *header, size_t header_size, const gg_image *img,
+                               size_t row_size, int flags, int direct) {
+    size_t capacity = BMP_WRITE_BLOCK + header_size + row_size;
+    capacity = (capacity + BMP_WRITE_ALIGN - 1) / BMP_WRITE_ALIGN * BMP_WRITE_ALIGN;
+    unsigned char *buffer;
+    if (posix_memalign((void **)&buffer, BMP_WRITE_ALIGN, capacity) != 0) {
+        return 1;
+    }
+
+    int out_channels = img->channels == 4 ? 4 : 3;
+    swap_fn swap = select_swap(out_channels);
+    off_t offset = 0, previous = 0;
+    size_t used = header_size;
+    memcpy(buffer, header, header_size);
+
+    for (int y = img->height - 1; y >= 0; y--) {
+        encode_row(buffer + used, img->pixels + (ptrdiff_t)y * img->stride, img->width, img->channels, row_size,
+                   flags & BMP_WRITE_BGR, swap);
+        used += row_size;
+
+        if (used >= BMP_WRITE_BLOCK) {
+            if (flush_block(fd, buffer, BMP_WRITE_BLOCK, offset, flags, &previous) != 0) {
+                free(buffer);
+                return 1;
+            }
+            offset += BMP_WRITE_BLOCK;
+            used -= BMP_WRITE_BLOCK;
+            memmove(buffer, buffer + BMP_WRITE_BLOCK, used);
+        }
+    }
+
+    if (direct) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    }
+    int result = used > 0 ? flush_block(fd, buffer, used, offset, flags, &previous) : 0;
+    if (result == 0 && (flags & BMP_WRITE_DONTNEED)) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    free(buffer);
+    return result;
+}
+
+int bmp_write(const char *file_name, const gg_image *img, int flags) {
+    if (img->width <= 0 || img->height <= 0 || img->channels <= 0 || img->channels > 4) {
+        errno = EINVAL;
+        return 1;
+    }
+
+    int out_channels = img->channels == 4 ? 4 : 3;
+    size_t row_size = ((size_t)img->width * out_channels + 3) & ~(size_t)3;
+    if (row_size > (UINT32_MAX - BMP_FILE_HEADER_SIZE - BMP_V4_HEADER_SIZE) / (size_t)img->height) {
+        errno = EFBIG;
+        return 1;
+    }
+
+    unsigned char header[BMP_FILE_HEADER_SIZE + BMP_V4_HEADER_SIZE];
+    size_t header_size = build_header(header, img->width, img->height, out_channels, row_size);
+
+    // Filesystems without direct I/O reject O_DIRECT at open time
+    int direct = (flags & BMP_WRITE_DIRECT) != 0;
+    int fd = direct ? open(file_name, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644) : -1;
+    if (fd < 0) {
+        direct = 0;
+        fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+        return 1;
+    }
+
+    int result;
+    if (!direct && (flags & BMP_WRITE_BGR) && img->channels >= 3) {
+        result = write_rows_vectored(fd, header, header_size, img, row_size);
+        if (result == 0 && (flags & BMP_WRITE_DONTNEED)) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+    } else {
+        result = write_rows_buffered(fd, header, header_size, img, row_size, flags, direct);
+    }
+
+    if (close(fd) != 0) {
+        result = 1;
+    }
+    return result;
+}
+
+int bmp_same_file(const char *file_name, const char *other_file_name) {
+    struct stat a, b;
+    return stat(file_name, &a) == 0 && stat(other_file_name, &b) == 0 && a.st_dev == b.st_dev &&
+           a.st_ino == b.st_ino;
+}
+
+static int pread_all(int fd, unsigned char *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t got = pread(fd, data, length, offset);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        if (got == 0) {
+            errno = EIO;
+            return 1;
+        }
+        data += got;
+        offset += got;
+        length -= (size_t)got;
+    }
+    return 0;
+}
+
+static int pwrite_all(int fd, const unsigned char *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        data += written;
+        offset += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+int bmp_reader_open(const char *file_name, bmp_reader *reader) {
+    reader->fd = open(file_name, O_RDONLY);
+    if (reader->fd < 0) {
+        return 1;
+    }
+
+    struct stat file_stat;
+    unsigned char header[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE];
+    bmp_layout layout;
+    if (fstat(reader->fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+        (size_t)file_stat.st_size < sizeof(header) ||
+        pread_all(reader->fd, header, sizeof(header), 0) != 0 ||
+        parse_layout(header, (size_t)file_stat.st_size, &layout) != 0) {
+        close(reader->fd);
+        reader->fd = -1;
+        errno = EINVAL;
+        return 1;
+    }
+
+    reader->width = layout.width;
+    reader->height = layout.rows;
+    reader->top_down = layout.top_down;
+    reader->row_size = layout.row_size;
+    reader->pixel_offset = (off_t)layout.pixel_offset;
+    return 0;
+}
+
+int bmp_read_rows(bmp_reader *reader, int first_row, int rows, unsigned char *buffer, gg_image *band) {
+    if (first_row < 0 || rows <= 0 || rows > reader->height - first_row) {
+        errno = EINVAL;
+        return 1;
+    }
+
+    // The rows are contiguous in the file either way, just in reverse order
+    // for bottom-up files
+    int file_row = reader->top_down ? first_row : reader->height - first_row - rows;
+    size_t row_size = reader->row_size;
+    off_t offset = reader->pixel_offset + (off_t)file_row * (off_t)row_size;
+    if (pread_all(reader->fd, buffer, (size_t)rows * row_size, offset) != 0) {
+        return 1;
+    }
+
+    swap_fn swap = select_swap(3);
+    for (int y = 0; y < rows; y++) {
+        swap(buffer + (size_t)y * row_size, buffer + (size_t)y * row_size, reader->width);
+    }
+
+    if (reader->top_down) {
+        gg_image_wrap(band, buffer, reader->width, rows, 3, (ptrdiff_t)row_size);
+    } else {
+        gg_image_wrap(band, buffer + (size_t)(rows - 1) * row_size, reader->width, rows, 3, -(ptrdiff_t)row_size);
+    }
+    return 0;
+}
+
+void bmp_reader_close(bmp_reader *reader) {
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    reader->fd = -1;
+}
+
+int bmp_writer_open(const char *file_name, int width, int height, int channels, int flags, bmp_writer *writer) {
+    writer->fd = -1;
+    writer->buffer = NULL;
+    if (width <= 0 || height <= 0 || channels <= 0 || channels > 4) {
+        errno = EINVAL;
+        return 1;
+    }
+
+    int out_channels = channels == 4 ? 4 : 3;
+    size_t row_size = ((size_t)width * out_channels + 3) & ~(size_t)3;
+    if (row_size > (UINT32_MAX - BMP_FILE_HEADER_SIZE - BMP_V4_HEADER_SIZE) / (size_t)height) {
+        errno = EFBIG;
+        return 1;
+    }
+
+    unsigned char header[BMP_FILE_HEADER_SIZE + BMP_V4_HEADER_SIZE];
+    size_t header_size = build_header(header, width, height, out_channels, row_size);
+
+    size_t chunk_rows = BMP_WRITE_BLOCK / row_size > 0 ? BMP_WRITE_BLOCK / row_size : 1;
+    writer->capacity = chunk_rows * row_size;
+    writer->buffer = malloc(writer->capacity);
+    if (writer->buffer == NULL) {
+        errno = ENOMEM;
+        return 1;
+    }
+
+    // The file gets its final size up front, so bands can land in any order
+    writer->fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0 || pwrite_all(writer->fd, header, header_size, 0) != 0 ||
+        ftruncate(writer->fd, (off_t)(header_size + row_size * height)) != 0) {
+        bmp_writer_close(writer);
+        return 1;
+    }
+
+    writer->width = width;
+    writer->height = height;
+    writer->channels = channels;
+    writer->flags = flags;
+    writer->row_size = row_size;
+    writer->pixel_offset = (off_t)header_size;
+    return 0;
+}
+
+int bmp_write_rows(bmp_writer *writer, int first_row, const gg_image *rows) {
+    if (rows->width != writer->width || rows->channels != writer->channels || first_row < 0 ||
+        rows->height > writer->height - first_row) {
+        errno = EINVAL;
+        return 1;
+    }
+
+    size_t row_size = writer->row_size;
+    int chunk_rows = (int)(writer->capacity / row_size);
+    swap_fn swap = select_swap(writer->channels == 4 ? 4 : 3);
+
+    // Bottom row first, as in the file
+    for (int y = rows->height; y > 0;) {
+        int count = y < chunk_rows ? y : chunk_rows;
+        for (int i = 0; i < count; i++) {
+            const unsigned char *row = rows->pixels + (ptrdiff_t)(y - 1 - i) * rows->stride;
+            encode_row(writer->buffer + (size_t)i * row_size, row, rows->width, rows->channels, row_size,
+                       writer->flags & BMP_WRITE_BGR, swap);
+        }
+        off_t offset = writer->pixel_offset + (off_t)(writer->height - first_row - y) * (off_t)row_size;
+        if (pwrite_all(writer->fd, writer->buffer, (size_t)count * row_size, offset) != 0) {
+            return 1;
+        }
+        y -= count;
+    }
+
+    if (writer->flags & BMP_WRITE_DONTNEED) {
+        off_t start = writer->pixel_offset + (off_t)(writer->height - first_row - rows->height) * (off_t)row_size;
+        off_t length = (off_t)rows->height * (off_t)row_size;
+        sync_file_range(writer->fd, start, length,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(writer->fd, start, length, POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+int bmp_writer_close(bmp_writer *writer) {
+    int result = 0;
+    if (writer->fd >= 0 && close(writer->fd) != 0) {
+        result = 1;
+    }
+    free(writer->buffer);
+    writer->fd = -1;
+    writer->buffer = NULL;
+    return result;
+}
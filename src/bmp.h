@@ -0,0 +1,79 @@
+#ifndef BMP_H
+#define BMP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "ggpicture.h"
+
+// A BMP file mapped read-only into memory. image describes the pixel array in
+// place: rows are padded to 4 bytes, bottom-up files get a negative stride so
+// image->pixels always points at the top row, and the channel order is the
+// file's B, G, R. Nothing is copied or converted.
+typedef struct {
+    gg_image image;
+    void *base;
+    size_t length;
+} bmp_mapping;
+
+// Map an uncompressed 24-bit BMP. Returns 0 on success and 1 if the file is
+// not in that form (or cannot be mapped), in which case the caller should fall
+// back to a decoding loader. Prints nothing.
+int bmp_map(const char *file_name, bmp_mapping *map);
+void bmp_unmap(bmp_mapping *map);
+
+// bmp_write flags
+#define BMP_WRITE_BGR 1      // pixels are already in B, G, R(, A) order, as in a bmp_mapping
+#define BMP_WRITE_DIRECT 2   // bypass the page cache with O_DIRECT where the filesystem allows it
+#define BMP_WRITE_DONTNEED 4 // drop written data from the page cache as the file is written
+
+// Encode img as a bottom-up BMP: 32-bit with alpha for 4 channels, 24-bit
+// otherwise (gray is expanded), with the same bytes stbi_write_bmp produces.
+// Returns 0 on success and 1 with errno set on failure. Prints nothing.
+int bmp_write(const char *file_name, const gg_image *img, int flags);
+
+// 1 if both paths name the same existing file, as when an output would
+// truncate the input it is computed from. Prints nothing.
+int bmp_same_file(const char *file_name, const char *other_file_name);
+
+// Row-band access to files too large to hold in memory. Rows are numbered top
+// to bottom whatever the file's row order.
+typedef struct {
+    int fd;
+    int width;
+    int height;
+    int top_down;
+    size_t row_size; // bytes per row in the file, padding included
+    off_t pixel_offset;
+} bmp_reader;
+
+// Open an uncompressed 24-bit BMP. Returns 1 with errno set if the file cannot
+// be opened or is in any other format. Prints nothing.
+int bmp_reader_open(const char *file_name, bmp_reader *reader);
+// Read rows [first_row, first_row + rows) into buffer, which must hold
+// rows * reader->row_size bytes, convert them to R, G, B in place and describe
+// them in band (3 channels, stride +/- row_size).
+int bmp_read_rows(bmp_reader *reader, int first_row, int rows, unsigned char *buffer, gg_image *band);
+void bmp_reader_close(bmp_reader *reader);
+
+typedef struct {
+    int fd;
+    int width;
+    int height;
+    int channels;
+    int flags;
+    size_t row_size;
+    off_t pixel_offset;
+    unsigned char *buffer;
+    size_t capacity;
+} bmp_writer;
+
+// Create a width x height file with the same header bmp_write would give it.
+// Bands are then written with bmp_write_rows, in any order, and the result is
+// byte for byte what bmp_write produces for the whole image. flags as for
+// bmp_write, except that BMP_WRITE_DIRECT is ignored.
+int bmp_writer_open(const char *file_name, int width, int height, int channels, int flags, bmp_writer *writer);
+int bmp_write_rows(bmp_writer *writer, int first_row, const gg_image *rows);
+// Returns 1 if the file could not be closed cleanly
+int bmp_writer_close(bmp_writer *writer);
+
+#endif
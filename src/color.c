@@ -0,0 +1,505 @@
+#include <stdint.h>
+#include <math.h>
+#include "ggpicture_internal.h"
+
+#ifdef GG_X86
+#include <immintrin.h>
+#endif
+
+// Coefficients are applied as 16-bit fixed point with MATRIX_SHIFT fraction
+// bits. Each output channel is two multiply-add pairs, (R, G) and (B, 128):
+// the offset rides on a constant lane of 128 so that offsets up to
+// GG_COLOR_MATRIX_MAX_OFFSET still fit in 16 bits.
+#define MATRIX_SHIFT 12
+#define OFFSET_LANE 128
+
+typedef struct {
+    int16_t rg[3][2];
+    int16_t bk[3][2];
+} fixed_matrix;
+
+// Pixels are gathered into one plane per channel a chunk at a time, so the
+// vector code never has to deal with 3- or 4-byte pixels
+#define PLANE_CHUNK 256
+
+// Replace each of planes[0..2][start, end) with the result for the R, G, B
+// values at that index
+typedef void (*planes_fn)(unsigned char *const *planes, const void *params, int start, int end);
+
+// The matrix versions compute
+// (m0 * R + m1 * G + m2 * B + offset * 128) >> MATRIX_SHIFT in 32-bit integers
+// and clamp it to 0..255, so all of them produce the same bytes.
+
+static void matrix_planes_scalar(unsigned char *const *planes, const void *params, int start, int end) {
+    const fixed_matrix *m = params;
+    for (int j = start; j < end; j++) {
+        int r = planes[0][j], g = planes[1][j], b = planes[2][j];
+        for (int c = 0; c < 3; c++) {
+            int value = (m->rg[c][0] * r + m->rg[c][1] * g + m->bk[c][0] * b + m->bk[c][1] * OFFSET_LANE) >>
+                        MATRIX_SHIFT;
+            planes[c][j] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+        }
+    }
+}
+
+#ifdef GG_X86
+
+// Both halves of a multiply-add pair as one 32-bit lane
+static int32_t pair_weights(const int16_t *pair) {
+    return (int32_t)((uint32_t)(uint16_t)pair[1] << 16 | (uint16_t)pair[0]);
+}
+
+__attribute__((target("sse2")))
+static void matrix_planes_sse2(unsigned char *const *planes, const void *params, int start, int end) {
+    const fixed_matrix *m = params;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lane = _mm_set1_epi16(OFFSET_LANE);
+    __m128i rg_weights[3], bk_weights[3];
+    for (int c = 0; c < 3; c++) {
+        rg_weights[c] = _mm_set1_epi32(pair_weights(m->rg[c]));
+        bk_weights[c] = _mm_set1_epi32(pair_weights(m->bk[c]));
+    }
+
+    int j = start;
+    for (; j + 16 <= end; j += 16) {
+        __m128i r = _mm_loadu_si128((const __m128i *)(planes[0] + j));
+        __m128i g = _mm_loadu_si128((const __m128i *)(planes[1] + j));
+        __m128i b = _mm_loadu_si128((const __m128i *)(planes[2] + j));
+        __m128i r_lo = _mm_unpacklo_epi8(r, zero), r_hi = _mm_unpackhi_epi8(r, zero);
+        __m128i g_lo = _mm_unpacklo_epi8(g, zero), g_hi = _mm_unpackhi_epi8(g, zero);
+        __m128i b_lo = _mm_unpacklo_epi8(b, zero), b_hi = _mm_unpackhi_epi8(b, zero);
+
+        __m128i rg[4] = {_mm_unpacklo_epi16(r_lo, g_lo), _mm_unpackhi_epi16(r_lo, g_lo),
+                         _mm_unpacklo_epi16(r_hi, g_hi), _mm_unpackhi_epi16(r_hi, g_hi)};
+        __m128i bk[4] = {_mm_unpacklo_epi16(b_lo, lane), _mm_unpackhi_epi16(b_lo, lane),
+                         _mm_unpacklo_epi16(b_hi, lane), _mm_unpackhi_epi16(b_hi, lane)};
+
+        for (int c = 0; c < 3; c++) {
+            __m128i sums[4];
+            for (int q = 0; q < 4; q++) {
+                sums[q] = _mm_add_epi32(_mm_madd_epi16(rg[q], rg_weights[c]), _mm_madd_epi16(bk[q], bk_weights[c]));
+                sums[q] = _mm_srai_epi32(sums[q], MATRIX_SHIFT);
+            }
+            // The saturating packs do the clamping
+            __m128i words_lo = _mm_packs_epi32(sums[0], sums[1]);
+            __m128i words_hi = _mm_packs_epi32(sums[2], sums[3]);
+            _mm_storeu_si128((__m128i *)(planes[c] + j), _mm_packus_epi16(words_lo, words_hi));
+        }
+    }
+
+    matrix_planes_scalar(planes, m, j, end);
+}
+
+__attribute__((target("avx2")))
+static void matrix_planes_avx2(unsigned char *const *planes, const void *params, int start, int end) {
+    const fixed_matrix *m = params;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lane = _mm256_set1_epi16(OFFSET_LANE);
+    __m256i rg_weights[3], bk_weights[3];
+    for (int c = 0; c < 3; c++) {
+        rg_weights[c] = _mm256_set1_epi32(pair_weights(m->rg[c]));
+        bk_weights[c] = _mm256_set1_epi32(pair_weights(m->bk[c]));
+    }
+
+    // The unpacks and packs both work per 128-bit lane and undo each other,
+    // so unlike the blur no cross-lane permute is needed
+    int j = start;
+    for (; j + 32 <= end; j += 32) {
+        __m256i r = _mm256_loadu_si256((const __m256i *)(planes[0] + j));
+        __m256i g = _mm256_loadu_si256((const __m256i *)(planes[1] + j));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(planes[2] + j));
+        __m256i r_lo = _mm256_unpacklo_epi8(r, zero), r_hi = _mm256_unpackhi_epi8(r, zero);
+        __m256i g_lo = _mm256_unpacklo_epi8(g, zero), g_hi = _mm256_unpackhi_epi8(g, zero);
+        __m256i b_lo = _mm256_unpacklo_epi8(b, zero), b_hi = _mm256_unpackhi_epi8(b, zero);
+
+        __m256i rg[4] = {_mm256_unpacklo_epi16(r_lo, g_lo), _mm256_unpackhi_epi16(r_lo, g_lo),
+                         _mm256_unpacklo_epi16(r_hi, g_hi), _mm256_unpackhi_epi16(r_hi, g_hi)};
+        __m256i bk[4] = {_mm256_unpacklo_epi16(b_lo, lane), _mm256_unpackhi_epi16(b_lo, lane),
+                         _mm256_unpacklo_epi16(b_hi, lane), _mm256_unpackhi_epi16(b_hi, lane)};
+
+        for (int c = 0; c < 3; c++) {
+            __m256i sums[4];
+            for (int q = 0; q < 4; q++) {
+                sums[q] = _mm256_add_epi32(_mm256_madd_epi16(rg[q], rg_weights[c]),
+                                           _mm256_madd_epi16(bk[q], bk_weights[c]));
+                sums[q] = _mm256_srai_epi32(sums[q], MATRIX_SHIFT);
+            }
+            __m256i words_lo = _mm256_packs_epi32(sums[0], sums[1]);
+            __m256i words_hi = _mm256_packs_epi32(sums[2], sums[3]);
+            _mm256_storeu_si256((__m256i *)(planes[c] + j), _mm256_packus_epi16(words_lo, words_hi));
+        }
+    }
+
+    matrix_planes_sse2(planes, m, j, end);
+}
+
+// The AVX2 loop with four 128-bit lanes instead of two
+GG_TARGET_AVX512
+static void matrix_planes_avx512(unsigned char *const *planes, const void *params, int start, int end) {
+    const fixed_matrix *m = params;
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i lane = _mm512_set1_epi16(OFFSET_LANE);
+    __m512i rg_weights[3], bk_weights[3];
+    for (int c = 0; c < 3; c++) {
+        rg_weights[c] = _mm512_set1_epi32(pair_weights(m->rg[c]));
+        bk_weights[c] = _mm512_set1_epi32(pair_weights(m->bk[c]));
+    }
+
+    int j = start;
+    for (; j + 64 <= end; j += 64) {
+        __m512i r = _mm512_loadu_si512((const void *)(planes[0] + j));
+        __m512i g = _mm512_loadu_si512((const void *)(planes[1] + j));
+        __m512i b = _mm512_loadu_si512((const void *)(planes[2] + j));
+        __m512i r_lo = _mm512_unpacklo_epi8(r, zero), r_hi = _mm512_unpackhi_epi8(r, zero);
+        __m512i g_lo = _mm512_unpacklo_epi8(g, zero), g_hi = _mm512_unpackhi_epi8(g, zero);
+        __m512i b_lo = _mm512_unpacklo_epi8(b, zero), b_hi = _mm512_unpackhi_epi8(b, zero);
+
+        __m512i rg[4] = {_mm512_unpacklo_epi16(r_lo, g_lo), _mm512_unpackhi_epi16(r_lo, g_lo),
+                         _mm512_unpacklo_epi16(r_hi, g_hi), _mm512_unpackhi_epi16(r_hi, g_hi)};
+        __m512i bk[4] = {_mm512_unpacklo_epi16(b_lo, lane), _mm512_unpackhi_epi16(b_lo, lane),
+                         _mm512_unpacklo_epi16(b_hi, lane), _mm512_unpackhi_epi16(b_hi, lane)};
+
+        for (int c = 0; c < 3; c++) {
+            __m512i sums[4];
+            for (int q = 0; q < 4; q++) {
+                sums[q] = _mm512_add_epi32(_mm512_madd_epi16(rg[q], rg_weights[c]),
+                                           _mm512_madd_epi16(bk[q], bk_weights[c]));
+                sums[q] = _mm512_srai_epi32(sums[q], MATRIX_SHIFT);
+            }
+            __m512i words_lo = _mm512_packs_epi32(sums[0], sums[1]);
+            __m512i words_hi = _mm512_packs_epi32(sums[2], sums[3]);
+            _mm512_storeu_si512((void *)(planes[c] + j), _mm512_packus_epi16(words_lo, words_hi));
+        }
+    }
+
+    matrix_planes_avx2(planes, m, j, end);
+}
+
+static const planes_fn matrix_planes_versions[GG_ISA_COUNT] = {
+    matrix_planes_scalar, matrix_planes_sse2, matrix_planes_avx2, matrix_planes_avx512,
+};
+
+#else
+
+static const planes_fn matrix_planes_versions[GG_ISA_COUNT] = {
+    matrix_planes_scalar, matrix_planes_scalar, matrix_planes_scalar, matrix_planes_scalar,
+};
+
+#endif
+
+void gg_color_matrix_black_and_white(gg_color_matrix *matrix) {
+    for (int c = 0; c < 3; c++) {
+        matrix->m[c][0] = 0.299f;
+        matrix->m[c][1] = 0.587f;
+        matrix->m[c][2] = 0.114f;
+        matrix->m[c][3] = 0.0f;
+    }
+}
+
+void gg_color_matrix_vintage(gg_color_matrix *matrix) {
+    static const float sepia[3][4] = {
+        {0.393f, 0.769f, 0.189f, 0.0f},
+        {0.349f, 0.686f, 0.168f, 0.0f},
+        {0.272f, 0.534f, 0.131f, 0.0f},
+    };
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 4; k++) {
+            matrix->m[c][k] = sepia[c][k];
+        }
+    }
+}
+
+int gg_color_matrix_valid(const gg_color_matrix *matrix) {
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            float value = matrix->m[c][k];
+            if (!(value >= -GG_COLOR_MATRIX_MAX_COEFF && value < GG_COLOR_MATRIX_MAX_COEFF)) {
+                return 0;
+            }
+        }
+        float offset = matrix->m[c][3];
+        if (!(offset >= -GG_COLOR_MATRIX_MAX_OFFSET && offset < GG_COLOR_MATRIX_MAX_OFFSET)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int16_t to_fixed(float value, int scale) {
+    long fixed = lrintf(value * scale);
+    return (int16_t)(fixed < INT16_MIN ? INT16_MIN : (fixed > INT16_MAX ? INT16_MAX : fixed));
+}
+
+struct planes_job {
+    gg_image *img;
+    planes_fn fn;
+    const void *params;
+};
+
+static void planes_rows(void *ctx, int start, int end) {
+    struct planes_job *job = ctx;
+    gg_image *img = job->img;
+    int channels = img->channels;
+    unsigned char r[PLANE_CHUNK], g[PLANE_CHUNK], b[PLANE_CHUNK];
+    unsigned char *const planes[3] = {r, g, b};
+
+    for (int y = start; y < end; y++) {
+        unsigned char *row = ROW(img, y);
+        for (int x = 0; x < img->width; x += PLANE_CHUNK) {
+            int count = img->width - x < PLANE_CHUNK ? img->width - x : PLANE_CHUNK;
+            unsigned char *px = row + (ptrdiff_t)x * channels;
+
+            const unsigned char *in = px;
+            for (int i = 0; i < count; i++, in += channels) {
+                r[i] = in[0];
+                g[i] = in[1];
+                b[i] = in[2];
+            }
+            job->fn(planes, job->params, 0, count);
+            // Any alpha channel is left as it was
+            unsigned char *out = px;
+            for (int i = 0; i < count; i++, out += channels) {
+                out[0] = r[i];
+                out[1] = g[i];
+                out[2] = b[i];
+            }
+        }
+    }
+}
+
+// Run fn over every pixel of an image with at least three channels
+static void run_planes(gg_image *img, planes_fn fn, const void *params) {
+    struct planes_job job = {img, fn, params};
+    gg_parallel_for(img->height, GG_ROW_GRAIN((size_t)img->width * img->channels), planes_rows, &job);
+}
+
+int gg_apply_color_matrix(gg_image *img, const gg_color_matrix *matrix) {
+    if (img->channels < 3) {
+        return GG_ERR_CHANNELS;
+    }
+    if (!gg_color_matrix_valid(matrix)) {
+        return GG_ERR_ARGUMENT;
+    }
+
+    fixed_matrix fixed;
+    for (int c = 0; c < 3; c++) {
+        fixed.rg[c][0] = to_fixed(matrix->m[c][0], 1 << MATRIX_SHIFT);
+        fixed.rg[c][1] = to_fixed(matrix->m[c][1], 1 << MATRIX_SHIFT);
+        fixed.bk[c][0] = to_fixed(matrix->m[c][2], 1 << MATRIX_SHIFT);
+        fixed.bk[c][1] = to_fixed(matrix->m[c][3], (1 << MATRIX_SHIFT) / OFFSET_LANE);
+    }
+
+    run_planes(img, GG_DISPATCH(matrix_planes_versions), &fixed);
+    return GG_OK;
+}
+
+int gg_black_and_white(gg_image *img) {
+    gg_color_matrix matrix;
+    gg_color_matrix_black_and_white(&matrix);
+    return gg_apply_color_matrix(img, &matrix);
+}
+
+int gg_vintage(gg_image *img) {
+    gg_color_matrix matrix;
+    gg_color_matrix_vintage(&matrix);
+    return gg_apply_color_matrix(img, &matrix);
+}
+
+// With hue and lightness fixed, scaling the HSL saturation by f scales every
+// channel's distance from L = (max + min) / 2 by f, as long as the new
+// saturation stays within 0..1. The clamp at 1 becomes a cap on the scale:
+// chroma (max - min) times the scale may not exceed the room
+// 255 - |max + min - 255| that L leaves. So each pixel is
+// L + k * (v - L) with k = f, or room / chroma when that is smaller, and k
+// never below 0. Every implementation does the same float operations in the
+// same order and truncates, so all of them produce the same bytes, within one
+// level of the HSL round trip.
+static void saturation_planes_scalar(unsigned char *const *planes, const void *params, int start, int end) {
+    float factor = *(const float *)params;
+    for (int j = start; j < end; j++) {
+        float r = planes[0][j], g = planes[1][j], b = planes[2][j];
+        float max = fmaxf(r, fmaxf(g, b));
+        float min = fminf(r, fminf(g, b));
+        float sum = max + min;
+        float chroma = max - min;
+        float room = 255.0f - fabsf(sum - 255.0f);
+        float k = factor * chroma > room ? room / fmaxf(chroma, 1.0f) : factor;
+        k = fmaxf(k, 0.0f);
+        float l = sum * 0.5f;
+
+        for (int c = 0; c < 3; c++) {
+            int value = (int)(l + k * (planes[c][j] - l));
+            planes[c][j] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+        }
+    }
+}
+
+#ifdef GG_X86
+
+// Four pixels' worth of channels as floats, scaled in place
+__attribute__((target("sse2")))
+static inline void saturate_sse2(__m128 *r, __m128 *g, __m128 *b, __m128 factor) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 full = _mm_set1_ps(255.0f);
+    __m128 max = _mm_max_ps(*r, _mm_max_ps(*g, *b));
+    __m128 min = _mm_min_ps(*r, _mm_min_ps(*g, *b));
+    __m128 sum = _mm_add_ps(max, min);
+    __m128 chroma = _mm_sub_ps(max, min);
+    __m128 room = _mm_sub_ps(full, _mm_andnot_ps(sign, _mm_sub_ps(sum, full)));
+    __m128 capped = _mm_cmpgt_ps(_mm_mul_ps(factor, chroma), room);
+    __m128 cap = _mm_div_ps(room, _mm_max_ps(chroma, _mm_set1_ps(1.0f)));
+    __m128 k = _mm_or_ps(_mm_and_ps(capped, cap), _mm_andnot_ps(capped, factor));
+    k = _mm_max_ps(k, _mm_setzero_ps());
+    __m128 l = _mm_mul_ps(sum, _mm_set1_ps(0.5f));
+
+    *r = _mm_add_ps(l, _mm_mul_ps(k, _mm_sub_ps(*r, l)));
+    *g = _mm_add_ps(l, _mm_mul_ps(k, _mm_sub_ps(*g, l)));
+    *b = _mm_add_ps(l, _mm_mul_ps(k, _mm_sub_ps(*b, l)));
+}
+
+__attribute__((target("sse2")))
+static void saturation_planes_sse2(unsigned char *const *planes, const void *params, int start, int end) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 factor = _mm_set1_ps(*(const float *)params);
+    int j = start;
+
+    // 16 pixels per iteration, as four groups of four floats
+    for (; j + 16 <= end; j += 16) {
+        __m128 channels[3][4];
+        for (int c = 0; c < 3; c++) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(planes[c] + j));
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            channels[c][0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+            channels[c][1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+            channels[c][2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+            channels[c][3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+        }
+        for (int q = 0; q < 4; q++) {
+            saturate_sse2(&channels[0][q], &channels[1][q], &channels[2][q], factor);
+        }
+        // Truncate like the scalar cast; the saturating packs clamp
+        for (int c = 0; c < 3; c++) {
+            __m128i words_lo = _mm_packs_epi32(_mm_cvttps_epi32(channels[c][0]), _mm_cvttps_epi32(channels[c][1]));
+            __m128i words_hi = _mm_packs_epi32(_mm_cvttps_epi32(channels[c][2]), _mm_cvttps_epi32(channels[c][3]));
+            _mm_storeu_si128((__m128i *)(planes[c] + j), _mm_packus_epi16(words_lo, words_hi));
+        }
+    }
+
+    saturation_planes_scalar(planes, params, j, end);
+}
+
+__attribute__((target("avx2")))
+static inline void saturate_avx2(__m256 *r, __m256 *g, __m256 *b, __m256 factor) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 full = _mm256_set1_ps(255.0f);
+    __m256 max = _mm256_max_ps(*r, _mm256_max_ps(*g, *b));
+    __m256 min = _mm256_min_ps(*r, _mm256_min_ps(*g, *b));
+    __m256 sum = _mm256_add_ps(max, min);
+    __m256 chroma = _mm256_sub_ps(max, min);
+    __m256 room = _mm256_sub_ps(full, _mm256_andnot_ps(sign, _mm256_sub_ps(sum, full)));
+    __m256 capped = _mm256_cmp_ps(_mm256_mul_ps(factor, chroma), room, _CMP_GT_OQ);
+    __m256 cap = _mm256_div_ps(room, _mm256_max_ps(chroma, _mm256_set1_ps(1.0f)));
+    __m256 k = _mm256_blendv_ps(factor, cap, capped);
+    k = _mm256_max_ps(k, _mm256_setzero_ps());
+    __m256 l = _mm256_mul_ps(sum, _mm256_set1_ps(0.5f));
+
+    *r = _mm256_add_ps(l, _mm256_mul_ps(k, _mm256_sub_ps(*r, l)));
+    *g = _mm256_add_ps(l, _mm256_mul_ps(k, _mm256_sub_ps(*g, l)));
+    *b = _mm256_add_ps(l, _mm256_mul_ps(k, _mm256_sub_ps(*b, l)));
+}
+
+__attribute__((target("avx2")))
+static void saturation_planes_avx2(unsigned char *const *planes, const void *params, int start, int end) {
+    const __m256 factor = _mm256_set1_ps(*(const float *)params);
+    int j = start;
+
+    // 16 pixels per iteration, as two groups of eight floats
+    for (; j + 16 <= end; j += 16) {
+        __m256 channels[3][2];
+        for (int c = 0; c < 3; c++) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(planes[c] + j));
+            channels[c][0] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+            channels[c][1] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+        }
+        for (int h = 0; h < 2; h++) {
+            saturate_avx2(&channels[0][h], &channels[1][h], &channels[2][h], factor);
+        }
+        // The 32-bit pack interleaves the 128-bit halves; one permute puts
+        // the words back in order before the final pack to bytes
+        for (int c = 0; c < 3; c++) {
+            __m256i words = _mm256_packs_epi32(_mm256_cvttps_epi32(channels[c][0]), _mm256_cvttps_epi32(channels[c][1]));
+            words = _mm256_permute4x64_epi64(words, _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+            _mm_storeu_si128((__m128i *)(planes[c] + j), bytes);
+        }
+    }
+
+    saturation_planes_sse2(planes, params, j, end);
+}
+
+GG_TARGET_AVX512
+static inline void saturate_avx512(__m512 *r, __m512 *g, __m512 *b, __m512 factor) {
+    const __m512 full = _mm512_set1_ps(255.0f);
+    __m512 max = _mm512_max_ps(*r, _mm512_max_ps(*g, *b));
+    __m512 min = _mm512_min_ps(*r, _mm512_min_ps(*g, *b));
+    __m512 sum = _mm512_add_ps(max, min);
+    __m512 chroma = _mm512_sub_ps(max, min);
+    __m512 room = _mm512_sub_ps(full, _mm512_abs_ps(_mm512_sub_ps(sum, full)));
+    __mmask16 capped = _mm512_cmp_ps_mask(_mm512_mul_ps(factor, chroma), room, _CMP_GT_OQ);
+    __m512 cap = _mm512_div_ps(room, _mm512_max_ps(chroma, _mm512_set1_ps(1.0f)));
+    __m512 k = _mm512_mask_blend_ps(capped, factor, cap);
+    k = _mm512_max_ps(k, _mm512_setzero_ps());
+    __m512 l = _mm512_mul_ps(sum, _mm512_set1_ps(0.5f));
+
+    *r = _mm512_add_ps(l, _mm512_mul_ps(k, _mm512_sub_ps(*r, l)));
+    *g = _mm512_add_ps(l, _mm512_mul_ps(k, _mm512_sub_ps(*g, l)));
+    *b = _mm512_add_ps(l, _mm512_mul_ps(k, _mm512_sub_ps(*b, l)));
+}
+
+GG_TARGET_AVX512
+static void saturation_planes_avx512(unsigned char *const *planes, const void *params, int start, int end) {
+    const __m512 factor = _mm512_set1_ps(*(const float *)params);
+    const __m512i zero = _mm512_setzero_si512();
+    int j = start;
+
+    // 16 pixels per iteration in one register per channel
+    for (; j + 16 <= end; j += 16) {
+        __m512 channels[3];
+        for (int c = 0; c < 3; c++) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(planes[c] + j));
+            channels[c] = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes));
+        }
+        saturate_avx512(&channels[0], &channels[1], &channels[2], factor);
+        // Clamping below at 0 and narrowing with unsigned saturation gives
+        // the same bytes as the packs, in memory order
+        for (int c = 0; c < 3; c++) {
+            __m512i values = _mm512_max_epi32(_mm512_cvttps_epi32(channels[c]), zero);
+            _mm_storeu_si128((__m128i *)(planes[c] + j), _mm512_cvtusepi32_epi8(values));
+        }
+    }
+
+    saturation_planes_avx2(planes, params, j, end);
+}
+
+static const planes_fn saturation_planes_versions[GG_ISA_COUNT] = {
+    saturation_planes_scalar, saturation_planes_sse2, saturation_planes_avx2, saturation_planes_avx512,
+};
+
+#else
+
+static const planes_fn saturation_planes_versions[GG_ISA_COUNT] = {
+    saturation_planes_scalar, saturation_planes_scalar, saturation_planes_scalar, saturation_planes_scalar,
+};
+
+#endif
+
+int gg_saturation(gg_image *img, int percentage) {
+    if (img->channels < 3) {
+        return GG_ERR_CHANNELS;
+    }
+
+    float factor = 1.0f + (percentage / 100.0f); // Saturation adjustment factor
+    run_planes(img, GG_DISPATCH(saturation_planes_versions), &factor);
+    return GG_OK;
+}
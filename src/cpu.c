@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ggpicture.h"
+
+// Level detected on first use (-1 until then), already capped by GGPICTURE_ISA
+static int detected_isa = -1;
+
+// Cap set through gg_set_max_isa; -1 means "whatever the CPU supports"
+static int max_isa = -1;
+
+static int detect_isa(void) {
+    int isa = GG_ISA_SCALAR;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        isa = GG_ISA_SSE2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        isa = GG_ISA_AVX2;
+    }
+    // The feature set GG_TARGET_AVX512 compiles for
+    if (isa == GG_ISA_AVX2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl")) {
+        isa = GG_ISA_AVX512;
+    }
+#endif
+
+    // A forced level can only go down: code for a level the CPU lacks would crash
+    static const char *const names[] = {"scalar", "sse2", "avx2", "avx512"};
+    const char *forced = getenv("GGPICTURE_ISA");
+    for (int level = 0; forced != NULL && level < (int)(sizeof(names) / sizeof(names[0])); level++) {
+        if (strcmp(forced, names[level]) == 0 && level < isa) {
+            isa = level;
+        }
+    }
+    return isa;
+}
+
+int gg_cpu_isa(void) {
+    int isa = __atomic_load_n(&detected_isa, __ATOMIC_RELAXED);
+    if (isa < 0) {
+        isa = detect_isa();
+        __atomic_store_n(&detected_isa, isa, __ATOMIC_RELAXED);
+    }
+
+    if (max_isa >= 0 && isa > max_isa) {
+        isa = max_isa;
+    }
+    return isa;
+}
+
+void gg_set_max_isa(int isa) {
+    max_isa = isa;
+}
@@ -0,0 +1,373 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include "ggpicture_internal.h"
+
+// Freed pixel buffers kept for reuse while gg_set_buffer_cache is on, oldest
+// first. glibc hands large requests out as fresh mappings and unmaps them on
+// free, so without the cache a process that works through image after image
+// faults in and zeroes every page of every buffer again.
+#define BUFFER_CACHE_SLOTS 32
+// Smaller blocks come back from malloc's own free lists anyway
+#define BUFFER_CACHE_MIN_BYTES (64 * 1024)
+
+static struct {
+    pthread_mutex_t mutex;
+    size_t limit;
+    size_t held;
+    int count;
+    void *buffers[BUFFER_CACHE_SLOTS];
+    size_t sizes[BUFFER_CACHE_SLOTS];
+} buffer_cache = {PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, {NULL}, {0}};
+
+// Drop the oldest buffers until a new one of incoming bytes fits under the
+// limit and in a free slot, handing them to evicted to be freed outside the
+// lock. Returns how many were dropped.
+static int evict_buffers(size_t incoming, void **evicted) {
+    int dropped = 0;
+    while (buffer_cache.count > 0 &&
+           (buffer_cache.held + incoming > buffer_cache.limit ||
+            (incoming > 0 && buffer_cache.count == BUFFER_CACHE_SLOTS))) {
+        evicted[dropped++] = buffer_cache.buffers[0];
+        buffer_cache.held -= buffer_cache.sizes[0];
+        buffer_cache.count--;
+        memmove(buffer_cache.buffers, buffer_cache.buffers + 1, buffer_cache.count * sizeof(*buffer_cache.buffers));
+        memmove(buffer_cache.sizes, buffer_cache.sizes + 1, buffer_cache.count * sizeof(*buffer_cache.sizes));
+    }
+    return dropped;
+}
+
+void gg_set_buffer_cache(size_t max_bytes) {
+    void *evicted[BUFFER_CACHE_SLOTS];
+    pthread_mutex_lock(&buffer_cache.mutex);
+    buffer_cache.limit = max_bytes;
+    int dropped = evict_buffers(0, evicted);
+    pthread_mutex_unlock(&buffer_cache.mutex);
+    for (int i = 0; i < dropped; i++) {
+        free(evicted[i]);
+    }
+}
+
+void *gg_buffer_alloc(size_t bytes) {
+    if (bytes >= BUFFER_CACHE_MIN_BYTES) {
+        void *buffer = NULL;
+        pthread_mutex_lock(&buffer_cache.mutex);
+        // The smallest cached buffer that fits, unless even that would waste
+        // more than it holds
+        int best = -1;
+        for (int i = 0; i < buffer_cache.count; i++) {
+            size_t size = buffer_cache.sizes[i];
+            if (size >= bytes && size / 2 <= bytes && (best < 0 || size < buffer_cache.sizes[best])) {
+                best = i;
+            }
+        }
+        if (best >= 0) {
+            buffer = buffer_cache.buffers[best];
+            buffer_cache.held -= buffer_cache.sizes[best];
+            buffer_cache.count--;
+            memmove(buffer_cache.buffers + best, buffer_cache.buffers + best + 1,
+                    (buffer_cache.count - best) * sizeof(*buffer_cache.buffers));
+            memmove(buffer_cache.sizes + best, buffer_cache.sizes + best + 1,
+                    (buffer_cache.count - best) * sizeof(*buffer_cache.sizes));
+        }
+        pthread_mutex_unlock(&buffer_cache.mutex);
+        if (buffer != NULL) {
+            return buffer;
+        }
+    }
+    return malloc(bytes);
+}
+
+void gg_buffer_free(void *buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    // Cached buffers are plain malloc blocks, so anything malloc'd may come
+    // through here and anything handed out may go to free instead
+    size_t size = malloc_usable_size(buffer);
+    if (size >= BUFFER_CACHE_MIN_BYTES) {
+        void *evicted[BUFFER_CACHE_SLOTS];
+        int dropped = 0;
+        int kept = 0;
+        pthread_mutex_lock(&buffer_cache.mutex);
+        if (size <= buffer_cache.limit) {
+            dropped = evict_buffers(size, evicted);
+            buffer_cache.buffers[buffer_cache.count] = buffer;
+            buffer_cache.sizes[buffer_cache.count] = size;
+            buffer_cache.count++;
+            buffer_cache.held += size;
+            kept = 1;
+        }
+        pthread_mutex_unlock(&buffer_cache.mutex);
+        for (int i = 0; i < dropped; i++) {
+            free(evicted[i]);
+        }
+        if (kept) {
+            return;
+        }
+    }
+    free(buffer);
+}
+
+int gg_image_create(gg_image *img, int width, int height, int channels) {
+    img->width = 0;
+    img->height = 0;
+    img->channels = 0;
+    img->stride = 0;
+    img->pixels = NULL;
+
+    if (width <= 0 || height <= 0 || channels <= 0 || channels > 4) {
+        return GG_ERR_SIZE;
+    }
+    if ((size_t)width > SIZE_MAX / (size_t)height / (size_t)channels) {
+        return GG_ERR_SIZE;
+    }
+
+    unsigned char *pixels = gg_buffer_alloc((size_t)width * height * channels);
+    if (pixels == NULL) {
+        return GG_ERR_ALLOC;
+    }
+
+    gg_image_wrap(img, pixels, width, height, channels, (ptrdiff_t)width * channels);
+    return GG_OK;
+}
+
+void gg_image_wrap(gg_image *img, unsigned char *pixels, int width, int height, int channels, ptrdiff_t stride) {
+    img->width = width;
+    img->height = height;
+    img->channels = channels;
+    img->stride = stride;
+    img->pixels = pixels;
+}
+
+void gg_image_free(gg_image *img) {
+    gg_buffer_free(img->pixels);
+    img->pixels = NULL;
+    img->width = 0;
+    img->height = 0;
+    img->stride = 0;
+}
+
+const char *gg_strerror(int err) {
+    switch (err) {
+    case GG_OK:
+        return "Success";
+    case GG_ERR_ALLOC:
+        return "Memory allocation failed";
+    case GG_ERR_CHANNELS:
+        return "Image does not have enough color channels for RGB";
+    case GG_ERR_ARGUMENT:
+        return "Invalid argument";
+    case GG_ERR_SIZE:
+        return "Invalid image size";
+    }
+    return "Unknown error";
+}
+
+static unsigned char brightness_value(int value, int percentage) {
+    int adjusted_value = value + (value * percentage / 100);
+    return (unsigned char)(adjusted_value < 0 ? 0 : (adjusted_value > 255 ? 255 : adjusted_value));
+}
+
+static unsigned char contrast_value(int value, float factor) {
+    int midpoint = 128;
+    int adjusted_value = midpoint + (value - midpoint) * factor;
+    return (unsigned char)(adjusted_value < 0 ? 0 : (adjusted_value > 255 ? 255 : adjusted_value));
+}
+
+void gg_lut_identity(gg_lut *lut) {
+    for (int i = 0; i < 256; i++) {
+        lut->table[i] = (unsigned char)i;
+    }
+}
+
+void gg_lut_brightness(gg_lut *lut, int percentage) {
+    for (int i = 0; i < 256; i++) {
+        lut->table[i] = brightness_value(lut->table[i], percentage);
+    }
+}
+
+void gg_lut_contrast(gg_lut *lut, int percentage) {
+    float factor = 1.0f + (percentage / 100.0f);
+    for (int i = 0; i < 256; i++) {
+        lut->table[i] = contrast_value(lut->table[i], factor);
+    }
+}
+
+int gg_lut_is_identity(const gg_lut *lut) {
+    for (int i = 0; i < 256; i++) {
+        if (lut->table[i] != i) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Look up a run of bytes. Eight lookups are assembled into one 64-bit store so
+// the loop issues a load and a store per 8 bytes instead of per byte.
+static void apply_lut_run(unsigned char *data, size_t count, const unsigned char *table) {
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        uint64_t in, out;
+        memcpy(&in, data + i, sizeof(in));
+        out = (uint64_t)table[in & 0xff] |
+              (uint64_t)table[(in >> 8) & 0xff] << 8 |
+              (uint64_t)table[(in >> 16) & 0xff] << 16 |
+              (uint64_t)table[(in >> 24) & 0xff] << 24 |
+              (uint64_t)table[(in >> 32) & 0xff] << 32 |
+              (uint64_t)table[(in >> 40) & 0xff] << 40 |
+              (uint64_t)table[(in >> 48) & 0xff] << 48 |
+              (uint64_t)table[in >> 56] << 56;
+        memcpy(data + i, &out, sizeof(out));
+    }
+    for (; i < count; i++) {
+        data[i] = table[data[i]];
+    }
+}
+
+struct lut_job {
+    gg_image *img;
+    const unsigned char *table;
+};
+
+static void apply_lut_rows(void *ctx, int start, int end) {
+    struct lut_job *job = ctx;
+    gg_image *img = job->img;
+    size_t row_bytes = (size_t)img->width * img->channels;
+
+    // Contiguous bands are treated as a single run
+    if (img->stride == (ptrdiff_t)row_bytes) {
+        apply_lut_run(ROW(img, start), row_bytes * (end - start), job->table);
+        return;
+    }
+
+    for (int y = start; y < end; y++) {
+        apply_lut_run(ROW(img, y), row_bytes, job->table);
+    }
+}
+
+int gg_apply_lut(gg_image *img, const gg_lut *lut) {
+    if (gg_lut_is_identity(lut)) {
+        return GG_OK;
+    }
+
+    struct lut_job job = {img, lut->table};
+    gg_parallel_for(img->height, GG_ROW_GRAIN((size_t)img->width * img->channels), apply_lut_rows, &job);
+    return GG_OK;
+}
+
+int gg_brightness(gg_image *img, int percentage) {
+    gg_lut lut;
+    gg_lut_identity(&lut);
+    gg_lut_brightness(&lut, percentage);
+    return gg_apply_lut(img, &lut);
+}
+
+int gg_contrast(gg_image *img, int percentage) {
+    gg_lut lut;
+    gg_lut_identity(&lut);
+    gg_lut_contrast(&lut, percentage);
+    return gg_apply_lut(img, &lut);
+}
+
+int gg_pixelated_size(const gg_image *src, int pixel_size, int *width, int *height) {
+    if (pixel_size <= 0 || pixel_size > src->width || pixel_size > src->height) {
+        return GG_ERR_ARGUMENT;
+    }
+    // The output is cropped to a whole number of blocks
+    *width = (src->width / pixel_size) * pixel_size;
+    *height = (src->height / pixel_size) * pixel_size;
+    return GG_OK;
+}
+
+struct pixelate_job {
+    const gg_image *src;
+    gg_image *dst;
+    int pixel_size;
+    int failed;
+};
+
+// Fill count pixels with copies of one pixel, doubling the copied run each time
+static void fill_pixels(unsigned char *out, const unsigned char *pixel, int channels, int count) {
+    size_t total = (size_t)count * channels;
+    if (channels == 1) {
+        memset(out, pixel[0], total);
+        return;
+    }
+
+    memcpy(out, pixel, channels);
+    for (size_t filled = channels; filled < total;) {
+        size_t run = filled < total - filled ? filled : total - filled;
+        memcpy(out + filled, out, run);
+        filled += run;
+    }
+}
+
+// Each item is one row of blocks. Its rows are summed column by column in one
+// pass over the source, the column sums are reduced to one average per block,
+// and the first output row is filled a block at a time and copied to the rest.
+// The column sums vectorize, so the body is compiled for every ISA level.
+static GG_ALWAYS_INLINE void pixelate_block_rows_body(void *ctx, int start, int end) {
+    struct pixelate_job *job = ctx;
+    const gg_image *src = job->src;
+    gg_image *dst = job->dst;
+    int channels = src->channels;
+    int pixel_size = job->pixel_size;
+    size_t row_bytes = (size_t)dst->width * channels;
+    int count = pixel_size * pixel_size;
+
+    unsigned int *sums = malloc(row_bytes * sizeof(*sums));
+    if (sums == NULL) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (int y = start * pixel_size; y < end * pixel_size; y += pixel_size) {
+        memset(sums, 0, row_bytes * sizeof(*sums));
+        for (int dy = 0; dy < pixel_size; dy++) {
+            const unsigned char *row = ROW(src, y + dy);
+            for (size_t i = 0; i < row_bytes; i++) {
+                sums[i] += row[i];
+            }
+        }
+
+        unsigned char *out = ROW(dst, y);
+        for (int x = 0; x < dst->width; x += pixel_size) {
+            unsigned char average[4];
+            for (int c = 0; c < channels; c++) {
+                unsigned int total = 0;
+                for (int dx = 0; dx < pixel_size; dx++) {
+                    total += sums[(size_t)(x + dx) * channels + c];
+                }
+                average[c] = (unsigned char)(total / count);
+            }
+            fill_pixels(out + (size_t)x * channels, average, channels, pixel_size);
+        }
+        for (int dy = 1; dy < pixel_size; dy++) {
+            memcpy(ROW(dst, y + dy), out, row_bytes);
+        }
+    }
+    free(sums);
+}
+
+GG_ROW_KERNEL_VERSIONS(pixelate_block_rows);
+
+int gg_pixelate(const gg_image *src, gg_image *dst, int pixel_size) {
+    int effective_width, effective_height;
+
+    int err = gg_pixelated_size(src, pixel_size, &effective_width, &effective_height);
+    if (err != GG_OK) {
+        return err;
+    }
+    if (dst->width != effective_width || dst->height != effective_height || dst->channels != src->channels) {
+        return GG_ERR_SIZE;
+    }
+
+    struct pixelate_job job = {src, dst, pixel_size, 0};
+    size_t band_bytes = (size_t)effective_width * src->channels * pixel_size;
+    gg_parallel_for(effective_height / pixel_size, GG_ROW_GRAIN(band_bytes), GG_DISPATCH(pixelate_block_rows_versions), &job);
+    return job.failed ? GG_ERR_ALLOC : GG_OK;
+}
@@ -0,0 +1,154 @@
+#ifndef GGPICTURE_H
+#define GGPICTURE_H
+
+#include <stddef.h>
+
+#define GG_ROTATE_RIGHT 1
+#define GG_ROTATE_LEFT 2
+#define GG_ROTATE_FLIP 3
+
+// Axes for gg_mirror; both together turn the image by 180 degrees
+#define GG_MIRROR_HORIZONTAL 1 // left-right
+#define GG_MIRROR_VERTICAL 2   // top-bottom
+
+// Resampling for gg_rotate_angle
+#define GG_INTERP_BILINEAR 0
+#define GG_INTERP_BICUBIC 1 // Catmull-Rom
+
+// Output size for gg_angle_rotated_size
+#define GG_BOUNDS_EXPAND 0 // the whole rotated image, corners filled
+#define GG_BOUNDS_KEEP 1   // the source size, corners cut off
+#define GG_BOUNDS_INNER 2  // the largest upright rectangle with no fill
+
+// Error codes returned by every gg_* function
+#define GG_OK 0
+#define GG_ERR_ALLOC 1
+#define GG_ERR_CHANNELS 2
+#define GG_ERR_ARGUMENT 3
+#define GG_ERR_SIZE 4
+
+// Instruction set levels used by the SIMD kernels
+#define GG_ISA_SCALAR 0
+#define GG_ISA_SSE2 1
+#define GG_ISA_AVX2 2
+#define GG_ISA_AVX512 3 // AVX-512 F, BW and VL
+
+// An image in memory. Pixels are interleaved 8-bit channels; row y starts at
+// pixels + y * stride, so padded rows and sub-images can be described too.
+typedef struct {
+    int width;
+    int height;
+    int channels;
+    ptrdiff_t stride;
+    unsigned char *pixels;
+} gg_image;
+
+// Allocate a contiguous image (stride = width * channels). Release with gg_image_free.
+int gg_image_create(gg_image *img, int width, int height, int channels);
+// Describe an existing buffer without copying it
+void gg_image_wrap(gg_image *img, unsigned char *pixels, int width, int height, int channels, ptrdiff_t stride);
+// Release pixels allocated by gg_image_create (or any malloc'd buffer) and reset the struct
+void gg_image_free(gg_image *img);
+// Keep up to max_bytes of large freed pixel buffers for later gg_image_create
+// calls to reuse instead of mapping fresh pages, for processes that handle one
+// image after another. 0 (the default) turns the cache off and releases it.
+void gg_set_buffer_cache(size_t max_bytes);
+// malloc and free through that cache, for pixel buffers made elsewhere
+void *gg_buffer_alloc(size_t bytes);
+void gg_buffer_free(void *buffer);
+const char *gg_strerror(int err);
+
+// Level the SIMD kernels will use: the best one this CPU supports, detected
+// once, capped by the GGPICTURE_ISA environment variable (scalar, sse2, avx2
+// or avx512) and by gg_set_max_isa (pass -1 to remove the cap). Every level
+// gives identical output.
+int gg_cpu_isa(void);
+void gg_set_max_isa(int isa);
+
+// Threads the kernels split their rows across. 0 (the default) means one per
+// CPU this process may run on. Do not call while a kernel is running.
+int gg_threads(void);
+void gg_set_threads(int threads);
+
+// Callback run on the half-open item range [start, end)
+typedef void (*gg_range_fn)(void *ctx, int start, int end);
+
+// Split [0, count) into chunks of at least grain items and run them on the
+// shared thread pool, returning when all are done. Falls back to a single
+// inline call when there is one thread, too little work, or when called from
+// inside another parallel loop -- so kernels called from fn run serially.
+void gg_parallel_for(int count, int grain, gg_range_fn fn, void *ctx);
+
+// A chain of per-byte point operations folded into one 256-entry table.
+// Start from gg_lut_identity, append operations in order, then apply the
+// whole chain with a single pass over the pixels.
+typedef struct {
+    unsigned char table[256];
+} gg_lut;
+
+void gg_lut_identity(gg_lut *lut);
+void gg_lut_brightness(gg_lut *lut, int percentage);
+void gg_lut_contrast(gg_lut *lut, int percentage);
+int gg_lut_is_identity(const gg_lut *lut);
+int gg_apply_lut(gg_image *img, const gg_lut *lut);
+
+// A 3x4 color matrix: output channel c is
+// m[c][0] * R + m[c][1] * G + m[c][2] * B + m[c][3], truncated and clamped to
+// 0..255. It is applied in 16-bit fixed point, so coefficients must lie in
+// [-GG_COLOR_MATRIX_MAX_COEFF, GG_COLOR_MATRIX_MAX_COEFF) and offsets in
+// [-GG_COLOR_MATRIX_MAX_OFFSET, GG_COLOR_MATRIX_MAX_OFFSET). Alpha is kept.
+#define GG_COLOR_MATRIX_MAX_COEFF 8
+#define GG_COLOR_MATRIX_MAX_OFFSET 1024
+
+typedef struct {
+    float m[3][4];
+} gg_color_matrix;
+
+void gg_color_matrix_black_and_white(gg_color_matrix *matrix);
+void gg_color_matrix_vintage(gg_color_matrix *matrix);
+int gg_color_matrix_valid(const gg_color_matrix *matrix);
+int gg_apply_color_matrix(gg_image *img, const gg_color_matrix *matrix);
+
+// In-place kernels. Black and white and vintage are the preset color matrices.
+int gg_brightness(gg_image *img, int percentage);
+int gg_contrast(gg_image *img, int percentage);
+int gg_black_and_white(gg_image *img);
+int gg_vintage(gg_image *img);
+int gg_saturation(gg_image *img, int percentage);
+int gg_blur(gg_image *img, int radius);
+
+// Blur modes for gg_blur_ex. AUTO runs the exact Gaussian up to
+// GG_BLUR_APPROX_THRESHOLD and a constant-time box approximation above it.
+#define GG_BLUR_AUTO 0
+#define GG_BLUR_EXACT 1
+#define GG_BLUR_APPROX 2
+#define GG_BLUR_APPROX_THRESHOLD 24
+
+int gg_blur_ex(gg_image *img, int radius, int mode);
+
+// Rows above and below a pixel that gg_blur_ex reads to compute it. Blurring a
+// band of rows extended by this many rows on each side (clipped to the image)
+// gives the same bytes as blurring the whole image.
+int gg_blur_halo(int radius, int mode);
+
+// Out-of-place kernels. dst must already hold an image of the size reported
+// by the matching *_size function and the same channel count as src.
+int gg_rotated_size(const gg_image *src, int rotation_type, int *width, int *height);
+int gg_rotate(const gg_image *src, gg_image *dst, int rotation_type);
+int gg_pixelated_size(const gg_image *src, int pixel_size, int *width, int *height);
+int gg_pixelate(const gg_image *src, gg_image *dst, int pixel_size);
+
+// Mirror img in place along GG_MIRROR_* axes, swapping pixels from both ends
+// instead of copying into a second image. GG_MIRROR_HORIZONTAL |
+// GG_MIRROR_VERTICAL gives the same pixels as gg_rotate with GG_ROTATE_FLIP.
+int gg_mirror(gg_image *img, int axes);
+
+// Rotate clockwise by any angle in degrees, resampling with GG_INTERP_*. The
+// centers of src and dst line up and dst may have any size, usually the one
+// gg_angle_rotated_size reports for a GG_BOUNDS_* mode. Areas that fall
+// outside src take fill (src->channels bytes; NULL for zeros). Multiples of
+// 90 degrees at their natural size give exactly the pixels of gg_rotate.
+int gg_angle_rotated_size(const gg_image *src, double degrees, int bounds, int *width, int *height);
+int gg_rotate_angle(const gg_image *src, gg_image *dst, double degrees, int interpolation, const unsigned char *fill);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef GGPICTURE_INTERNAL_H
+#define GGPICTURE_INTERNAL_H
+
+#include "ggpicture.h"
+
+// Shared helpers for the kernel translation units; not part of the public API
+
+#define ROW(img, y) ((img)->pixels + (ptrdiff_t)(y) * (img)->stride)
+
+// Smallest band of rows worth handing to a thread
+#define GG_TASK_BYTES (64 * 1024)
+#define GG_ROW_GRAIN(row_bytes) ((int)(GG_TASK_BYTES / ((row_bytes) + 1) + 1))
+
+// Kernel dispatch. A kernel built for several instruction sets lists its
+// versions in a table indexed by GG_ISA_* level, repeating the best lower
+// version for levels it has nothing specific for, and GG_DISPATCH picks the
+// one for the level gg_cpu_isa() allows.
+#define GG_ISA_COUNT 4
+#define GG_DISPATCH(versions) ((versions)[gg_cpu_isa()])
+
+#define GG_ALWAYS_INLINE inline __attribute__((always_inline))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GG_X86 1
+// Must match the features gg_cpu_isa checks for GG_ISA_AVX512
+#define GG_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl")))
+
+// Compile a plain C row kernel once per level from one body,
+// "static GG_ALWAYS_INLINE void name##_body(void *ctx, int start, int end)",
+// so the compiler can vectorize each copy for that level's registers. x86-64
+// always has SSE2, so the baseline copy serves the two lowest levels. Defines
+// the name##_versions table for GG_DISPATCH.
+#define GG_ROW_KERNEL_VERSIONS(name)                                                  \
+    static void name##_baseline(void *ctx, int start, int end) {                      \
+        name##_body(ctx, start, end);                                                 \
+    }                                                                                 \
+    __attribute__((target("avx2"))) static void name##_avx2(void *ctx, int start, int end) { \
+        name##_body(ctx, start, end);                                                 \
+    }                                                                                 \
+    GG_TARGET_AVX512 static void name##_avx512(void *ctx, int start, int end) {       \
+        name##_body(ctx, start, end);                                                 \
+    }                                                                                 \
+    static void (*const name##_versions[GG_ISA_COUNT])(void *, int, int) = {          \
+        name##_baseline, name##_baseline, name##_avx2, name##_avx512}
+#else
+#define GG_ROW_KERNEL_VERSIONS(name)                                                  \
+    static void name##_baseline(void *ctx, int start, int end) {                      \
+        name##_body(ctx, start, end);                                                 \
+    }                                                                                 \
+    static void (*const name##_versions[GG_ISA_COUNT])(void *, int, int) = {          \
+        name##_baseline, name##_baseline, name##_baseline, name##_baseline}
+#endif
+
+// Compile a row kernel whose inner loops run over the channels of a pixel
+// once per common channel count from one body,
+// "static GG_ALWAYS_INLINE void name##_body(void *ctx, int start, int end, const int channels)",
+// so the per-pixel loops unroll into whole-pixel moves. job_type is the ctx
+// struct; its channels member feeds the generic copy used for other counts.
+// GG_FOR_CHANNELS picks the copy for an image once, before the rows run.
+#define GG_CHANNEL_VERSIONS(name, job_type)                                           \
+    static void name##_c1(void *ctx, int start, int end) {                            \
+        name##_body(ctx, start, end, 1);                                              \
+    }                                                                                 \
+    static void name##_c3(void *ctx, int start, int end) {                            \
+        name##_body(ctx, start, end, 3);                                              \
+    }                                                                                 \
+    static void name##_c4(void *ctx, int start, int end) {                            \
+        name##_body(ctx, start, end, 4);                                              \
+    }                                                                                 \
+    static void name##_any(void *ctx, int start, int end) {                           \
+        name##_body(ctx, start, end, ((const job_type *)ctx)->channels);              \
+    }                                                                                 \
+    static void (*const name##_channel_versions[5])(void *, int, int) = {             \
+        name##_any, name##_c1, name##_any, name##_c3, name##_c4}
+#define GG_FOR_CHANNELS(versions, channels) ((unsigned)(channels) <= 4 ? (versions)[channels] : (versions)[0])
+
+#endif
@@ -1,509 +1,550 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "stb_image.h"
+#include "ggpicture.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
+// Decoded pixels end up in gg_image_free, so they come from its buffer cache
+#define STBI_MALLOC(size) gg_buffer_alloc(size)
+#define STBI_REALLOC(buffer, size) realloc(buffer, size)
+#define STBI_FREE(buffer) gg_buffer_free(buffer)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "image_processing.h"
-#include <math.h>
+#include "pipeline.h"
+#include "bmp.h"
+#include "stream.h"
+#include "stats.h"
 
 extern char working_directory[];
 
-int process_image(const char *file_name, int rotation_type, const char *output_file_name) {
+static size_t file_size(const char *file_name) {
+    struct stat file_stat;
+    return stat(file_name, &file_stat) == 0 ? (size_t)file_stat.st_size : 0;
+}
+
+static size_t image_bytes(const gg_image *image) {
+    return (size_t)image->width * image->height * image->channels;
+}
+
+int load_image(const char *file_name, gg_image *image) {
+    stats_span span;
+    stats_begin(&span);
     int width, height, channels;
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
+    unsigned char *pixels = stbi_load(file_name, &width, &height, &channels, 0);
+    if (pixels == NULL) {
         printf("Error: Could not load the image from %s.\n", file_name);
         return 1;
     }
 
-    unsigned char *rotated_image = NULL;
+    gg_image_wrap(image, pixels, width, height, channels, (ptrdiff_t)width * channels);
+    stats_end(&span, "decode", file_size(file_name), image_bytes(image));
+    return 0;
+}
 
-    if (rotation_type == ROTATE_RIGHT) {
-        rotated_image = rotate_right(image, width, height, channels);
-    } else if (rotation_type == ROTATE_LEFT) {
-        rotated_image = rotate_left(image, width, height, channels);
-    } else if (rotation_type == ROTATE_FLIP) {
-        rotated_image = rotate_flip(image, width, height, channels);
-    }
+// BMP_WRITE_DIRECT / BMP_WRITE_DONTNEED for every output, set from the command line
+static int output_write_flags = 0;
 
-    if (rotated_image == NULL) {
-        printf("Error: Rotation failed.\n");
-        stbi_image_free(image);
-        return 1;
-    }
+void set_output_write_flags(int flags) {
+    output_write_flags = flags;
+}
 
-    if (!stbi_write_bmp(output_file_name, rotation_type == ROTATE_FLIP ? width : height,
-                        rotation_type == ROTATE_FLIP ? height : width, channels, rotated_image)) {
-        printf("Error: Could not save the rotated image to %s.\n", output_file_name);
-        free(rotated_image);
-        stbi_image_free(image);
+// order_flags is BMP_WRITE_BGR for results computed from a mapped BMP
+static int save_image_ordered(const gg_image *image, int order_flags, const char *output_file_name,
+                              const char *what, const char *done) {
+    stats_span span;
+    stats_begin(&span);
+    if (bmp_write(output_file_name, image, output_write_flags | order_flags) != 0) {
+        printf("Error: Could not save the %s image to %s.\n", what, output_file_name);
         return 1;
-                        }
-
-    printf("Rotated image saved to %s\n", output_file_name);
+    }
+    stats_end(&span, "encode", image_bytes(image), file_size(output_file_name));
 
-    free(rotated_image);
-    stbi_image_free(image);
+    printf("%s image saved to %s\n", done, output_file_name);
     return 0;
 }
 
+// Band size for streamed processing, 0 to load whole images
+static size_t stream_band_bytes = 0;
 
+void set_streaming(size_t band_bytes) {
+    stream_band_bytes = band_bytes;
+}
 
-unsigned char *rotate_right(const unsigned char *image, int width, int height, int channels) {
-    unsigned char *rotated = malloc(width * height * channels);
-    if (rotated == NULL) {
-        printf("Error: Memory allocation failed.\n");
-        return NULL;
-    }
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            for (int c = 0; c < channels; c++) {
-                rotated[(x * height + (height - y - 1)) * channels + c] =
-                    image[(y * width + x) * channels + c];
-            }
-        }
-    }
-
-    return rotated;
+// A single-stage command run through the streaming engine
+static int stream_stage(const char *file_name, stage_type type, int value, int mode, const char *output_file_name) {
+    pipeline p;
+    p.count = 1;
+    p.stages[0].type = type;
+    p.stages[0].value = value;
+    p.stages[0].mode = mode;
+    return stream_pipeline(file_name, &p, output_file_name, stream_band_bytes, output_write_flags);
 }
 
-unsigned char *rotate_left(const unsigned char *image, int width, int height, int channels) {
-    unsigned char *rotated = malloc(width * height * channels);
-    if (rotated == NULL) {
-        printf("Error: Memory allocation failed.\n");
-        return NULL;
-    }
+int save_image(const gg_image *image, const char *output_file_name, const char *what, const char *done) {
+    return save_image_ordered(image, 0, output_file_name, what, done);
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            for (int c = 0; c < channels; c++) {
-                rotated[((width - x - 1) * height + y) * channels + c] =
-                    image[(y * width + x) * channels + c];
-            }
-        }
+// Shared tail of the in-place commands: report a kernel error or save the result
+static int finish_image(gg_image *image, int err, const char *output_file_name, const char *what, const char *done) {
+    if (err != GG_OK) {
+        printf("Error: %s.\n", gg_strerror(err));
+        gg_image_free(image);
+        return 1;
     }
 
-    return rotated;
+    int result = save_image(image, output_file_name, what, done);
+    gg_image_free(image);
+    return result;
 }
 
-unsigned char *rotate_flip(const unsigned char *image, int width, int height, int channels) {
-    unsigned char *flipped = malloc(width * height * channels);
-    if (flipped == NULL) {
-        printf("Error: Memory allocation failed.\n");
-        return NULL;
-    }
+// Input of the filters that only read their source and write a new image.
+// Uncompressed 24-bit BMPs are mapped and read in place, in the file's B, G, R
+// order; anything else is decoded by stb into R, G, B.
+typedef struct {
+    gg_image image;
+    bmp_mapping map;
+    int mapped;
+} source_image;
+
+static int open_source(const char *file_name, source_image *source) {
+    stats_span span;
+    stats_begin(&span);
+    source->mapped = bmp_map(file_name, &source->map) == 0;
+    if (source->mapped) {
+        // Pages are read as the filter touches them, so its time includes the reads
+        source->image = source->map.image;
+        stats_end(&span, "map", 0, 0);
+        return 0;
+    }
+    return load_image(file_name, &source->image);
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            for (int c = 0; c < channels; c++) {
-                flipped[((height - y - 1) * width + (width - x - 1)) * channels + c] =
-                    image[(y * width + x) * channels + c];
-            }
-        }
+static void close_source(source_image *source) {
+    if (source->mapped) {
+        bmp_unmap(&source->map);
+    } else {
+        gg_image_free(&source->image);
     }
+}
 
-    return flipped;
+// Results of channel-order-agnostic filters keep the order of their source,
+// which for a mapped BMP is already the order the encoder writes
+static int source_order(const source_image *source) {
+    return source->mapped ? BMP_WRITE_BGR : 0;
 }
 
-int adjust_brightness(const char *file_name, int percentage, const char *output_file_name) {
-    int width, height, channels;
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
-        printf("Error: Could not load the image from %s.\n", file_name);
+// Rows per band when a mirror is written out from a mapped BMP
+#define MIRROR_BAND_BYTES (1 << 20)
+
+// Mirroring only moves pixels, and the vertical part only changes which
+// source row each output row comes from. A purely vertical mirror is therefore
+// written straight from a mapped BMP, read bottom to top, with no pixel
+// touched; the rest reverse one band of rows at a time into a small buffer on
+// the way out instead of building the whole result.
+static int write_mirrored(const gg_image *src, int axes, const char *output_file_name, const char *what,
+                          const char *done) {
+    int width = src->width;
+    int height = src->height;
+    int channels = src->channels;
+    gg_image upside_down;
+    gg_image_wrap(&upside_down, src->pixels + (ptrdiff_t)(height - 1) * src->stride, width, height, channels,
+                  -src->stride);
+    if (axes == GG_MIRROR_VERTICAL) {
+        return save_image_ordered(&upside_down, BMP_WRITE_BGR, output_file_name, what, done);
+    }
+
+    // A horizontal mirror is a flip of the upside-down view
+    const gg_image *view = axes == GG_MIRROR_HORIZONTAL ? &upside_down : src;
+    size_t row_bytes = (size_t)width * channels;
+    int band_rows = MIRROR_BAND_BYTES / row_bytes > 0 ? (int)(MIRROR_BAND_BYTES / row_bytes) : 1;
+    band_rows = band_rows < height ? band_rows : height;
+    unsigned char *buffer = malloc((size_t)band_rows * row_bytes);
+    if (buffer == NULL) {
+        printf("Error: Memory allocation failed.\n");
         return 1;
     }
 
-    for (int i = 0; i < width * height * channels; i++) {
-        int adjusted_value = image[i] + (image[i] * percentage / 100);
-        image[i] = (unsigned char)(adjusted_value < 0 ? 0 : (adjusted_value > 255 ? 255 : adjusted_value));
+    stats_span span;
+    stats_begin(&span);
+    bmp_writer writer;
+    if (bmp_writer_open(output_file_name, width, height, channels, output_write_flags | BMP_WRITE_BGR, &writer) != 0) {
+        printf("Error: Could not save the %s image to %s.\n", what, output_file_name);
+        free(buffer);
+        return 1;
     }
-
-    if (!stbi_write_bmp(output_file_name, width, height, channels, image)) {
-        printf("Error: Could not save the adjusted image to %s.\n", output_file_name);
-        stbi_image_free(image);
+    int result = 0;
+    for (int first = 0; first < height && result == 0; first += band_rows) {
+        int rows = height - first < band_rows ? height - first : band_rows;
+        // Output rows [first, first + rows) are the flipped view rows ending at height - first
+        gg_image source_rows, band;
+        gg_image_wrap(&source_rows, view->pixels + (ptrdiff_t)(height - first - rows) * view->stride, width, rows,
+                      channels, view->stride);
+        gg_image_wrap(&band, buffer, width, rows, channels, (ptrdiff_t)row_bytes);
+        gg_rotate(&source_rows, &band, GG_ROTATE_FLIP);
+        result = bmp_write_rows(&writer, first, &band);
+    }
+    if (bmp_writer_close(&writer) != 0) {
+        result = 1;
+    }
+    free(buffer);
+    if (result != 0) {
+        printf("Error: Could not save the %s image to %s.\n", what, output_file_name);
         return 1;
     }
+    stats_end(&span, axes == GG_MIRROR_HORIZONTAL ? "mirror" : "rotate", image_bytes(src), file_size(output_file_name));
 
-    printf("Brightness-adjusted image saved to %s\n", output_file_name);
-    stbi_image_free(image);
+    printf("%s image saved to %s\n", done, output_file_name);
     return 0;
 }
 
-int adjust_contrast(const char *file_name, int percentage, const char *output_file_name) {
-    int width, height, channels;
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
-        printf("Error: Could not load the image from %s.\n", file_name);
+// A mapped BMP goes out through write_mirrored; a decoded image is ours, so it
+// is mirrored in place without a second buffer before it is saved. Opening the
+// output truncates it, so a BMP mirrored onto itself is decoded first instead
+// of being read from a mapping of the pages that are about to go.
+static int mirror_file(const char *file_name, int axes, const char *output_file_name, const char *what,
+                       const char *done) {
+    source_image source;
+    if (bmp_same_file(file_name, output_file_name)) {
+        source.mapped = 0;
+        if (load_image(file_name, &source.image) != 0) {
+            return 1;
+        }
+    } else if (open_source(file_name, &source) != 0) {
         return 1;
     }
 
-    float factor = 1.0f + (percentage / 100.0f);
-    int midpoint = 128;
-
-    for (int i = 0; i < width * height * channels; i++) {
-        int adjusted_value = midpoint + (image[i] - midpoint) * factor;
-        image[i] = (unsigned char)(adjusted_value < 0 ? 0 :
-                                   (adjusted_value > 255 ? 255 : adjusted_value));
+    int result;
+    if (source.mapped) {
+        result = write_mirrored(&source.image, axes, output_file_name, what, done);
+    } else {
+        stats_span span;
+        stats_begin(&span);
+        gg_mirror(&source.image, axes);
+        stats_end(&span, axes == (GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL) ? "rotate" : "mirror",
+                  image_bytes(&source.image), image_bytes(&source.image));
+        result = save_image_ordered(&source.image, 0, output_file_name, what, done);
     }
+    close_source(&source);
+    return result;
+}
 
-    if (!stbi_write_bmp(output_file_name, width, height, channels, image)) {
-        printf("Error: Could not save the adjusted image to %s.\n", output_file_name);
-        stbi_image_free(image);
-        return 1;
+int process_image(const char *file_name, int rotation_type, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_ROTATE, rotation_type, 0, output_file_name);
     }
 
-    printf("Contrast-adjusted image saved to %s\n", output_file_name);
-    stbi_image_free(image);
-    return 0;
-}
+    if (rotation_type == ROTATE_FLIP) {
+        return mirror_file(file_name, GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL, output_file_name, "rotated",
+                           "Rotated");
+    }
 
-int make_black_and_white(const char *file_name, const char *output_file_name) {
-    int width, height, channels;
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
-        printf("Error: Could not load the image from %s.\n", file_name);
+    source_image source;
+    if (open_source(file_name, &source) != 0) {
         return 1;
     }
 
-    if (channels < 3) {
-        printf("Error: Image does not have enough color channels for RGB.\n");
-        stbi_image_free(image);
+    int width, height;
+    gg_image rotated_image;
+    stats_span span;
+    stats_begin(&span);
+    if (gg_rotated_size(&source.image, rotation_type, &width, &height) != GG_OK ||
+        gg_image_create(&rotated_image, width, height, source.image.channels) != GG_OK ||
+        gg_rotate(&source.image, &rotated_image, rotation_type) != GG_OK) {
+        printf("Error: Rotation failed.\n");
+        close_source(&source);
         return 1;
     }
+    stats_end(&span, "rotate", image_bytes(&source.image), image_bytes(&rotated_image));
+    int order = source_order(&source);
+    close_source(&source);
+
+    int result = save_image_ordered(&rotated_image, order, output_file_name, "rotated", "Rotated");
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * channels;
-            unsigned char r = image[idx];
-            unsigned char g = image[idx + 1];
-            unsigned char b = image[idx + 2];
-            unsigned char luminance = (unsigned char)(0.299 * r + 0.587 * g + 0.114 * b);
-            image[idx] = luminance;
-            image[idx + 1] = luminance;
-            image[idx + 2] = luminance;
+    gg_image_free(&rotated_image);
+    return result;
+}
+
+int rotate_image_angle(const char *file_name, double degrees, int interpolation, int bounds,
+                       const unsigned char fill[4], const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        // Reports that the stage cannot be streamed
+        pipeline p;
+        p.count = 1;
+        p.stages[0].type = STAGE_ROTATE_ANGLE;
+        p.stages[0].value = bounds;
+        p.stages[0].mode = interpolation;
+        p.stages[0].degrees = degrees;
+        memcpy(p.stages[0].fill, fill, sizeof(p.stages[0].fill));
+        return stream_pipeline(file_name, &p, output_file_name, stream_band_bytes, output_write_flags);
+    }
+
+    source_image source;
+    if (open_source(file_name, &source) != 0) {
+        return 1;
+    }
+    // The corners are written in the source's channel order
+    unsigned char source_fill[4];
+    memcpy(source_fill, fill, sizeof(source_fill));
+    if (source.mapped) {
+        source_fill[0] = fill[2];
+        source_fill[2] = fill[0];
+    }
+
+    int width, height;
+    gg_image rotated_image;
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_angle_rotated_size(&source.image, degrees, bounds, &width, &height);
+    if (err == GG_OK) {
+        err = gg_image_create(&rotated_image, width, height, source.image.channels);
+    }
+    if (err == GG_OK) {
+        err = gg_rotate_angle(&source.image, &rotated_image, degrees, interpolation, source_fill);
+        if (err != GG_OK) {
+            gg_image_free(&rotated_image);
         }
     }
+    if (err == GG_OK) {
+        stats_end(&span, "rotate", image_bytes(&source.image), image_bytes(&rotated_image));
+    }
+    int order = source_order(&source);
+    close_source(&source);
 
-    if (!stbi_write_bmp(output_file_name, width, height, channels, image)) {
-        printf("Error: Could not save the black-and-white image to %s.\n", output_file_name);
-        stbi_image_free(image);
+    if (err != GG_OK) {
+        printf("Error: Could not rotate the image: %s.\n", gg_strerror(err));
         return 1;
     }
 
-    printf("Black-and-white image saved to %s\n", output_file_name);
-    stbi_image_free(image);
-    return 0;
+    int result = save_image_ordered(&rotated_image, order, output_file_name, "rotated", "Rotated");
+    gg_image_free(&rotated_image);
+    return result;
 }
 
-int make_vintage(const char *file_name, const char *output_file_name) {
-    int width, height, channels;
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
-        printf("Error: Could not load the image from %s.\n", file_name);
-        return 1;
+int mirror_image(const char *file_name, int axes, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_MIRROR, axes, 0, output_file_name);
     }
 
-    if (channels < 3) {
-        printf("Error: Image does not have enough color channels for RGB.\n");
-        stbi_image_free(image);
-        return 1;
+    return mirror_file(file_name, axes, output_file_name, "mirrored", "Mirrored");
+}
+
+static unsigned char *rotate_buffer(const unsigned char *image, int width, int height, int channels, int rotation_type) {
+    gg_image src, dst;
+    gg_image_wrap(&src, (unsigned char *)image, width, height, channels, (ptrdiff_t)width * channels);
+
+    int rotated_width, rotated_height;
+    gg_rotated_size(&src, rotation_type, &rotated_width, &rotated_height);
+    if (gg_image_create(&dst, rotated_width, rotated_height, channels) != GG_OK) {
+        printf("Error: Memory allocation failed.\n");
+        return NULL;
     }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int idx = (y * width + x) * channels;
-            unsigned char r = image[idx];
-            unsigned char g = image[idx + 1];
-            unsigned char b = image[idx + 2];
+    gg_rotate(&src, &dst, rotation_type);
+    return dst.pixels;
+}
 
-            int new_r = (int)(0.393 * r + 0.769 * g + 0.189 * b);
-            int new_g = (int)(0.349 * r + 0.686 * g + 0.168 * b);
-            int new_b = (int)(0.272 * r + 0.534 * g + 0.131 * b);
+unsigned char *rotate_right(const unsigned char *image, int width, int height, int channels) {
+    return rotate_buffer(image, width, height, channels, ROTATE_RIGHT);
+}
 
-            image[idx] = (unsigned char)(new_r > 255 ? 255 : new_r);
-            image[idx + 1] = (unsigned char)(new_g > 255 ? 255 : new_g);
-            image[idx + 2] = (unsigned char)(new_b > 255 ? 255 : new_b);
-        }
+unsigned char *rotate_left(const unsigned char *image, int width, int height, int channels) {
+    return rotate_buffer(image, width, height, channels, ROTATE_LEFT);
+}
+
+unsigned char *rotate_flip(const unsigned char *image, int width, int height, int channels) {
+    return rotate_buffer(image, width, height, channels, ROTATE_FLIP);
+}
+
+int adjust_brightness(const char *file_name, int percentage, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_BRIGHTNESS, percentage, 0, output_file_name);
     }
 
-    if (!stbi_write_bmp(output_file_name, width, height, channels, image)) {
-        printf("Error: Could not save the vintage image to %s.\n", output_file_name);
-        stbi_image_free(image);
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
         return 1;
     }
 
-    printf("Vintage image saved to %s\n", output_file_name);
-    stbi_image_free(image);
-    return 0;
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_brightness(&image, percentage);
+    stats_end(&span, "setbright", image_bytes(&image), image_bytes(&image));
+    return finish_image(&image, err, output_file_name, "adjusted", "Brightness-adjusted");
 }
 
-int adjust_saturation(const char *file_name, int percentage, const char *output_file_name) {
-    int width, height, channels;
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
-        printf("Error: Could not load the image from %s.\n", file_name);
-        return 1;
+int adjust_contrast(const char *file_name, int percentage, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_CONTRAST, percentage, 0, output_file_name);
     }
 
-    if (channels < 3) {
-        printf("Error: Image does not have enough color channels for RGB.\n");
-        stbi_image_free(image);
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
         return 1;
     }
 
-    float factor = 1.0f + (percentage / 100.0f); // Compute the saturation adjustment factor
-
-    for (int y = 0; y < height; y++) {
-        for (int xk = 0; xk < width; xk++) {
-            int idx = (y * width + xk) * channels;
-
-            float r = image[idx] / 255.0f;
-            float g = image[idx + 1] / 255.0f;
-            float b = image[idx + 2] / 255.0f;
-
-            // Convert RGB to HSL
-            float max = fmaxf(r, fmaxf(g, b));
-            float min = fminf(r, fminf(g, b));
-            float delta = max - min;
-
-            float h = 0.0f, s = 0.0f, l = (max + min) / 2.0f;
-
-            if (delta != 0.0f) {
-                s = l < 0.5f ? (delta / (max + min)) : (delta / (2.0f - max - min));
-
-                if (max == r) {
-                    h = (g - b) / delta + (g < b ? 6.0f : 0.0f);
-                } else if (max == g) {
-                    h = (b - r) / delta + 2.0f;
-                } else {
-                    h = (r - g) / delta + 4.0f;
-                }
-
-                h /= 6.0f;
-            }
-
-            // Adjust saturation
-            s *= factor;
-            if (s > 1.0f) s = 1.0f;
-            if (s < 0.0f) s = 0.0f;
-
-            // Convert HSL back to RGB
-            float c = (1.0f - fabsf(2.0f * l - 1.0f)) * s;
-            float x = c * (1.0f - fabsf(fmodf(h * 6.0f, 2.0f) - 1.0f));
-            float m = l - c / 2.0f;
-
-            float r_prime, g_prime, b_prime;
-
-            if (h < 1.0f / 6.0f) {
-                r_prime = c; g_prime = x; b_prime = 0.0f;
-            } else if (h < 2.0f / 6.0f) {
-                r_prime = x; g_prime = c; b_prime = 0.0f;
-            } else if (h < 3.0f / 6.0f) {
-                r_prime = 0.0f; g_prime = c; b_prime = x;
-            } else if (h < 4.0f / 6.0f) {
-                r_prime = 0.0f; g_prime = x; b_prime = c;
-            } else if (h < 5.0f / 6.0f) {
-                r_prime = x; g_prime = 0.0f; b_prime = c;
-            } else {
-                r_prime = c; g_prime = 0.0f; b_prime = x;
-            }
-
-            image[idx] = (unsigned char)((r_prime + m) * 255.0f);
-            image[idx + 1] = (unsigned char)((g_prime + m) * 255.0f);
-            image[idx + 2] = (unsigned char)((b_prime + m) * 255.0f);
-        }
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_contrast(&image, percentage);
+    stats_end(&span, "setcontr", image_bytes(&image), image_bytes(&image));
+    return finish_image(&image, err, output_file_name, "adjusted", "Contrast-adjusted");
+}
+
+int make_black_and_white(const char *file_name, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_BLACK_AND_WHITE, 0, 0, output_file_name);
     }
 
-    if (!stbi_write_bmp(output_file_name, width, height, channels, image)) {
-        printf("Error: Could not save the saturation-adjusted image to %s.\n", output_file_name);
-        stbi_image_free(image);
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
         return 1;
     }
 
-    printf("Saturation-adjusted image saved to %s\n", output_file_name);
-    stbi_image_free(image);
-    return 0;
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_black_and_white(&image);
+    stats_end(&span, "makebw", image_bytes(&image), image_bytes(&image));
+    return finish_image(&image, err, output_file_name, "black-and-white", "Black-and-white");
 }
 
-int blur_image(const char *file_name, int radius, const char *output_file_name) {
-    int width, height, channels;
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
-        printf("Error: Could not load the image from %s.\n", file_name);
-        return 1;
+int make_vintage(const char *file_name, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_VINTAGE, 0, 0, output_file_name);
     }
 
-    if (channels < 3) {
-        printf("Error: Image does not have enough color channels for RGB.\n");
-        stbi_image_free(image);
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
         return 1;
     }
 
-    int kernel_size = 2 * radius + 1;
-    float *kernel = malloc(kernel_size * sizeof(float));
-    if (kernel == NULL) {
-        printf("Error: Could not allocate memory for the kernel.\n");
-        stbi_image_free(image);
-        return 1;
-    }
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_vintage(&image);
+    stats_end(&span, "makevintage", image_bytes(&image), image_bytes(&image));
+    return finish_image(&image, err, output_file_name, "vintage", "Vintage");
+}
 
-    float sigma = radius / 2.0f;
-    float sum = 0.0f;
+int apply_color_matrix(const char *file_name, const gg_color_matrix *matrix, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        pipeline p;
+        p.count = 1;
+        p.stages[0].type = STAGE_COLOR_MATRIX;
+        p.stages[0].value = 0;
+        p.stages[0].mode = 0;
+        p.stages[0].matrix = *matrix;
+        return stream_pipeline(file_name, &p, output_file_name, stream_band_bytes, output_write_flags);
+    }
 
-    for (int i = 0; i < kernel_size; i++) {
-        float x = i - radius;
-        kernel[i] = expf(-x * x / (2.0f * sigma * sigma));
-        sum += kernel[i];
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
+        return 1;
     }
 
-    for (int i = 0; i < kernel_size; i++) {
-        kernel[i] /= sum;
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_apply_color_matrix(&image, matrix);
+    stats_end(&span, "colormatrix", image_bytes(&image), image_bytes(&image));
+    return finish_image(&image, err, output_file_name, "color-transformed", "Color-transformed");
+}
+
+int adjust_saturation(const char *file_name, int percentage, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_SATURATION, percentage, 0, output_file_name);
     }
 
-    unsigned char *temp_image = malloc(width * height * channels);
-    if (temp_image == NULL) {
-        printf("Error: Could not allocate memory for temporary image.\n");
-        free(kernel);
-        stbi_image_free(image);
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
         return 1;
     }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            for (int c = 0; c < channels; c++) {
-                float value = 0.0f;
-                for (int k = -radius; k <= radius; k++) {
-                    int xk = x + k;
-                    if (xk >= 0 && xk < width) {
-                        value += image[(y * width + xk) * channels + c] * kernel[k + radius];
-                    }
-                }
-                temp_image[(y * width + x) * channels + c] = (unsigned char)(value);
-            }
-        }
-    }
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_saturation(&image, percentage);
+    stats_end(&span, "setsatur", image_bytes(&image), image_bytes(&image));
+    return finish_image(&image, err, output_file_name, "saturation-adjusted", "Saturation-adjusted");
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            for (int c = 0; c < channels; c++) {
-                float value = 0.0f;
-                for (int k = -radius; k <= radius; k++) {
-                    int yk = y + k;
-                    if (yk >= 0 && yk < height) {
-                        value += temp_image[(yk * width + x) * channels + c] * kernel[k + radius];
-                    }
-                }
-                image[(y * width + x) * channels + c] = (unsigned char)(value);
-            }
-        }
-    }
+int blur_image(const char *file_name, int radius, const char *output_file_name) {
+    return blur_image_ex(file_name, radius, GG_BLUR_AUTO, output_file_name);
+}
 
-    free(kernel);
-    free(temp_image);
+int blur_image_ex(const char *file_name, int radius, int mode, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_BLUR, radius, mode, output_file_name);
+    }
 
-    if (!stbi_write_bmp(output_file_name, width, height, channels, image)) {
-        printf("Error: Could not save the blurred image to %s.\n", output_file_name);
-        stbi_image_free(image);
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
         return 1;
     }
 
-    printf("Blurred image saved to %s\n", output_file_name);
-    stbi_image_free(image);
-    return 0;
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_blur_ex(&image, radius, mode);
+    stats_end(&span, "blur", image_bytes(&image), image_bytes(&image));
+    return finish_image(&image, err, output_file_name, "blurred", "Blurred");
 }
 
-
 int make_pixelated(const char *file_name, int pixel_size, const char *output_file_name) {
-    int width, height, channels;
+    if (stream_band_bytes > 0) {
+        return stream_stage(file_name, STAGE_PIXELATE, pixel_size, 0, output_file_name);
+    }
 
-    // Load the image
-    unsigned char *image = stbi_load(file_name, &width, &height, &channels, 0);
-    if (image == NULL) {
-        printf("Error: Could not load the image from %s.\n", file_name);
+    source_image source;
+    if (open_source(file_name, &source) != 0) {
         return 1;
     }
 
-    // Calculate the effective width and height to ensure divisibility by pixel_size
-    int effective_width = (width / pixel_size) * pixel_size;
-    int effective_height = (height / pixel_size) * pixel_size;
+    int width, height;
+    gg_image pixelated_image;
+    stats_span span;
+    stats_begin(&span);
+    int err = gg_pixelated_size(&source.image, pixel_size, &width, &height);
+    if (err == GG_OK) {
+        err = gg_image_create(&pixelated_image, width, height, source.image.channels);
+    }
+    if (err == GG_OK) {
+        err = gg_pixelate(&source.image, &pixelated_image, pixel_size);
+        if (err != GG_OK) {
+            gg_image_free(&pixelated_image);
+        }
+    }
+    if (err == GG_OK) {
+        stats_end(&span, "makepixel", image_bytes(&source.image), image_bytes(&pixelated_image));
+    }
+    int order = source_order(&source);
+    close_source(&source);
 
-    // Allocate memory for the pixelated image
-    unsigned char *pixelated_image = (unsigned char *)malloc(effective_width * effective_height * channels);
-    if (pixelated_image == NULL) {
-        printf("Error: Could not allocate memory for the pixelated image.\n");
-        stbi_image_free(image);
+    if (err != GG_OK) {
+        printf("Error: Could not pixelate the image: %s.\n", gg_strerror(err));
         return 1;
     }
 
-    // Pixelation logic
-    for (int y = 0; y < effective_height; y += pixel_size) {
-        for (int x = 0; x < effective_width; x += pixel_size) {
-            // Calculate the average color of the current block
-            int r = 0, g = 0, b = 0, a = 0, count = 0;
-
-            for (int dy = 0; dy < pixel_size; dy++) {
-                for (int dx = 0; dx < pixel_size; dx++) {
-                    int px = x + dx;
-                    int py = y + dy;
-
-                    if (px < width && py < height) {
-                        int idx = (py * width + px) * channels;
-                        r += image[idx];
-                        g += image[idx + 1];
-                        b += image[idx + 2];
-                        if (channels == 4) {
-                            a += image[idx + 3];
-                        }
-                        count++;
-                    }
-                }
-            }
-
-            // Average the colors
-            r /= count;
-            g /= count;
-            b /= count;
-            if (channels == 4) {
-                a /= count;
-            }
-
-            // Assign the average color to the entire block
-            for (int dy = 0; dy < pixel_size; dy++) {
-                for (int dx = 0; dx < pixel_size; dx++) {
-                    int px = x + dx;
-                    int py = y + dy;
-
-                    if (px < effective_width && py < effective_height) {
-                        int idx = (py * effective_width + px) * channels;
-                        pixelated_image[idx] = r;
-                        pixelated_image[idx + 1] = g;
-                        pixelated_image[idx + 2] = b;
-                        if (channels == 4) {
-                            pixelated_image[idx + 3] = a;
-                        }
-                    }
-                }
-            }
-        }
+    int result = save_image_ordered(&pixelated_image, order, output_file_name, "pixelated", "Pixelated");
+    gg_image_free(&pixelated_image);
+    return result;
+}
+
+int process_pipeline(const char *file_name, const pipeline *p, const char *output_file_name) {
+    if (stream_band_bytes > 0) {
+        return stream_pipeline(file_name, p, output_file_name, stream_band_bytes, output_write_flags);
     }
 
-    // Save the pixelated image
-    if (!stbi_write_bmp(output_file_name, effective_width, effective_height, channels, pixelated_image)) {
-        printf("Error: Could not save the pixelated image to %s.\n", output_file_name);
-        free(pixelated_image);
-        stbi_image_free(image);
+    gg_image image;
+    if (load_image(file_name, &image) != 0) {
         return 1;
     }
 
-    printf("Pixelated image saved to %s\n", output_file_name);
+    int err = stats_run_pipeline(p, &image);
+    if (err != GG_OK) {
+        printf("Error: %s.\n", gg_strerror(err));
+        gg_image_free(&image);
+        return 1;
+    }
 
-    // Free allocated memory
-    free(pixelated_image);
-    stbi_image_free(image);
-    return 0;
+    char done[64];
+    snprintf(done, sizeof(done), "Processed (%d stages)", p->count);
+    return finish_image(&image, GG_OK, output_file_name, "processed", done);
 }
-
@@ -2,28 +2,51 @@
 #define IMAGE_PROCESSING_H
 
 #include <limits.h>
+#include "ggpicture.h"
+#include "pipeline.h"
 
 #ifndef MAX_PATH
 #define MAX_PATH 1024
 #endif
 
-#define ROTATE_RIGHT 1
-#define ROTATE_LEFT 2
-#define ROTATE_FLIP 3
+#define ROTATE_RIGHT GG_ROTATE_RIGHT
+#define ROTATE_LEFT GG_ROTATE_LEFT
+#define ROTATE_FLIP GG_ROTATE_FLIP
 
 // Extern declaration for the global working directory
 extern char working_directory[MAX_PATH];
 
-// Main processing functions
+// Main processing functions (load from file_name, save to output_file_name)
 int process_image(const char *file_name, int rotation_type, const char *output_file_name);
+int mirror_image(const char *file_name, int axes, const char *output_file_name); // GG_MIRROR_* axes
+// Clockwise by degrees with GG_INTERP_* resampling, GG_BOUNDS_* output size and fill as R, G, B, A
+int rotate_image_angle(const char *file_name, double degrees, int interpolation, int bounds,
+                       const unsigned char fill[4], const char *output_file_name);
 int adjust_brightness(const char *file_name, int percentage, const char *output_file_name);
 int adjust_contrast(const char *file_name, int percentage, const char *output_file_name);
 int make_black_and_white(const char *file_name, const char *output_file_name);
 int make_vintage(const char *file_name, const char *output_file_name);
+int apply_color_matrix(const char *file_name, const gg_color_matrix *matrix, const char *output_file_name);
 int adjust_saturation(const char *file_name, int percentage, const char *output_file_name);
 int blur_image(const char *file_name, int radius, const char *output_file_name);
+int blur_image_ex(const char *file_name, int radius, int mode, const char *output_file_name);
 int make_pixelated(const char *file_name, int pixel_size, const char *output_file_name);
 
+// Extra bmp_write flags (BMP_WRITE_DIRECT, BMP_WRITE_DONTNEED) for every saved image
+void set_output_write_flags(int flags);
+
+// With a nonzero band size the commands above and process_pipeline stream BMP
+// input through stream_pipeline in bands of that many bytes
+void set_streaming(size_t band_bytes);
+
+// Decode a file into a gg_image that owns its pixels
+int load_image(const char *file_name, gg_image *image);
+// Encode as BMP (pixels in R, G, B order), printing "<done> image saved to ..." or an error naming the "<what> image"
+int save_image(const gg_image *image, const char *output_file_name, const char *what, const char *done);
+
+// Decode once, run the whole pipeline and encode once
+int process_pipeline(const char *file_name, const pipeline *p, const char *output_file_name);
+
 
 // Rotation functions
 unsigned char *rotate_right(const unsigned char *image, int width, int height, int channels);
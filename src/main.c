@@ -4,6 +4,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include "image_processing.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "bmp.h"
+#include "stream.h"
+#include "server.h"
+#include "stats.h"
 
 #define MAX_PATH 1024
 #define CONFIG_FILE "config.txt"
@@ -18,8 +24,18 @@ void print_help() {
     printf("  --set_dir <directory>      Set the working directory for input/output files.\n");
     printf("  --set_output <filename>    Set the output file name (relative to working directory).\n");
     printf("  --rotate -r/-l/-f <file>   Rotate the image right (-r), left (-l), or flip (-f).\n");
+    printf("  --rotate <degrees> [--bilinear|--bicubic] [--expand|--keep|--inner] [--fill <RRGGBB>] <file>\n");
+    printf("                             Rotate clockwise by any angle, resampling bilinearly (default)\n");
+    printf("                             or bicubically. The output holds the whole rotated image\n");
+    printf("                             (--expand, default), keeps the input size (--keep) or is the\n");
+    printf("                             largest rectangle without corners (--inner). Uncovered corners\n");
+    printf("                             take the fill color (default ffffff).\n");
+    printf("  --mirror -h/-v <file>      Mirror the image left-right (-h) or top-bottom (-v).\n");
     printf("  --makebw <file>            Convert the image to black and white.\n");
     printf("  --makevintage <file>       Apply a vintage filter to the image.\n");
+    printf("  --colormatrix \"<m>\" <file>\n");
+    printf("                             Apply a color matrix: 9 numbers (3x3) or 12 (3x4 with an\n");
+    printf("                             offset ending each row), row by row for R, G and B.\n");
     printf("  --setbright +/-<value> <file>\n");
     printf("                             Adjust image brightness by the given percentage.\n");
     printf("  --setcontr +/-<value> <file>\n");
@@ -27,13 +43,53 @@ void print_help() {
     printf("  --setsatur +/-<value> <file>\n");
     printf("                             Adjust image saturation by the given percentage.\n");
     printf("  --makepixel <size> <file>  Pixelate the image with the given pixel size.\n");
-    printf("  --blur <radius> <file>     Apply a blur effect with the given radius.\n");
+    printf("  --blur <radius> [--exact|--approx] <file>\n");
+    printf("                             Apply a blur effect with the given radius. Radii above %d\n", GG_BLUR_APPROX_THRESHOLD);
+    printf("                             use a fast approximation unless --exact is given.\n");
+    printf("  --pipeline <stages> <file>\n");
+    printf("                             Apply several operations with a single load and save.\n");
+    printf("                             Stages are comma-separated: rotate:r|l|f, mirror:h|v,\n");
+    printf("                             rotate:<degrees>[:bicubic][:keep|:inner][:<RRGGBB>],\n");
+    printf("                             setbright:<v>, setcontr:<v>, setsatur:<v>, makebw, makevintage,\n");
+    printf("                             makepixel:<size>, blur:<radius>[:exact|:approx],\n");
+    printf("                             colormatrix:<numbers separated by spaces>.\n");
+    printf("  --batch <dir|manifest> <stages> [<template>]\n");
+    printf("                             Apply a pipeline to every image in a directory or listed\n");
+    printf("                             in a manifest file, several files at a time. Output names\n");
+    printf("                             come from the template ({name}, {ext}, {index}; default\n");
+    printf("                             %s) and are relative to the working directory.\n", BATCH_DEFAULT_TEMPLATE);
+    printf("  --serve <socket>           Keep running and take pipeline jobs from clients on a UNIX\n");
+    printf("                             domain socket, with the worker threads kept warm.\n");
+    printf("  --submit <socket> <stages> <file> [<output>]\n");
+    printf("                             Run a pipeline on a --serve server and wait for it. Paths\n");
+    printf("                             are relative to the server's working directory.\n");
+    printf("  --stop <socket>            Stop a --serve server once its current jobs are done.\n");
+    printf("\nOptions (accepted anywhere on the command line):\n");
+    printf("  --threads <n>              Number of worker threads; 0 (default) uses one per CPU.\n");
+    printf("  --direct-io                Write output files with O_DIRECT, bypassing the page cache.\n");
+    printf("  --drop-cache               Drop output data from the page cache as it is written.\n");
+    printf("  --stream                   Read, process and write 24-bit BMP files in bands of rows,\n");
+    printf("                             for images larger than memory (not for --batch, and\n");
+    printf("                             without rotate -r/-l or by other angles).\n");
+    printf("  --band-mb <n>              Band size for --stream in megabytes (default %d); implies\n", STREAM_DEFAULT_BAND_MB);
+    printf("                             --stream.\n");
+    printf("  --stats[=json]             Report wall and CPU time, bytes read and written and peak\n");
+    printf("                             RSS for every stage (decode, each filter, encode) on stderr.\n");
+    printf("  --trace <file>             Write every stage to a Chrome trace-event file.\n");
     printf("\nExamples:\n");
     printf("  ./ggpicture --set_dir tests/\n");
     printf("  ./ggpicture --set_output output.bmp\n");
     printf("  ./ggpicture --rotate -r input.bmp\n");
+    printf("  ./ggpicture --rotate -2.5 --bicubic --inner scan.bmp\n");
     printf("  ./ggpicture --makepixel 10 input.bmp\n");
     printf("  ./ggpicture --blur 5 input.bmp\n");
+    printf("  ./ggpicture --colormatrix \"0 0 1  0 1 0  1 0 0\" input.bmp\n");
+    printf("  ./ggpicture --threads 8 --blur 40 input.bmp\n");
+    printf("  ./ggpicture --stream --band-mb 256 --blur 5 huge.bmp\n");
+    printf("  ./ggpicture --batch photos/ \"setbright:+10,blur:3\" out/{name}.bmp\n");
+    printf("  ./ggpicture --pipeline \"rotate:r,setbright:+10,blur:3\" input.bmp\n");
+    printf("  ./ggpicture --serve /tmp/ggpicture.sock &\n");
+    printf("  ./ggpicture --submit /tmp/ggpicture.sock \"blur:3\" input.bmp out.bmp\n");
     printf("\n");
 }
 
@@ -143,7 +199,86 @@ void get_working_directory_and_output() {
     }
 }
 
+// Options that apply to every command may appear anywhere on the command
+// line. They are applied and removed from argv, so the command handlers below
+// keep seeing their usual positional arguments. Returns the new argc, or -1
+// on error.
+int parse_global_options(int argc, char *argv[]) {
+    int kept = 1;
+    int write_flags = 0;
+    size_t band_bytes = 0;
+    int stats_report = STATS_OFF;
+    const char *trace_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0) {
+            char *end;
+            long threads = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+            if (i + 1 >= argc || *argv[i + 1] == '\0' || *end != '\0' || threads < 0 || threads > 1024) {
+                printf("Error: --threads expects a number between 0 (auto) and 1024.\n");
+                return -1;
+            }
+            gg_set_threads((int)threads);
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "--stream") == 0) {
+            if (band_bytes == 0) {
+                band_bytes = (size_t)STREAM_DEFAULT_BAND_MB << 20;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--band-mb") == 0) {
+            char *end;
+            long megabytes = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+            if (i + 1 >= argc || *argv[i + 1] == '\0' || *end != '\0' || megabytes < 1 || megabytes > 65536) {
+                printf("Error: --band-mb expects a number of megabytes between 1 and 65536.\n");
+                return -1;
+            }
+            band_bytes = (size_t)megabytes << 20;
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=table") == 0) {
+            stats_report = STATS_TABLE;
+            continue;
+        }
+        if (strcmp(argv[i], "--stats=json") == 0) {
+            stats_report = STATS_JSON;
+            continue;
+        }
+        if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= argc || *argv[i + 1] == '\0') {
+                printf("Error: --trace expects a file name.\n");
+                return -1;
+            }
+            trace_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--direct-io") == 0) {
+            write_flags |= BMP_WRITE_DIRECT;
+            continue;
+        }
+        if (strcmp(argv[i], "--drop-cache") == 0) {
+            write_flags |= BMP_WRITE_DONTNEED;
+            continue;
+        }
+        argv[kept++] = argv[i];
+    }
+
+    set_output_write_flags(write_flags);
+    set_streaming(band_bytes);
+    stats_enable(stats_report, trace_path);
+    argv[kept] = NULL;
+    return kept;
+}
+
 int main(int argc, char *argv[]) {
+    argc = parse_global_options(argc, argv);
+    if (argc < 0) {
+        return 1;
+    }
+
     if (argc < 2) {
         printf("Error: No command provided. Use --help for usage information.\n");
         return 1;
@@ -172,16 +307,55 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    // Clients only talk to a server, which has its own configuration
+    if (strcmp(argv[1], "--submit") == 0) {
+        if (argc != 5 && argc != 6) {
+            printf("Usage: ./image_editor --submit <socket> <stage[:arg],...> <file_name> [<output>]\n");
+            return 1;
+        }
+
+        const char *output = argc == 6 ? argv[5] : "";
+        if (strpbrk(argv[3], "\t\n") != NULL || strpbrk(argv[4], "\t\n") != NULL || strpbrk(output, "\t\n") != NULL) {
+            printf("Error: Stages and file names may not contain tabs or newlines.\n");
+            return 1;
+        }
+
+        char request[SERVER_MAX_LINE];
+        if (snprintf(request, sizeof(request), "run\t%s\t%s\t%s", argv[3], argv[4], output) >= (int)sizeof(request)) {
+            printf("Error: Request too long.\n");
+            return 1;
+        }
+        return submit_request(argv[2], request);
+    }
+
+    if (strcmp(argv[1], "--stop") == 0) {
+        if (argc != 3) {
+            printf("Usage: ./image_editor --stop <socket>\n");
+            return 1;
+        }
+        return submit_request(argv[2], "stop");
+    }
+
     get_working_directory_and_output();
 
+    if (strcmp(argv[1], "--serve") == 0) {
+        if (argc != 3) {
+            printf("Usage: ./image_editor --serve <socket>\n");
+            return 1;
+        }
+        return serve_jobs(argv[2], working_directory, output_file_name);
+    }
+
     if (strcmp(argv[1], "--rotate") == 0) {
-        if (argc != 4) {
+        if (argc < 4) {
             printf("Usage: ./image_editor --rotate -r/-l/-f <file_name>\n");
+            printf("       ./image_editor --rotate <degrees> [--bilinear|--bicubic] [--expand|--keep|--inner] "
+                   "[--fill <RRGGBB>] <file_name>\n");
             return 1;
         }
 
         char file_path[MAX_PATH];
-        const char *file_name = argv[3];
+        const char *file_name = argv[argc - 1];
 
         // Construct file path based on working directory if not an absolute path
         if (file_name[0] != '/') {
@@ -194,7 +368,7 @@ int main(int argc, char *argv[]) {
             file_path[sizeof(file_path) - 1] = '\0'; // Ensure null termination
         }
 
-        int rotation_type;
+        int rotation_type = 0;
 
         if (strcmp(argv[2], "-r") == 0) {
             rotation_type = ROTATE_RIGHT;
@@ -202,17 +376,102 @@ int main(int argc, char *argv[]) {
             rotation_type = ROTATE_LEFT;
         } else if (strcmp(argv[2], "-f") == 0) {
             rotation_type = ROTATE_FLIP;
+        }
+
+        if (rotation_type != 0) {
+            if (argc != 4) {
+                printf("Usage: ./image_editor --rotate -r/-l/-f <file_name>\n");
+                return 1;
+            }
+            if (process_image(file_path, rotation_type, output_file_name) != 0) {
+                printf("Failed to process the image.\n");
+                return 1;
+            }
+            printf("Image processed successfully.\n");
+            return 0;
+        }
+
+        // Any other angle in degrees
+        char *end;
+        double degrees = strtod(argv[2], &end);
+        if (argv[2][0] == '\0' || *end != '\0' || !(degrees >= -100000 && degrees <= 100000)) {
+            printf("Invalid rotation option. Use -r, -l, -f or an angle in degrees.\n");
+            return 1;
+        }
+
+        int interpolation = GG_INTERP_BILINEAR;
+        int bounds = GG_BOUNDS_EXPAND;
+        unsigned char fill[4] = {255, 255, 255, 255};
+        for (int i = 3; i < argc - 1; i++) {
+            if (strcmp(argv[i], "--bilinear") == 0) {
+                interpolation = GG_INTERP_BILINEAR;
+            } else if (strcmp(argv[i], "--bicubic") == 0) {
+                interpolation = GG_INTERP_BICUBIC;
+            } else if (strcmp(argv[i], "--expand") == 0) {
+                bounds = GG_BOUNDS_EXPAND;
+            } else if (strcmp(argv[i], "--keep") == 0) {
+                bounds = GG_BOUNDS_KEEP;
+            } else if (strcmp(argv[i], "--inner") == 0) {
+                bounds = GG_BOUNDS_INNER;
+            } else if (strcmp(argv[i], "--fill") == 0 && i + 1 < argc - 1) {
+                if (parse_fill_color(argv[++i], fill) != 0) {
+                    printf("Error: Invalid fill color '%s'. Use 6 or 8 hex digits such as ffffff.\n", argv[i]);
+                    return 1;
+                }
+            } else {
+                printf("Invalid rotation option '%s'. Use --bilinear, --bicubic, --expand, --keep, --inner or "
+                       "--fill <RRGGBB>.\n",
+                       argv[i]);
+                return 1;
+            }
+        }
+
+        if (rotate_image_angle(file_path, degrees, interpolation, bounds, fill, output_file_name) != 0) {
+            printf("Failed to rotate the image.\n");
+            return 1;
+        }
+
+        printf("Image rotated successfully.\n");
+        return 0;
+    }
+
+    if (strcmp(argv[1], "--mirror") == 0) {
+        if (argc != 4) {
+            printf("Usage: ./image_editor --mirror -h/-v <file_name>\n");
+            return 1;
+        }
+
+        char file_path[MAX_PATH];
+        const char *file_name = argv[3];
+
+        // Construct file path based on working directory if not an absolute path
+        if (file_name[0] != '/') {
+            if (snprintf(file_path, sizeof(file_path), "%s/%s", working_directory, file_name) >= (int)sizeof(file_path)) {
+                printf("Error: File path too long.\n");
+                return 1;
+            }
         } else {
-            printf("Invalid rotation option. Use -r, -l, or -f.\n");
+            strncpy(file_path, file_name, sizeof(file_path) - 1);
+            file_path[sizeof(file_path) - 1] = '\0'; // Ensure null termination
+        }
+
+        int axes;
+
+        if (strcmp(argv[2], "-h") == 0) {
+            axes = GG_MIRROR_HORIZONTAL;
+        } else if (strcmp(argv[2], "-v") == 0) {
+            axes = GG_MIRROR_VERTICAL;
+        } else {
+            printf("Invalid mirror option. Use -h or -v.\n");
             return 1;
         }
 
-        if (process_image(file_path, rotation_type, output_file_name) != 0) {
-            printf("Failed to process the image.\n");
+        if (mirror_image(file_path, axes, output_file_name) != 0) {
+            printf("Failed to mirror the image.\n");
             return 1;
         }
 
-        printf("Image processed successfully.\n");
+        printf("Image mirrored successfully.\n");
         return 0;
     }
 
@@ -336,6 +595,40 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (strcmp(argv[1], "--colormatrix") == 0) {
+        if (argc != 4) {
+            printf("Usage: ./image_editor --colormatrix \"<9 or 12 numbers>\" <file_name>\n");
+            return 1;
+        }
+
+        gg_color_matrix matrix;
+        if (parse_color_matrix(argv[2], &matrix) != 0) {
+            return 1;
+        }
+
+        char file_path[MAX_PATH];
+        const char *file_name = argv[3];
+
+        // Construct file path based on working directory if not an absolute path
+        if (file_name[0] != '/') {
+            if (snprintf(file_path, sizeof(file_path), "%s/%s", working_directory, file_name) >= (int)sizeof(file_path)) {
+                printf("Error: File path too long.\n");
+                return 1;
+            }
+        } else {
+            strncpy(file_path, file_name, sizeof(file_path) - 1);
+            file_path[sizeof(file_path) - 1] = '\0'; // Ensure null termination
+        }
+
+        if (apply_color_matrix(file_path, &matrix, output_file_name) != 0) {
+            printf("Failed to apply the color matrix.\n");
+            return 1;
+        }
+
+        printf("Color matrix applied successfully.\n");
+        return 0;
+    }
+
     if (strcmp(argv[1], "--setsatur") == 0) {
         if (argc != 4) {
             printf("Usage: ./image_editor --setsatur +/-x <file_name>\n");
@@ -368,14 +661,26 @@ int main(int argc, char *argv[]) {
     }
 
     if (strcmp(argv[1], "--blur") == 0) {
-        if (argc != 4) {
-            printf("Usage: ./image_editor --blur <radius> <file_name>\n");
+        if (argc != 4 && argc != 5) {
+            printf("Usage: ./image_editor --blur <radius> [--exact|--approx] <file_name>\n");
             return 1;
         }
 
         char file_path[MAX_PATH];
-        const char *file_name = argv[3];
+        const char *file_name = argv[argc - 1];
         int radius = atoi(argv[2]);
+        int mode = GG_BLUR_AUTO;
+
+        if (argc == 5) {
+            if (strcmp(argv[3], "--exact") == 0) {
+                mode = GG_BLUR_EXACT;
+            } else if (strcmp(argv[3], "--approx") == 0) {
+                mode = GG_BLUR_APPROX;
+            } else {
+                printf("Invalid blur mode. Use --exact or --approx.\n");
+                return 1;
+            }
+        }
 
         if (radius <= 0) {
             printf("Error: Radius must be a positive integer.\n");
@@ -393,7 +698,7 @@ int main(int argc, char *argv[]) {
             file_path[sizeof(file_path) - 1] = '\0'; // Ensure null termination
         }
 
-        if (blur_image(file_path, radius, output_file_name) != 0) {
+        if (blur_image_ex(file_path, radius, mode, output_file_name) != 0) {
             printf("Failed to blur the image.\n");
             return 1;
         }
@@ -437,6 +742,60 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (strcmp(argv[1], "--pipeline") == 0) {
+        if (argc != 4) {
+            printf("Usage: ./image_editor --pipeline <stage[:arg],...> <file_name>\n");
+            return 1;
+        }
+
+        pipeline stages;
+        if (parse_pipeline(argv[2], &stages) != 0) {
+            return 1;
+        }
+
+        char file_path[MAX_PATH];
+        const char *file_name = argv[3];
+
+        // Construct file path based on working directory if not an absolute path
+        if (file_name[0] != '/') {
+            if (snprintf(file_path, sizeof(file_path), "%s/%s", working_directory, file_name) >= (int)sizeof(file_path)) {
+                printf("Error: File path too long.\n");
+                return 1;
+            }
+        } else {
+            strncpy(file_path, file_name, sizeof(file_path) - 1);
+            file_path[sizeof(file_path) - 1] = '\0'; // Ensure null termination
+        }
+
+        if (process_pipeline(file_path, &stages, output_file_name) != 0) {
+            printf("Failed to run the pipeline.\n");
+            return 1;
+        }
+
+        printf("Pipeline applied successfully.\n");
+        return 0;
+    }
+
+    if (strcmp(argv[1], "--batch") == 0) {
+        if (argc != 4 && argc != 5) {
+            printf("Usage: ./image_editor --batch <dir|manifest> <stage[:arg],...> [<output_template>]\n");
+            return 1;
+        }
+
+        pipeline stages;
+        if (parse_pipeline(argv[3], &stages) != 0) {
+            return 1;
+        }
+
+        const char *output_template = argc == 5 ? argv[4] : BATCH_DEFAULT_TEMPLATE;
+        if (process_batch(argv[2], &stages, output_template, working_directory) != 0) {
+            printf("Failed to process the batch.\n");
+            return 1;
+        }
+
+        printf("Batch processed successfully.\n");
+        return 0;
+    }
 
     printf("Invalid command. Use --set_dir, --set_output, --rotate, --setbright or else.\n");
     return 1;
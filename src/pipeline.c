@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pipeline.h"
+
+#define MAX_STAGE_SPEC 256
+
+static int parse_int(const char *text, int *value) {
+    char *end;
+    long parsed;
+
+    if (text == NULL || *text == '\0') {
+        return 1;
+    }
+    parsed = strtol(text, &end, 10);
+    if (*end != '\0' || parsed < -100000 || parsed > 100000) {
+        return 1;
+    }
+    *value = (int)parsed;
+    return 0;
+}
+
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    size_t len = strlen(text);
+    while (len > 0 && isspace((unsigned char)text[len - 1])) {
+        text[--len] = '\0';
+    }
+    return text;
+}
+
+int parse_color_matrix(const char *text, gg_color_matrix *out) {
+    float values[12];
+    int count = 0;
+    const char *cursor = text;
+
+    for (;;) {
+        while (isspace((unsigned char)*cursor) || *cursor == ',' || *cursor == ';') {
+            cursor++;
+        }
+        if (*cursor == '\0') {
+            break;
+        }
+        char *end;
+        float value = strtof(cursor, &end);
+        if (end == cursor || count == 12) {
+            printf("Error: A color matrix needs 9 or 12 numbers (rows of R, G, B weights and an optional offset).\n");
+            return 1;
+        }
+        values[count++] = value;
+        cursor = end;
+    }
+    if (count != 9 && count != 12) {
+        printf("Error: A color matrix needs 9 or 12 numbers (rows of R, G, B weights and an optional offset).\n");
+        return 1;
+    }
+
+    int columns = count / 3;
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 4; k++) {
+            out->m[c][k] = k < columns ? values[c * columns + k] : 0.0f;
+        }
+    }
+    if (!gg_color_matrix_valid(out)) {
+        printf("Error: Color matrix weights must be within +/-%d and offsets within +/-%d.\n",
+               GG_COLOR_MATRIX_MAX_COEFF, GG_COLOR_MATRIX_MAX_OFFSET);
+        return 1;
+    }
+    return 0;
+}
+
+int parse_fill_color(const char *text, unsigned char fill[4]) {
+    if (*text == '#') {
+        text++;
+    }
+    size_t len = strlen(text);
+    if (len != 6 && len != 8) {
+        return 1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)text[i])) {
+            return 1;
+        }
+    }
+
+    fill[3] = 255;
+    for (size_t i = 0; i < len / 2; i++) {
+        char pair[3] = {text[2 * i], text[2 * i + 1], '\0'};
+        fill[i] = (unsigned char)strtol(pair, NULL, 16);
+    }
+    return 0;
+}
+
+// "<degrees>[:option]..." after "rotate:". Defaults to bilinear, the whole
+// rotated image and white corners.
+static int parse_rotate_angle(char *arg, pipeline_stage *stage) {
+    char *option = strchr(arg, ':');
+    if (option != NULL) {
+        *option++ = '\0';
+    }
+
+    char *end;
+    double degrees = strtod(arg, &end);
+    if (*arg == '\0' || *end != '\0' || !(degrees >= -100000 && degrees <= 100000)) {
+        printf("Error: Invalid rotation '%s'. Use r, l, f or an angle in degrees.\n", arg);
+        return 1;
+    }
+    stage->type = STAGE_ROTATE_ANGLE;
+    stage->degrees = degrees;
+    stage->mode = GG_INTERP_BILINEAR;
+    stage->value = GG_BOUNDS_EXPAND;
+    memset(stage->fill, 255, sizeof(stage->fill));
+
+    while (option != NULL) {
+        char *next = strchr(option, ':');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        if (strcmp(option, "bilinear") == 0) {
+            stage->mode = GG_INTERP_BILINEAR;
+        } else if (strcmp(option, "bicubic") == 0) {
+            stage->mode = GG_INTERP_BICUBIC;
+        } else if (strcmp(option, "expand") == 0) {
+            stage->value = GG_BOUNDS_EXPAND;
+        } else if (strcmp(option, "keep") == 0) {
+            stage->value = GG_BOUNDS_KEEP;
+        } else if (strcmp(option, "inner") == 0) {
+            stage->value = GG_BOUNDS_INNER;
+        } else if (parse_fill_color(option, stage->fill) != 0) {
+            printf("Error: Invalid rotation option '%s'. Use bilinear, bicubic, expand, keep, inner or a color "
+                   "such as ffffff.\n",
+                   option);
+            return 1;
+        }
+        option = next;
+    }
+    return 0;
+}
+
+static int parse_stage(char *token, pipeline_stage *stage) {
+    char *name = token;
+    char *arg = strchr(token, ':');
+    if (arg != NULL) {
+        *arg++ = '\0';
+        arg = trim(arg);
+    }
+    name = trim(name);
+    stage->mode = 0;
+
+    if (strcmp(name, "rotate") == 0) {
+        stage->type = STAGE_ROTATE;
+        if (arg == NULL) {
+            printf("Error: Stage 'rotate' needs r, l, f or an angle in degrees (e.g. rotate:r or rotate:2.5).\n");
+            return 1;
+        }
+        if (strcmp(arg, "r") == 0) {
+            stage->value = GG_ROTATE_RIGHT;
+        } else if (strcmp(arg, "l") == 0) {
+            stage->value = GG_ROTATE_LEFT;
+        } else if (strcmp(arg, "f") == 0) {
+            stage->value = GG_ROTATE_FLIP;
+        } else {
+            return parse_rotate_angle(arg, stage);
+        }
+        return 0;
+    }
+
+    if (strcmp(name, "mirror") == 0) {
+        stage->type = STAGE_MIRROR;
+        if (arg == NULL) {
+            printf("Error: Stage 'mirror' needs h or v (e.g. mirror:h).\n");
+            return 1;
+        }
+        if (strcmp(arg, "h") == 0) {
+            stage->value = GG_MIRROR_HORIZONTAL;
+        } else if (strcmp(arg, "v") == 0) {
+            stage->value = GG_MIRROR_VERTICAL;
+        } else {
+            printf("Error: Invalid mirror axis '%s'. Use h or v.\n", arg);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(name, "makebw") == 0 || strcmp(name, "makevintage") == 0) {
+        stage->type = strcmp(name, "makebw") == 0 ? STAGE_BLACK_AND_WHITE : STAGE_VINTAGE;
+        stage->value = 0;
+        if (arg != NULL) {
+            printf("Error: Stage '%s' does not take an argument.\n", name);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(name, "colormatrix") == 0) {
+        stage->type = STAGE_COLOR_MATRIX;
+        stage->value = 0;
+        if (arg == NULL) {
+            printf("Error: Stage 'colormatrix' needs its numbers (e.g. colormatrix:0.5 0 0 0 1 0 0 0 1).\n");
+            return 1;
+        }
+        return parse_color_matrix(arg, &stage->matrix);
+    }
+
+    if (strcmp(name, "setbright") == 0) {
+        stage->type = STAGE_BRIGHTNESS;
+    } else if (strcmp(name, "setcontr") == 0) {
+        stage->type = STAGE_CONTRAST;
+    } else if (strcmp(name, "setsatur") == 0) {
+        stage->type = STAGE_SATURATION;
+    } else if (strcmp(name, "makepixel") == 0) {
+        stage->type = STAGE_PIXELATE;
+    } else if (strcmp(name, "blur") == 0) {
+        stage->type = STAGE_BLUR;
+        // Optional mode after the radius: blur:40:exact or blur:40:approx
+        char *mode = arg != NULL ? strchr(arg, ':') : NULL;
+        if (mode != NULL) {
+            *mode++ = '\0';
+            if (strcmp(mode, "exact") == 0) {
+                stage->mode = GG_BLUR_EXACT;
+            } else if (strcmp(mode, "approx") == 0) {
+                stage->mode = GG_BLUR_APPROX;
+            } else {
+                printf("Error: Invalid blur mode '%s'. Use exact or approx.\n", mode);
+                return 1;
+            }
+        }
+    } else {
+        printf("Error: Unknown pipeline stage '%s'.\n", name);
+        return 1;
+    }
+
+    if (parse_int(arg, &stage->value) != 0) {
+        printf("Error: Stage '%s' needs an integer argument (e.g. %s:10).\n", name, name);
+        return 1;
+    }
+
+    if ((stage->type == STAGE_PIXELATE || stage->type == STAGE_BLUR) && stage->value <= 0) {
+        printf("Error: Stage '%s' needs a positive integer.\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+int parse_pipeline(const char *spec, pipeline *out) {
+    out->count = 0;
+
+    const char *cursor = spec;
+    while (*cursor != '\0') {
+        const char *comma = strchr(cursor, ',');
+        size_t len = comma != NULL ? (size_t)(comma - cursor) : strlen(cursor);
+        char token[MAX_STAGE_SPEC];
+
+        if (len >= sizeof(token)) {
+            printf("Error: Pipeline stage is too long.\n");
+            return 1;
+        }
+        memcpy(token, cursor, len);
+        token[len] = '\0';
+
+        if (out->count == MAX_PIPELINE_STAGES) {
+            printf("Error: Too many pipeline stages (maximum is %d).\n", MAX_PIPELINE_STAGES);
+            return 1;
+        }
+        if (parse_stage(token, &out->stages[out->count]) != 0) {
+            return 1;
+        }
+        out->count++;
+
+        cursor += len;
+        if (*cursor == ',') {
+            cursor++;
+        }
+    }
+
+    if (out->count == 0) {
+        printf("Error: Pipeline is empty.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int is_point_stage(const pipeline_stage *stage) {
+    return stage->type == STAGE_BRIGHTNESS || stage->type == STAGE_CONTRAST;
+}
+
+// Fold a run of consecutive per-byte stages into one table. Returns the index
+// of the first stage after the run.
+static int compose_point_stages(const pipeline *p, int first, gg_lut *lut) {
+    int i = first;
+
+    gg_lut_identity(lut);
+    for (; i < p->count && is_point_stage(&p->stages[i]); i++) {
+        if (p->stages[i].type == STAGE_BRIGHTNESS) {
+            gg_lut_brightness(lut, p->stages[i].value);
+        } else {
+            gg_lut_contrast(lut, p->stages[i].value);
+        }
+    }
+    return i;
+}
+
+const char *pipeline_stage_name(const pipeline_stage *stage) {
+    switch (stage->type) {
+    case STAGE_ROTATE:
+    case STAGE_ROTATE_ANGLE:
+        return "rotate";
+    case STAGE_BRIGHTNESS:
+        return "setbright";
+    case STAGE_CONTRAST:
+        return "setcontr";
+    case STAGE_SATURATION:
+        return "setsatur";
+    case STAGE_BLACK_AND_WHITE:
+        return "makebw";
+    case STAGE_VINTAGE:
+        return "makevintage";
+    case STAGE_PIXELATE:
+        return "makepixel";
+    case STAGE_BLUR:
+        return "blur";
+    case STAGE_COLOR_MATRIX:
+        return "colormatrix";
+    case STAGE_MIRROR:
+        return "mirror";
+    }
+    return "unknown";
+}
+
+int stage_changes_size(const pipeline_stage *stage) {
+    return (stage->type == STAGE_ROTATE && stage->value != GG_ROTATE_FLIP) || stage->type == STAGE_ROTATE_ANGLE ||
+           stage->type == STAGE_PIXELATE;
+}
+
+int run_pipeline(const pipeline *p, gg_image *img) {
+    return run_pipeline_observed(p, img, NULL);
+}
+
+int run_pipeline_observed(const pipeline *p, gg_image *img, const pipeline_observer *observer) {
+    for (int i = 0; i < p->count; i++) {
+        const pipeline_stage *stage = &p->stages[i];
+        gg_image result = {0, 0, 0, 0, NULL};
+        int width, height;
+        int err = GG_OK;
+
+        if (is_point_stage(stage)) {
+            gg_lut lut;
+            int next = compose_point_stages(p, i, &lut);
+            if (observer != NULL) {
+                observer->before(observer->ctx, p, i, next - 1, img);
+            }
+            err = gg_apply_lut(img, &lut);
+            if (err != GG_OK) {
+                return err;
+            }
+            if (observer != NULL) {
+                observer->after(observer->ctx, p, i, next - 1, img);
+            }
+            i = next - 1;
+            continue;
+        }
+
+        if (observer != NULL) {
+            observer->before(observer->ctx, p, i, i, img);
+        }
+
+        switch (stage->type) {
+        case STAGE_ROTATE:
+            if (stage->value == GG_ROTATE_FLIP) {
+                err = gg_mirror(img, GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL);
+                break;
+            }
+            err = gg_rotated_size(img, stage->value, &width, &height);
+            if (err == GG_OK) {
+                err = gg_image_create(&result, width, height, img->channels);
+            }
+            if (err == GG_OK) {
+                err = gg_rotate(img, &result, stage->value);
+            }
+            break;
+        case STAGE_ROTATE_ANGLE:
+            err = gg_angle_rotated_size(img, stage->degrees, stage->value, &width, &height);
+            if (err == GG_OK) {
+                err = gg_image_create(&result, width, height, img->channels);
+            }
+            if (err == GG_OK) {
+                err = gg_rotate_angle(img, &result, stage->degrees, stage->mode, stage->fill);
+            }
+            break;
+        case STAGE_PIXELATE:
+            err = gg_pixelated_size(img, stage->value, &width, &height);
+            if (err == GG_OK) {
+                err = gg_image_create(&result, width, height, img->channels);
+            }
+            if (err == GG_OK) {
+                err = gg_pixelate(img, &result, stage->value);
+            }
+            break;
+        case STAGE_BRIGHTNESS:
+        case STAGE_CONTRAST:
+            // Handled by compose_point_stages above
+            break;
+        case STAGE_SATURATION:
+            err = gg_saturation(img, stage->value);
+            break;
+        case STAGE_BLACK_AND_WHITE:
+            err = gg_black_and_white(img);
+            break;
+        case STAGE_VINTAGE:
+            err = gg_vintage(img);
+            break;
+        case STAGE_BLUR:
+            err = gg_blur_ex(img, stage->value, stage->mode);
+            break;
+        case STAGE_COLOR_MATRIX:
+            err = gg_apply_color_matrix(img, &stage->matrix);
+            break;
+        case STAGE_MIRROR:
+            err = gg_mirror(img, stage->value);
+            break;
+        }
+
+        if (stage_changes_size(stage)) {
+            if (err != GG_OK) {
+                gg_image_free(&result);
+                return err;
+            }
+            gg_image_free(img);
+            *img = result;
+        } else if (err != GG_OK) {
+            return err;
+        }
+        if (observer != NULL) {
+            observer->after(observer->ctx, p, i, i, img);
+        }
+    }
+
+    return GG_OK;
+}
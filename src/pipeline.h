@@ -0,0 +1,75 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "ggpicture.h"
+
+#define MAX_PIPELINE_STAGES 32
+
+typedef enum {
+    STAGE_ROTATE,
+    STAGE_BRIGHTNESS,
+    STAGE_CONTRAST,
+    STAGE_SATURATION,
+    STAGE_BLACK_AND_WHITE,
+    STAGE_VINTAGE,
+    STAGE_PIXELATE,
+    STAGE_BLUR,
+    STAGE_COLOR_MATRIX,
+    STAGE_MIRROR,
+    STAGE_ROTATE_ANGLE
+} stage_type;
+
+typedef struct {
+    stage_type type;
+    int value; // Rotation type, mirror axes, percentage, pixel size, radius or GG_BOUNDS_* depending on type
+    int mode;  // GG_BLUR_* for blur stages, GG_INTERP_* for angle rotations, unused otherwise
+    gg_color_matrix matrix; // STAGE_COLOR_MATRIX only
+    double degrees;         // STAGE_ROTATE_ANGLE only, with the color of the uncovered corners
+    unsigned char fill[4];
+} pipeline_stage;
+
+typedef struct {
+    int count;
+    pipeline_stage stages[MAX_PIPELINE_STAGES];
+} pipeline;
+
+// Parse a spec such as "rotate:r,setbright:+10,blur:3" into stages. Rotations
+// by other angles read "rotate:<degrees>" followed by any of the options
+// ":bilinear" or ":bicubic", ":expand", ":keep" or ":inner", and a fill color
+// ":RRGGBB" or ":RRGGBBAA".
+int parse_pipeline(const char *spec, pipeline *out);
+
+// Parse 9 (3x3) or 12 (3x4, offset last in each row) numbers separated by
+// spaces, commas or semicolons, row by row. Prints an error and returns 1 if
+// the text is malformed or a value is out of range.
+int parse_color_matrix(const char *text, gg_color_matrix *out);
+
+// Parse a fill color as 6 or 8 hex digits, R, G, B and optionally alpha
+// (opaque if left out). Returns 1 without printing if the text is malformed.
+int parse_fill_color(const char *text, unsigned char fill[4]);
+
+// Run every stage on an in-memory image and return a GG_* code. Stages that
+// write a new image (90-degree and any-angle rotations, pixelation) replace
+// img with it and free the old pixels, so img must own its buffer; all
+// others, flips and mirrors included, work in place.
+int run_pipeline(const pipeline *p, gg_image *img);
+
+// Called around each step of run_pipeline_observed. A step is one stage, or
+// a run of brightness and contrast stages folded into one table, covering
+// stages[first..last]; after sees the step's result.
+typedef struct {
+    void (*before)(void *ctx, const pipeline *p, int first, int last, const gg_image *img);
+    void (*after)(void *ctx, const pipeline *p, int first, int last, const gg_image *img);
+    void *ctx;
+} pipeline_observer;
+
+// run_pipeline reporting every step to observer (which may be NULL)
+int run_pipeline_observed(const pipeline *p, gg_image *img, const pipeline_observer *observer);
+
+// 1 if the stage replaces the image with a new one, usually of another size
+int stage_changes_size(const pipeline_stage *stage);
+
+// Name of a stage as written in a pipeline spec, such as "setbright"
+const char *pipeline_stage_name(const pipeline_stage *stage);
+
+#endif
@@ -0,0 +1,461 @@
+#include <string.h>
+#include "ggpicture_internal.h"
+
+#ifdef GG_X86
+#include <immintrin.h>
+#endif
+
+// Edge length of the square blocks walked by the 90-degree rotations. One
+// block keeps ROTATE_TILE source rows and ROTATE_TILE destination rows hot
+// (at most 2 * 32 * 32 * 4 bytes), so the column-wise side of the transpose
+// hits L1 instead of missing cache and TLB on every pixel.
+#define ROTATE_TILE 32
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+struct rotate_job {
+    const gg_image *src;
+    gg_image *dst;
+    int clockwise;
+    int channels;
+};
+
+// Rotate by 90 degrees one block at a time. Inside a block, each destination
+// row is written contiguously while the source is read down a column that is
+// still in cache. Threads take whole rows of tiles, which cover disjoint
+// destination columns.
+static GG_ALWAYS_INLINE void rotate_90_body(void *ctx, int tile_start, int tile_end, const int channels) {
+    struct rotate_job *job = ctx;
+    const gg_image *src = job->src;
+    gg_image *dst = job->dst;
+    int width = src->width;
+    int height = src->height;
+    int y_stop = MIN(tile_end * ROTATE_TILE, height);
+
+    for (int ty = tile_start * ROTATE_TILE; ty < y_stop; ty += ROTATE_TILE) {
+        int y_end = MIN(ty + ROTATE_TILE, height);
+        for (int tx = 0; tx < width; tx += ROTATE_TILE) {
+            int x_end = MIN(tx + ROTATE_TILE, width);
+            for (int x = tx; x < x_end; x++) {
+                const unsigned char *in = ROW(src, ty) + x * channels;
+                if (job->clockwise) {
+                    // Source (x, y) lands on destination row x, column height - 1 - y
+                    unsigned char *out = ROW(dst, x) + (height - 1 - ty) * channels;
+                    for (int y = ty; y < y_end; y++) {
+                        memcpy(out, in, channels);
+                        in += src->stride;
+                        out -= channels;
+                    }
+                } else {
+                    // Source (x, y) lands on destination row width - 1 - x, column y
+                    unsigned char *out = ROW(dst, width - 1 - x) + ty * channels;
+                    for (int y = ty; y < y_end; y++) {
+                        memcpy(out, in, channels);
+                        in += src->stride;
+                        out += channels;
+                    }
+                }
+            }
+        }
+    }
+}
+
+GG_CHANNEL_VERSIONS(rotate_90, struct rotate_job);
+
+// 180 degrees only reverses the pixel order, so rows are streamed front to
+// back on both sides and no blocking is needed.
+static GG_ALWAYS_INLINE void rotate_180_body(void *ctx, int start, int end, const int channels) {
+    struct rotate_job *job = ctx;
+    const gg_image *src = job->src;
+    gg_image *dst = job->dst;
+    int width = src->width;
+    int height = src->height;
+
+    for (int y = start; y < end; y++) {
+        const unsigned char *in = ROW(src, y);
+        unsigned char *out = ROW(dst, height - 1 - y) + (width - 1) * channels;
+        for (int x = 0; x < width; x++) {
+            memcpy(out, in, channels);
+            in += channels;
+            out -= channels;
+        }
+    }
+}
+
+GG_CHANNEL_VERSIONS(rotate_180, struct rotate_job);
+
+// In-place mirroring is built on one primitive: swap count pixels of a with
+// those of b in reverse order, a[i] <-> b[count - 1 - i]. a and b must not
+// overlap. A row pair of a 180-degree turn is one call, and a single row
+// mirrors as its first half against its second.
+typedef void (*swap_reversed_fn)(unsigned char *a, unsigned char *b, int count, int channels);
+
+static GG_ALWAYS_INLINE void swap_reversed_body(unsigned char *a, unsigned char *b, int count, const int channels) {
+    unsigned char *mirror = b + (ptrdiff_t)count * channels;
+    for (int i = 0; i < count; i++) {
+        mirror -= channels;
+        if (channels <= 4) {
+            unsigned char pixel[4];
+            memcpy(pixel, a, channels);
+            memcpy(a, mirror, channels);
+            memcpy(mirror, pixel, channels);
+        } else {
+            for (int c = 0; c < channels; c++) {
+                unsigned char value = a[c];
+                a[c] = mirror[c];
+                mirror[c] = value;
+            }
+        }
+        a += channels;
+    }
+}
+
+static void swap_reversed_c1(unsigned char *a, unsigned char *b, int count, int channels) {
+    (void)channels;
+    swap_reversed_body(a, b, count, 1);
+}
+
+static void swap_reversed_c3(unsigned char *a, unsigned char *b, int count, int channels) {
+    (void)channels;
+    swap_reversed_body(a, b, count, 3);
+}
+
+static void swap_reversed_c4(unsigned char *a, unsigned char *b, int count, int channels) {
+    (void)channels;
+    swap_reversed_body(a, b, count, 4);
+}
+
+static void swap_reversed_any(unsigned char *a, unsigned char *b, int count, int channels) {
+    swap_reversed_body(a, b, count, channels);
+}
+
+#ifdef GG_X86
+
+// Gray and four-channel pixels fill vector registers exactly, so whole
+// registers are loaded from both ends, reversed and stored crosswise. Pixels
+// left over in the middle go through the scalar loop.
+
+__attribute__((target("sse2")))
+static __m128i reverse_bytes_sse2(__m128i v) {
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+__attribute__((target("sse2")))
+static void swap_reversed_c1_sse2(unsigned char *a, unsigned char *b, int count, int channels) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        unsigned char *mirror = b + count - i - 16;
+        __m128i front = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i back = _mm_loadu_si128((const __m128i *)mirror);
+        _mm_storeu_si128((__m128i *)(a + i), reverse_bytes_sse2(back));
+        _mm_storeu_si128((__m128i *)mirror, reverse_bytes_sse2(front));
+    }
+    swap_reversed_c1(a + i, b, count - i, channels);
+}
+
+__attribute__((target("sse2")))
+static void swap_reversed_c4_sse2(unsigned char *a, unsigned char *b, int count, int channels) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        unsigned char *mirror = b + (ptrdiff_t)(count - i - 4) * 4;
+        __m128i front = _mm_loadu_si128((const __m128i *)(a + (ptrdiff_t)i * 4));
+        __m128i back = _mm_loadu_si128((const __m128i *)mirror);
+        _mm_storeu_si128((__m128i *)(a + (ptrdiff_t)i * 4), _mm_shuffle_epi32(back, _MM_SHUFFLE(0, 1, 2, 3)));
+        _mm_storeu_si128((__m128i *)mirror, _mm_shuffle_epi32(front, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+    swap_reversed_c4(a + (ptrdiff_t)i * 4, b, count - i, channels);
+}
+
+// Three-channel pixels tile 48 bytes, three registers, 16 pixels at a time.
+// SSE2 reverses the whole block bytewise, which also reverses the bytes of
+// each pixel, then puts every pixel's outer bytes back by shifting the block
+// two bytes either way and picking each byte from the shift it needs.
+
+__attribute__((target("sse2")))
+static void reverse_pixels_c3_sse2(__m128i v[3]) {
+    // Every third byte, starting from byte 0, 1 and 2
+    const __m128i thirds[3] = {
+        _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1),
+        _mm_setr_epi8(0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0),
+        _mm_setr_epi8(0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0),
+    };
+    __m128i r[3] = {reverse_bytes_sse2(v[2]), reverse_bytes_sse2(v[1]), reverse_bytes_sse2(v[0])};
+    for (int i = 0; i < 3; i++) {
+        __m128i next = i < 2 ? _mm_slli_si128(r[i + 1], 14) : _mm_setzero_si128();
+        __m128i previous = i > 0 ? _mm_srli_si128(r[i - 1], 14) : _mm_setzero_si128();
+        __m128i down = _mm_or_si128(_mm_srli_si128(r[i], 2), next);
+        __m128i up = _mm_or_si128(_mm_slli_si128(r[i], 2), previous);
+        // Register i starts at offset 16 * i, which is i modulo 3 from the end
+        v[i] = _mm_or_si128(_mm_or_si128(_mm_and_si128(down, thirds[(3 - i) % 3]),
+                                         _mm_and_si128(r[i], thirds[(4 - i) % 3])),
+                            _mm_and_si128(up, thirds[(5 - i) % 3]));
+    }
+}
+
+__attribute__((target("sse2")))
+static void swap_reversed_c3_sse2(unsigned char *a, unsigned char *b, int count, int channels) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        unsigned char *front = a + (ptrdiff_t)i * 3;
+        unsigned char *mirror = b + (ptrdiff_t)(count - i - 16) * 3;
+        __m128i x[3], y[3];
+        for (int r = 0; r < 3; r++) {
+            x[r] = _mm_loadu_si128((const __m128i *)(front + 16 * r));
+            y[r] = _mm_loadu_si128((const __m128i *)(mirror + 16 * r));
+        }
+        reverse_pixels_c3_sse2(x);
+        reverse_pixels_c3_sse2(y);
+        for (int r = 0; r < 3; r++) {
+            _mm_storeu_si128((__m128i *)(front + 16 * r), y[r]);
+            _mm_storeu_si128((__m128i *)(mirror + 16 * r), x[r]);
+        }
+    }
+    swap_reversed_c3(a + (ptrdiff_t)i * 3, b, count - i, channels);
+}
+
+// With pshufb every output register is gathered straight from the two or
+// three input registers its pixels come from.
+__attribute__((target("avx2")))
+static void reverse_pixels_c3_avx2(__m128i v[3]) {
+    const __m128i lane0_from1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14);
+    const __m128i lane0_from2 = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -1);
+    const __m128i lane1_from0 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 15, -1);
+    const __m128i lane1_from1 = _mm_setr_epi8(15, -1, 11, 12, 13, 8, 9, 10, 5, 6, 7, 2, 3, 4, -1, 0);
+    const __m128i lane1_from2 = _mm_setr_epi8(-1, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i lane2_from0 = _mm_setr_epi8(-1, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+    const __m128i lane2_from1 = _mm_setr_epi8(1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i lane0 = _mm_or_si128(_mm_shuffle_epi8(v[1], lane0_from1), _mm_shuffle_epi8(v[2], lane0_from2));
+    __m128i lane1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v[0], lane1_from0), _mm_shuffle_epi8(v[1], lane1_from1)),
+                                 _mm_shuffle_epi8(v[2], lane1_from2));
+    __m128i lane2 = _mm_or_si128(_mm_shuffle_epi8(v[0], lane2_from0), _mm_shuffle_epi8(v[1], lane2_from1));
+    v[0] = lane0;
+    v[1] = lane1;
+    v[2] = lane2;
+}
+
+__attribute__((target("avx2")))
+static void swap_reversed_c3_avx2(unsigned char *a, unsigned char *b, int count, int channels) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        unsigned char *front = a + (ptrdiff_t)i * 3;
+        unsigned char *mirror = b + (ptrdiff_t)(count - i - 16) * 3;
+        __m128i x[3], y[3];
+        for (int r = 0; r < 3; r++) {
+            x[r] = _mm_loadu_si128((const __m128i *)(front + 16 * r));
+            y[r] = _mm_loadu_si128((const __m128i *)(mirror + 16 * r));
+        }
+        reverse_pixels_c3_avx2(x);
+        reverse_pixels_c3_avx2(y);
+        for (int r = 0; r < 3; r++) {
+            _mm_storeu_si128((__m128i *)(front + 16 * r), y[r]);
+            _mm_storeu_si128((__m128i *)(mirror + 16 * r), x[r]);
+        }
+    }
+    swap_reversed_c3(a + (ptrdiff_t)i * 3, b, count - i, channels);
+}
+
+__attribute__((target("avx2")))
+static __m256i reverse_bytes_avx2(__m256i v) {
+    const __m256i lanes = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                           15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, lanes), _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2")))
+static void swap_reversed_c1_avx2(unsigned char *a, unsigned char *b, int count, int channels) {
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        unsigned char *mirror = b + count - i - 32;
+        __m256i front = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i back = _mm256_loadu_si256((const __m256i *)mirror);
+        _mm256_storeu_si256((__m256i *)(a + i), reverse_bytes_avx2(back));
+        _mm256_storeu_si256((__m256i *)mirror, reverse_bytes_avx2(front));
+    }
+    swap_reversed_c1_sse2(a + i, b, count - i, channels);
+}
+
+__attribute__((target("avx2")))
+static void swap_reversed_c4_avx2(unsigned char *a, unsigned char *b, int count, int channels) {
+    const __m256i order = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        unsigned char *mirror = b + (ptrdiff_t)(count - i - 8) * 4;
+        __m256i front = _mm256_loadu_si256((const __m256i *)(a + (ptrdiff_t)i * 4));
+        __m256i back = _mm256_loadu_si256((const __m256i *)mirror);
+        _mm256_storeu_si256((__m256i *)(a + (ptrdiff_t)i * 4), _mm256_permutevar8x32_epi32(back, order));
+        _mm256_storeu_si256((__m256i *)mirror, _mm256_permutevar8x32_epi32(front, order));
+    }
+    swap_reversed_c4_sse2(a + (ptrdiff_t)i * 4, b, count - i, channels);
+}
+
+GG_TARGET_AVX512
+static __m512i reverse_bytes_avx512(__m512i v) {
+    const __m512i lanes = _mm512_broadcast_i32x4(_mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    v = _mm512_shuffle_epi8(v, lanes);
+    return _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+GG_TARGET_AVX512
+static void swap_reversed_c1_avx512(unsigned char *a, unsigned char *b, int count, int channels) {
+    int i = 0;
+    for (; i + 64 <= count; i += 64) {
+        unsigned char *mirror = b + count - i - 64;
+        __m512i front = _mm512_loadu_si512((const void *)(a + i));
+        __m512i back = _mm512_loadu_si512((const void *)mirror);
+        _mm512_storeu_si512((void *)(a + i), reverse_bytes_avx512(back));
+        _mm512_storeu_si512((void *)mirror, reverse_bytes_avx512(front));
+    }
+    swap_reversed_c1_avx2(a + i, b, count - i, channels);
+}
+
+GG_TARGET_AVX512
+static void swap_reversed_c4_avx512(unsigned char *a, unsigned char *b, int count, int channels) {
+    const __m512i order = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        unsigned char *mirror = b + (ptrdiff_t)(count - i - 16) * 4;
+        __m512i front = _mm512_loadu_si512((const void *)(a + (ptrdiff_t)i * 4));
+        __m512i back = _mm512_loadu_si512((const void *)mirror);
+        _mm512_storeu_si512((void *)(a + (ptrdiff_t)i * 4), _mm512_permutexvar_epi32(order, back));
+        _mm512_storeu_si512((void *)mirror, _mm512_permutexvar_epi32(order, front));
+    }
+    swap_reversed_c4_avx2(a + (ptrdiff_t)i * 4, b, count - i, channels);
+}
+
+static const swap_reversed_fn swap_reversed_c1_versions[GG_ISA_COUNT] = {
+    swap_reversed_c1, swap_reversed_c1_sse2, swap_reversed_c1_avx2, swap_reversed_c1_avx512,
+};
+
+static const swap_reversed_fn swap_reversed_c3_versions[GG_ISA_COUNT] = {
+    swap_reversed_c3, swap_reversed_c3_sse2, swap_reversed_c3_avx2, swap_reversed_c3_avx2,
+};
+
+static const swap_reversed_fn swap_reversed_c4_versions[GG_ISA_COUNT] = {
+    swap_reversed_c4, swap_reversed_c4_sse2, swap_reversed_c4_avx2, swap_reversed_c4_avx512,
+};
+
+#else
+
+static const swap_reversed_fn swap_reversed_c1_versions[GG_ISA_COUNT] = {
+    swap_reversed_c1, swap_reversed_c1, swap_reversed_c1, swap_reversed_c1,
+};
+
+static const swap_reversed_fn swap_reversed_c3_versions[GG_ISA_COUNT] = {
+    swap_reversed_c3, swap_reversed_c3, swap_reversed_c3, swap_reversed_c3,
+};
+
+static const swap_reversed_fn swap_reversed_c4_versions[GG_ISA_COUNT] = {
+    swap_reversed_c4, swap_reversed_c4, swap_reversed_c4, swap_reversed_c4,
+};
+
+#endif
+
+static swap_reversed_fn select_swap_reversed(int channels) {
+    switch (channels) {
+    case 1:
+        return GG_DISPATCH(swap_reversed_c1_versions);
+    case 3:
+        return GG_DISPATCH(swap_reversed_c3_versions);
+    case 4:
+        return GG_DISPATCH(swap_reversed_c4_versions);
+    default:
+        return swap_reversed_any;
+    }
+}
+
+// Plain row swap for the vertical mirror; the compiler vectorizes it
+static void swap_rows(unsigned char *restrict a, unsigned char *restrict b, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        unsigned char value = a[i];
+        a[i] = b[i];
+        b[i] = value;
+    }
+}
+
+struct mirror_job {
+    gg_image *img;
+    int axes;
+    swap_reversed_fn swap_reversed;
+};
+
+// Items are rows for a horizontal mirror and pairs of rows (y, height - 1 - y)
+// otherwise, so every pixel is read and written exactly once
+static void mirror_rows(void *ctx, int start, int end) {
+    struct mirror_job *job = ctx;
+    gg_image *img = job->img;
+    int width = img->width;
+    int channels = img->channels;
+    int half = width / 2;
+
+    for (int y = start; y < end; y++) {
+        unsigned char *row = ROW(img, y);
+        unsigned char *other = ROW(img, img->height - 1 - y);
+        if (job->axes != GG_MIRROR_HORIZONTAL && other != row) {
+            if (job->axes == GG_MIRROR_VERTICAL) {
+                swap_rows(row, other, (size_t)width * channels);
+            } else {
+                job->swap_reversed(row, other, width, channels);
+            }
+        } else if (job->axes != GG_MIRROR_VERTICAL) {
+            job->swap_reversed(row, row + (ptrdiff_t)(width - half) * channels, half, channels);
+        }
+    }
+}
+
+int gg_mirror(gg_image *img, int axes) {
+    if (axes != GG_MIRROR_HORIZONTAL && axes != GG_MIRROR_VERTICAL &&
+        axes != (GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL)) {
+        return GG_ERR_ARGUMENT;
+    }
+
+    struct mirror_job job = {img, axes, select_swap_reversed(img->channels)};
+    size_t row_bytes = (size_t)img->width * img->channels;
+    if (axes == GG_MIRROR_HORIZONTAL) {
+        gg_parallel_for(img->height, GG_ROW_GRAIN(row_bytes), mirror_rows, &job);
+    } else {
+        gg_parallel_for((img->height + 1) / 2, GG_ROW_GRAIN(2 * row_bytes), mirror_rows, &job);
+    }
+    return GG_OK;
+}
+
+int gg_rotated_size(const gg_image *src, int rotation_type, int *width, int *height) {
+    if (rotation_type == GG_ROTATE_RIGHT || rotation_type == GG_ROTATE_LEFT) {
+        *width = src->height;
+        *height = src->width;
+    } else if (rotation_type == GG_ROTATE_FLIP) {
+        *width = src->width;
+        *height = src->height;
+    } else {
+        return GG_ERR_ARGUMENT;
+    }
+    return GG_OK;
+}
+
+int gg_rotate(const gg_image *src, gg_image *dst, int rotation_type) {
+    int expected_width, expected_height;
+
+    int err = gg_rotated_size(src, rotation_type, &expected_width, &expected_height);
+    if (err != GG_OK) {
+        return err;
+    }
+    if (dst->width != expected_width || dst->height != expected_height || dst->channels != src->channels) {
+        return GG_ERR_SIZE;
+    }
+
+    struct rotate_job job = {src, dst, rotation_type == GG_ROTATE_RIGHT, src->channels};
+    size_t row_bytes = (size_t)src->width * src->channels;
+
+    if (rotation_type == GG_ROTATE_FLIP) {
+        gg_parallel_for(src->height, GG_ROW_GRAIN(row_bytes),
+                        GG_FOR_CHANNELS(rotate_180_channel_versions, src->channels), &job);
+        return GG_OK;
+    }
+
+    int tile_rows = (src->height + ROTATE_TILE - 1) / ROTATE_TILE;
+    gg_parallel_for(tile_rows, GG_ROW_GRAIN(row_bytes * ROTATE_TILE),
+                    GG_FOR_CHANNELS(rotate_90_channel_versions, src->channels), &job);
+    return GG_OK;
+}
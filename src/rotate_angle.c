@@ -0,0 +1,406 @@
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include "ggpicture_internal.h"
+
+#ifdef GG_X86
+#include <immintrin.h>
+#endif
+
+// Edge length of the square destination blocks. A block reads a source patch
+// of about the same size whatever the angle, and every row of a block starts
+// from an exact position, so the fixed-point stepping never drifts by more
+// than ANGLE_TILE steps of rounding.
+#define ANGLE_TILE 64
+
+#define ANGLE_PI 3.14159265358979323846
+
+// Weight tables are indexed by the top 8 bits of the 16-bit fraction
+#define ANGLE_PHASES 256
+
+struct angle_job;
+
+// Fill count destination pixels of one row. Pixel i samples the source at
+// base + (frac + i * step) / 65536 in both directions.
+typedef void (*angle_span_fn)(const struct angle_job *job, unsigned char *out, int count, int base_x, int base_y,
+                              int frac_x, int frac_y);
+
+struct angle_job {
+    const gg_image *src;
+    gg_image *dst;
+    double cos_a;
+    double sin_a;
+    double src_cx, src_cy;
+    double dst_cx, dst_cy;
+    int step_x, step_y; // 16.16 source step per destination pixel
+    int taps;           // per direction: 2 for bilinear, 4 for bicubic
+    int shift;          // fixed-point bits of both weight passes together
+    int weights[4][ANGLE_PHASES];
+    unsigned char fill[4];
+    angle_span_fn span;
+};
+
+// Integer weights in 8.8 (bilinear) or 10.10 (Catmull-Rom bicubic) fixed
+// point. Every phase sums exactly to one, so flat areas and the fill color
+// come out unchanged.
+static void build_weights(struct angle_job *job, int interpolation) {
+    if (interpolation == GG_INTERP_BILINEAR) {
+        job->taps = 2;
+        job->shift = 16;
+        for (int f = 0; f < ANGLE_PHASES; f++) {
+            job->weights[0][f] = 256 - f;
+            job->weights[1][f] = f;
+        }
+        return;
+    }
+
+    job->taps = 4;
+    job->shift = 20;
+    for (int f = 0; f < ANGLE_PHASES; f++) {
+        double t = (double)f / ANGLE_PHASES;
+        double w[4] = {
+            (-t * t * t + 2 * t * t - t) / 2,
+            (3 * t * t * t - 5 * t * t + 2) / 2,
+            (-3 * t * t * t + 4 * t * t + t) / 2,
+            (t * t * t - t * t) / 2,
+        };
+        int sum = 0;
+        for (int k = 0; k < 4; k++) {
+            job->weights[k][f] = (int)lround(w[k] * 1024);
+            sum += job->weights[k][f];
+        }
+        job->weights[t < 0.5 ? 1 : 2][f] += 1024 - sum;
+    }
+}
+
+// One destination pixel from the taps x taps source pixels starting at (x0,
+// y0). Taps outside the source take the fill color, which blends the edges.
+static GG_ALWAYS_INLINE void sample_pixel(const struct angle_job *job, unsigned char *out, int x0, int y0,
+                                          int phase_x, int phase_y, const int taps) {
+    const gg_image *src = job->src;
+    int channels = src->channels;
+    int inside = x0 >= 0 && y0 >= 0 && x0 + taps <= src->width && y0 + taps <= src->height;
+    int acc[4] = {0, 0, 0, 0};
+
+    for (int ty = 0; ty < taps; ty++) {
+        int y = y0 + ty;
+        int row[4] = {0, 0, 0, 0};
+        for (int tx = 0; tx < taps; tx++) {
+            int x = x0 + tx;
+            const unsigned char *pixel = job->fill;
+            if (inside || (x >= 0 && x < src->width && y >= 0 && y < src->height)) {
+                pixel = ROW(src, y) + x * channels;
+            }
+            for (int c = 0; c < channels; c++) {
+                row[c] += pixel[c] * job->weights[tx][phase_x];
+            }
+        }
+        for (int c = 0; c < channels; c++) {
+            acc[c] += row[c] * job->weights[ty][phase_y];
+        }
+    }
+
+    for (int c = 0; c < channels; c++) {
+        int value = (acc[c] + (1 << (job->shift - 1))) >> job->shift;
+        out[c] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+    }
+}
+
+static GG_ALWAYS_INLINE void span_body(const struct angle_job *job, unsigned char *out, int count, int base_x,
+                                       int base_y, int frac_x, int frac_y, const int taps) {
+    int channels = job->src->channels;
+    int origin = taps / 2 - 1;
+    for (int i = 0; i < count; i++) {
+        int px = frac_x + i * job->step_x;
+        int py = frac_y + i * job->step_y;
+        sample_pixel(job, out + i * channels, base_x + (px >> 16) - origin, base_y + (py >> 16) - origin,
+                     (px >> 8) & (ANGLE_PHASES - 1), (py >> 8) & (ANGLE_PHASES - 1), taps);
+    }
+}
+
+static void span_bilinear(const struct angle_job *job, unsigned char *out, int count, int base_x, int base_y,
+                          int frac_x, int frac_y) {
+    span_body(job, out, count, base_x, base_y, frac_x, frac_y, 2);
+}
+
+static void span_bicubic(const struct angle_job *job, unsigned char *out, int count, int base_x, int base_y,
+                         int frac_x, int frac_y) {
+    span_body(job, out, count, base_x, base_y, frac_x, frac_y, 4);
+}
+
+#ifdef GG_X86
+
+// Eight destination pixels at a time. Each tap is one 32-bit gather per pixel
+// that brings in a whole 3- or 4-channel pixel, and the weights are gathered
+// from the tables by phase. The arithmetic is the scalar integer arithmetic
+// lane by lane, so both give the same bytes. Groups with a tap outside the
+// source, or too close to its right edge for the 4-byte read of a 3-channel
+// pixel, go through the scalar loop.
+__attribute__((target("avx2")))
+static GG_ALWAYS_INLINE void span_avx2_body(const struct angle_job *job, unsigned char *out, int count, int base_x,
+                                            int base_y, int frac_x, int frac_y, const int taps, const int channels) {
+    const gg_image *src = job->src;
+    const int origin = taps / 2 - 1;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i byte = _mm256_set1_epi32(255);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i lane_step_x = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(job->step_x));
+    const __m256i lane_step_y = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(job->step_y));
+    const __m256i max_x = _mm256_set1_epi32(src->width - taps - (channels == 3));
+    const __m256i max_y = _mm256_set1_epi32(src->height - taps);
+    const __m256i stride = _mm256_set1_epi32((int)src->stride);
+    const __m256i round = _mm256_set1_epi32(1 << (job->shift - 1));
+    const __m128i shift = _mm_cvtsi32_si128(job->shift);
+    const int *pixels = (const int *)src->pixels;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_add_epi32(_mm256_set1_epi32(frac_x + i * job->step_x), lane_step_x);
+        __m256i py = _mm256_add_epi32(_mm256_set1_epi32(frac_y + i * job->step_y), lane_step_y);
+        __m256i x0 = _mm256_add_epi32(_mm256_set1_epi32(base_x - origin), _mm256_srai_epi32(px, 16));
+        __m256i y0 = _mm256_add_epi32(_mm256_set1_epi32(base_y - origin), _mm256_srai_epi32(py, 16));
+
+        __m256i outside = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(zero, x0), _mm256_cmpgt_epi32(x0, max_x)),
+                                          _mm256_or_si256(_mm256_cmpgt_epi32(zero, y0), _mm256_cmpgt_epi32(y0, max_y)));
+        if (!_mm256_testz_si256(outside, outside)) {
+            span_body(job, out + i * channels, 8, base_x, base_y, frac_x + i * job->step_x, frac_y + i * job->step_y,
+                      taps);
+            continue;
+        }
+
+        __m256i phase_x = _mm256_and_si256(_mm256_srli_epi32(px, 8), byte);
+        __m256i phase_y = _mm256_and_si256(_mm256_srli_epi32(py, 8), byte);
+        __m256i wx[4], wy[4];
+        for (int t = 0; t < taps; t++) {
+            wx[t] = _mm256_i32gather_epi32(job->weights[t], phase_x, 4);
+            wy[t] = _mm256_i32gather_epi32(job->weights[t], phase_y, 4);
+        }
+
+        __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(y0, stride),
+                                          _mm256_mullo_epi32(x0, _mm256_set1_epi32(channels)));
+        __m256i acc[4] = {zero, zero, zero, zero};
+        for (int ty = 0; ty < taps; ty++) {
+            __m256i row[4] = {zero, zero, zero, zero};
+            for (int tx = 0; tx < taps; tx++) {
+                __m256i word = _mm256_i32gather_epi32(pixels, _mm256_add_epi32(offset, _mm256_set1_epi32(tx * channels)), 1);
+                for (int c = 0; c < channels; c++) {
+                    __m256i value = _mm256_and_si256(_mm256_srli_epi32(word, 8 * c), byte);
+                    row[c] = _mm256_add_epi32(row[c], _mm256_mullo_epi32(value, wx[tx]));
+                }
+            }
+            for (int c = 0; c < channels; c++) {
+                acc[c] = _mm256_add_epi32(acc[c], _mm256_mullo_epi32(row[c], wy[ty]));
+            }
+            offset = _mm256_add_epi32(offset, stride);
+        }
+
+        __m256i result = zero;
+        for (int c = 0; c < channels; c++) {
+            __m256i value = _mm256_sra_epi32(_mm256_add_epi32(acc[c], round), shift);
+            value = _mm256_min_epi32(_mm256_max_epi32(value, zero), byte);
+            result = _mm256_or_si256(result, _mm256_slli_epi32(value, 8 * c));
+        }
+
+        if (channels == 4) {
+            _mm256_storeu_si256((__m256i *)(out + i * 4), result);
+        } else {
+            // Drop every fourth byte: 12 bytes per 128-bit lane, then close the
+            // gap between the lanes and store the 24 bytes
+            const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                  0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            const __m256i order = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+            const __m256i six = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+            result = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(result, pack), order);
+            _mm256_maskstore_epi32((int *)(out + i * 3), six, result);
+        }
+    }
+
+    span_body(job, out + i * channels, count - i, base_x, base_y, frac_x + i * job->step_x,
+              frac_y + i * job->step_y, taps);
+}
+
+__attribute__((target("avx2")))
+static void span_bilinear_avx2(const struct angle_job *job, unsigned char *out, int count, int base_x, int base_y,
+                               int frac_x, int frac_y) {
+    if (job->src->channels == 3) {
+        span_avx2_body(job, out, count, base_x, base_y, frac_x, frac_y, 2, 3);
+    } else if (job->src->channels == 4) {
+        span_avx2_body(job, out, count, base_x, base_y, frac_x, frac_y, 2, 4);
+    } else {
+        span_bilinear(job, out, count, base_x, base_y, frac_x, frac_y);
+    }
+}
+
+__attribute__((target("avx2")))
+static void span_bicubic_avx2(const struct angle_job *job, unsigned char *out, int count, int base_x, int base_y,
+                              int frac_x, int frac_y) {
+    if (job->src->channels == 3) {
+        span_avx2_body(job, out, count, base_x, base_y, frac_x, frac_y, 4, 3);
+    } else if (job->src->channels == 4) {
+        span_avx2_body(job, out, count, base_x, base_y, frac_x, frac_y, 4, 4);
+    } else {
+        span_bicubic(job, out, count, base_x, base_y, frac_x, frac_y);
+    }
+}
+
+static const angle_span_fn span_bilinear_versions[GG_ISA_COUNT] = {
+    span_bilinear, span_bilinear, span_bilinear_avx2, span_bilinear_avx2,
+};
+
+static const angle_span_fn span_bicubic_versions[GG_ISA_COUNT] = {
+    span_bicubic, span_bicubic, span_bicubic_avx2, span_bicubic_avx2,
+};
+
+#else
+
+static const angle_span_fn span_bilinear_versions[GG_ISA_COUNT] = {
+    span_bilinear, span_bilinear, span_bilinear, span_bilinear,
+};
+
+static const angle_span_fn span_bicubic_versions[GG_ISA_COUNT] = {
+    span_bicubic, span_bicubic, span_bicubic, span_bicubic,
+};
+
+#endif
+
+// Threads take whole rows of blocks. Each block row segment starts from the
+// exact source position of its first pixel and steps in fixed point from there.
+static void rotate_angle_tiles(void *ctx, int tile_start, int tile_end) {
+    struct angle_job *job = ctx;
+    gg_image *dst = job->dst;
+    int channels = dst->channels;
+    int y_stop = tile_end * ANGLE_TILE < dst->height ? tile_end * ANGLE_TILE : dst->height;
+
+    for (int ty = tile_start * ANGLE_TILE; ty < y_stop; ty += ANGLE_TILE) {
+        int y_end = ty + ANGLE_TILE < dst->height ? ty + ANGLE_TILE : dst->height;
+        for (int tx = 0; tx < dst->width; tx += ANGLE_TILE) {
+            int count = dst->width - tx < ANGLE_TILE ? dst->width - tx : ANGLE_TILE;
+            for (int y = ty; y < y_end; y++) {
+                double dx = tx - job->dst_cx, dy = y - job->dst_cy;
+                double sx = job->src_cx + dx * job->cos_a + dy * job->sin_a;
+                double sy = job->src_cy - dx * job->sin_a + dy * job->cos_a;
+                double base_x = floor(sx), base_y = floor(sy);
+                job->span(job, ROW(dst, y) + (ptrdiff_t)tx * channels, count, (int)base_x, (int)base_y,
+                          (int)((sx - base_x) * 65536.0), (int)((sy - base_y) * 65536.0));
+            }
+        }
+    }
+}
+
+// Number of clockwise quarter turns if degrees is a whole multiple of 90
+static int quarter_turns(double degrees, int *turns) {
+    double quarters = degrees / 90.0;
+    if (quarters != floor(quarters) || fabs(quarters) > INT_MAX) {
+        return 0;
+    }
+    *turns = (int)fmod(quarters, 4.0);
+    *turns = (*turns + 4) % 4;
+    return 1;
+}
+
+int gg_angle_rotated_size(const gg_image *src, double degrees, int bounds, int *width, int *height) {
+    if (!isfinite(degrees) || bounds < GG_BOUNDS_EXPAND || bounds > GG_BOUNDS_INNER) {
+        return GG_ERR_ARGUMENT;
+    }
+
+    int turns;
+    if (bounds == GG_BOUNDS_KEEP || (quarter_turns(degrees, &turns) && turns % 2 == 0)) {
+        *width = src->width;
+        *height = src->height;
+        return GG_OK;
+    }
+    if (quarter_turns(degrees, &turns)) {
+        *width = src->height;
+        *height = src->width;
+        return GG_OK;
+    }
+
+    double radians = degrees * ANGLE_PI / 180.0;
+    double c = fabs(cos(radians)), s = fabs(sin(radians));
+    double w = src->width, h = src->height;
+    double out_w, out_h;
+
+    if (bounds == GG_BOUNDS_EXPAND) {
+        out_w = ceil(w * c + h * s - 1e-6);
+        out_h = ceil(w * s + h * c - 1e-6);
+    } else {
+        // Largest upright rectangle inside the rotated one: either it touches
+        // all four sides, or, for thin images, both long sides at its corners
+        double long_side = w >= h ? w : h, short_side = w >= h ? h : w;
+        if (short_side <= 2.0 * s * c * long_side || fabs(s - c) < 1e-10) {
+            double x = 0.5 * short_side;
+            out_w = w >= h ? x / s : x / c;
+            out_h = w >= h ? x / c : x / s;
+        } else {
+            double cos_2a = c * c - s * s;
+            out_w = (w * c - h * s) / cos_2a;
+            out_h = (h * c - w * s) / cos_2a;
+        }
+        out_w = floor(out_w + 1e-6);
+        out_h = floor(out_h + 1e-6);
+    }
+
+    if (out_w > INT_MAX || out_h > INT_MAX) {
+        return GG_ERR_SIZE;
+    }
+    *width = out_w < 1 ? 1 : (int)out_w;
+    *height = out_h < 1 ? 1 : (int)out_h;
+    return GG_OK;
+}
+
+int gg_rotate_angle(const gg_image *src, gg_image *dst, double degrees, int interpolation, const unsigned char *fill) {
+    if (!isfinite(degrees) || (interpolation != GG_INTERP_BILINEAR && interpolation != GG_INTERP_BICUBIC)) {
+        return GG_ERR_ARGUMENT;
+    }
+    if (src->channels > 4 || dst->channels != src->channels) {
+        return GG_ERR_SIZE;
+    }
+
+    // Quarter turns at their natural size move pixels without resampling
+    int turns;
+    if (quarter_turns(degrees, &turns)) {
+        if (turns % 2 == 0 && dst->width == src->width && dst->height == src->height) {
+            if (turns == 2) {
+                return gg_rotate(src, dst, GG_ROTATE_FLIP);
+            }
+            for (int y = 0; y < src->height; y++) {
+                memcpy(ROW(dst, y), ROW(src, y), (size_t)src->width * src->channels);
+            }
+            return GG_OK;
+        }
+        if (turns % 2 == 1 && dst->width == src->height && dst->height == src->width) {
+            return gg_rotate(src, dst, turns == 1 ? GG_ROTATE_RIGHT : GG_ROTATE_LEFT);
+        }
+    }
+
+    struct angle_job job;
+    double radians = fmod(degrees, 360.0) * ANGLE_PI / 180.0;
+    job.src = src;
+    job.dst = dst;
+    job.cos_a = cos(radians);
+    job.sin_a = sin(radians);
+    job.src_cx = (src->width - 1) / 2.0;
+    job.src_cy = (src->height - 1) / 2.0;
+    job.dst_cx = (dst->width - 1) / 2.0;
+    job.dst_cy = (dst->height - 1) / 2.0;
+    job.step_x = (int)lround(job.cos_a * 65536.0);
+    job.step_y = (int)lround(-job.sin_a * 65536.0);
+    build_weights(&job, interpolation);
+    memset(job.fill, 0, sizeof(job.fill));
+    if (fill != NULL) {
+        memcpy(job.fill, fill, src->channels);
+    }
+
+    // The gathers address the source with 32-bit offsets
+    int small = (double)(src->stride < 0 ? -src->stride : src->stride) * src->height < INT_MAX / 2;
+    if (interpolation == GG_INTERP_BILINEAR) {
+        job.span = small ? GG_DISPATCH(span_bilinear_versions) : span_bilinear;
+    } else {
+        job.span = small ? GG_DISPATCH(span_bicubic_versions) : span_bicubic;
+    }
+
+    int tile_rows = (dst->height + ANGLE_TILE - 1) / ANGLE_TILE;
+    size_t row_bytes = (size_t)dst->width * dst->channels;
+    gg_parallel_for(tile_rows, GG_ROW_GRAIN(row_bytes * ANGLE_TILE * job.taps), rotate_angle_tiles, &job);
+    return GG_OK;
+}
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "server.h"
+#include "image_processing.h"
+#include "stats.h"
+
+struct server {
+    const char *base_dir;
+    const char *default_output;
+    int listen_fd;
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;
+    int connections;
+    int stopping;
+};
+
+struct connection {
+    struct server *server;
+    int fd;
+};
+
+// Buffered request reader that also collects a descriptor sent with
+// SCM_RIGHTS, which the next request line may refer to
+struct line_reader {
+    int fd;
+    int passed_fd;
+    size_t length;
+    char buffer[SERVER_MAX_LINE];
+};
+
+static int fill_address(const char *socket_path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        printf("Error: Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+static int connect_socket(const char *socket_path) {
+    struct sockaddr_un address;
+    if (fill_address(socket_path, &address) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+static int reply(int fd, const char *status, const char *detail) {
+    char line[SERVER_MAX_LINE];
+    int written = detail != NULL ? snprintf(line, sizeof(line), "%s %s\n", status, detail)
+                                 : snprintf(line, sizeof(line), "%s\n", status);
+    if (written < 0 || (size_t)written >= sizeof(line)) {
+        written = snprintf(line, sizeof(line), "%s\n", status);
+    }
+    return send_all(fd, line, (size_t)written);
+}
+
+// Join base_dir and a relative path; absolute paths are copied as they are
+static int resolve_path(const char *base_dir, const char *path, char *out, size_t size) {
+    int written = path[0] == '/' ? snprintf(out, size, "%s", path) : snprintf(out, size, "%s/%s", base_dir, path);
+    return written < 0 || (size_t)written >= size;
+}
+
+static int run_job(struct server *server, int fd, char *fields) {
+    char *stages = fields;
+    char *input = strchr(stages, '\t');
+    char *output = input != NULL ? strchr(input + 1, '\t') : NULL;
+    if (output == NULL || strchr(output + 1, '\t') != NULL) {
+        return reply(fd, "error", "expected run<TAB>stages<TAB>input<TAB>output");
+    }
+    *input++ = '\0';
+    *output++ = '\0';
+
+    pipeline p;
+    if (parse_pipeline(stages, &p) != 0) {
+        return reply(fd, "error", "invalid pipeline");
+    }
+
+    char input_path[MAX_PATH];
+    char output_path[MAX_PATH];
+    if (*input == '\0' || resolve_path(server->base_dir, input, input_path, sizeof(input_path)) != 0 ||
+        resolve_path(server->base_dir, *output != '\0' ? output : server->default_output, output_path,
+                     sizeof(output_path)) != 0) {
+        return reply(fd, "error", "invalid path");
+    }
+
+    if (process_pipeline(input_path, &p, output_path) != 0) {
+        return reply(fd, "error", "processing failed");
+    }
+    return reply(fd, "ok", output_path);
+}
+
+static int parse_size(const char *text, int *out) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || value <= 0 || value > INT_MAX) {
+        return 1;
+    }
+    *out = (int)value;
+    return 0;
+}
+
+static int changes_size(const pipeline *p) {
+    for (int i = 0; i < p->count; i++) {
+        if (stage_changes_size(&p->stages[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Run a pipeline on pixels mapped from a shared-memory segment. Without size
+// changes the kernels work on the mapping itself; otherwise the result is
+// copied back and must fit in the segment.
+static int run_mapped(const pipeline *p, unsigned char *pixels, size_t capacity, int *width, int *height,
+                      int channels) {
+    gg_image img;
+    gg_image_wrap(&img, pixels, *width, *height, channels, (ptrdiff_t)*width * channels);
+    if (!changes_size(p)) {
+        return stats_run_pipeline(p, &img);
+    }
+
+    gg_image work;
+    int err = gg_image_create(&work, img.width, img.height, channels);
+    if (err != GG_OK) {
+        return err;
+    }
+    memcpy(work.pixels, pixels, (size_t)img.width * img.height * channels);
+    err = stats_run_pipeline(p, &work);
+    if (err == GG_OK && (size_t)work.width * work.height * channels > capacity) {
+        err = GG_ERR_SIZE;
+    }
+    if (err == GG_OK) {
+        memcpy(pixels, work.pixels, (size_t)work.width * work.height * channels);
+        *width = work.width;
+        *height = work.height;
+    }
+    gg_image_free(&work);
+    return err;
+}
+
+static int run_shared_job(int fd, char *fields, int *passed_fd) {
+    char *field[5];
+    int count = 0;
+    for (char *next = fields; count < 5; count++) {
+        field[count] = next;
+        next = strchr(next, '\t');
+        if (next == NULL) {
+            count++;
+            break;
+        }
+        *next++ = '\0';
+    }
+
+    int width, height, channels;
+    if (count != 5 || strchr(field[4], '\t') != NULL || parse_size(field[2], &width) != 0 ||
+        parse_size(field[3], &height) != 0 || parse_size(field[4], &channels) != 0 || channels > 4) {
+        return reply(fd, "error", "expected shm<TAB>stages<TAB>segment<TAB>width<TAB>height<TAB>channels");
+    }
+
+    pipeline p;
+    if (parse_pipeline(field[0], &p) != 0) {
+        return reply(fd, "error", "invalid pipeline");
+    }
+
+    // "-" is the descriptor sent with the request, anything else a POSIX
+    // shared-memory name
+    int segment = -1;
+    if (strcmp(field[1], "-") == 0) {
+        segment = *passed_fd;
+        *passed_fd = -1;
+    } else if (field[1][0] == '/') {
+        segment = shm_open(field[1], O_RDWR, 0);
+    }
+    if (segment < 0) {
+        return reply(fd, "error", "no shared memory segment");
+    }
+
+    struct stat segment_stat;
+    size_t needed = (size_t)width * height * channels;
+    if ((size_t)width > SIZE_MAX / (size_t)height / (size_t)channels || fstat(segment, &segment_stat) != 0 ||
+        segment_stat.st_size <= 0 || (size_t)segment_stat.st_size < needed) {
+        close(segment);
+        return reply(fd, "error", "segment smaller than the image");
+    }
+    size_t capacity = (size_t)segment_stat.st_size;
+    unsigned char *pixels = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0);
+    close(segment);
+    if (pixels == MAP_FAILED) {
+        return reply(fd, "error", "could not map the segment");
+    }
+
+    int err = run_mapped(&p, pixels, capacity, &width, &height, channels);
+    munmap(pixels, capacity);
+    if (err != GG_OK) {
+        return reply(fd, "error", gg_strerror(err));
+    }
+
+    char size[64];
+    snprintf(size, sizeof(size), "%d %d %d", width, height, channels);
+    return reply(fd, "ok", size);
+}
+
+// Returns 1 with the next line (newline removed) in line, 0 at end of input
+// and -1 if a line does not fit in SERVER_MAX_LINE
+static int read_line(struct line_reader *reader, char *line) {
+    for (;;) {
+        char *newline = memchr(reader->buffer, '\n', reader->length);
+        if (newline != NULL) {
+            size_t used = (size_t)(newline - reader->buffer) + 1;
+            memcpy(line, reader->buffer, used - 1);
+            line[used - 1] = '\0';
+            reader->length -= used;
+            memmove(reader->buffer, newline + 1, reader->length);
+            return 1;
+        }
+        if (reader->length == sizeof(reader->buffer)) {
+            return -1;
+        }
+
+        union {
+            struct cmsghdr header;
+            char space[CMSG_SPACE(sizeof(int) * 4)];
+        } control;
+        struct iovec iov = {reader->buffer + reader->length, sizeof(reader->buffer) - reader->length};
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.space;
+        message.msg_controllen = sizeof(control.space);
+
+        ssize_t received = recvmsg(reader->fd, &message, MSG_CMSG_CLOEXEC);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); received >= 0 && cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            // Keep the first descriptor of the message, close any others
+            int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int i = 0; i < count; i++) {
+                int passed;
+                memcpy(&passed, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (i == 0) {
+                    if (reader->passed_fd >= 0) {
+                        close(reader->passed_fd);
+                    }
+                    reader->passed_fd = passed;
+                } else {
+                    close(passed);
+                }
+            }
+        }
+        if (received <= 0) {
+            return 0;
+        }
+        reader->length += (size_t)received;
+    }
+}
+
+static void stop_server(struct server *server) {
+    pthread_mutex_lock(&server->mutex);
+    if (!server->stopping) {
+        server->stopping = 1;
+        // Wakes the accept loop
+        shutdown(server->listen_fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&server->mutex);
+}
+
+static void *connection_main(void *arg) {
+    struct connection *connection = arg;
+    struct server *server = connection->server;
+    int fd = connection->fd;
+    free(connection);
+
+    struct line_reader *reader = malloc(sizeof(*reader));
+    char line[SERVER_MAX_LINE];
+    int status = 0;
+    if (reader != NULL) {
+        reader->fd = fd;
+        reader->passed_fd = -1;
+        reader->length = 0;
+    }
+    while (reader != NULL && (status = read_line(reader, line)) > 0) {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+
+        int failed;
+        if (strncmp(line, "run\t", 4) == 0) {
+            failed = run_job(server, fd, line + 4);
+        } else if (strncmp(line, "shm\t", 4) == 0) {
+            failed = run_shared_job(fd, line + 4, &reader->passed_fd);
+        } else if (strcmp(line, "ping") == 0) {
+            failed = reply(fd, "ok", NULL);
+        } else if (strcmp(line, "stop") == 0) {
+            stop_server(server);
+            failed = reply(fd, "ok", NULL);
+        } else {
+            failed = reply(fd, "error", "unknown request");
+        }
+        // A descriptor belongs to the request it came with
+        if (reader->passed_fd >= 0) {
+            close(reader->passed_fd);
+            reader->passed_fd = -1;
+        }
+        fflush(stdout);
+        if (failed) {
+            break;
+        }
+    }
+    if (status < 0) {
+        reply(fd, "error", "request too long");
+    }
+    if (reader != NULL && reader->passed_fd >= 0) {
+        close(reader->passed_fd);
+    }
+    free(reader);
+    close(fd);
+
+    pthread_mutex_lock(&server->mutex);
+    if (--server->connections == 0) {
+        pthread_cond_signal(&server->idle);
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return NULL;
+}
+
+int serve_jobs(const char *socket_path, const char *base_dir, const char *default_output) {
+    struct sockaddr_un address;
+    if (fill_address(socket_path, &address) != 0) {
+        return 1;
+    }
+
+    // A socket file left behind by a server that is gone is replaced; a live
+    // server is not
+    struct stat socket_stat;
+    if (lstat(socket_path, &socket_stat) == 0) {
+        int fd = S_ISSOCK(socket_stat.st_mode) ? connect_socket(socket_path) : -1;
+        if (!S_ISSOCK(socket_stat.st_mode) || fd >= 0) {
+            printf("Error: %s is already in use.\n", socket_path);
+            if (fd >= 0) {
+                close(fd);
+            }
+            return 1;
+        }
+        unlink(socket_path);
+    }
+
+    struct server server;
+    server.base_dir = base_dir;
+    server.default_output = default_output;
+    server.connections = 0;
+    server.stopping = 0;
+    pthread_mutex_init(&server.mutex, NULL);
+    pthread_cond_init(&server.idle, NULL);
+
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listen_fd < 0 || bind(server.listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server.listen_fd, SOMAXCONN) != 0) {
+        printf("Error: Could not listen on %s: %s.\n", socket_path, strerror(errno));
+        if (server.listen_fd >= 0) {
+            close(server.listen_fd);
+        }
+        return 1;
+    }
+
+    // Clients that hang up early must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    gg_set_buffer_cache(SERVER_BUFFER_CACHE_BYTES);
+    printf("Serving on %s\n", socket_path);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(server.listen_fd, NULL, NULL);
+        pthread_mutex_lock(&server.mutex);
+        int stopping = server.stopping;
+        pthread_mutex_unlock(&server.mutex);
+        if (stopping) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            break;
+        }
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            printf("Error: accept failed: %s.\n", strerror(errno));
+            break;
+        }
+
+        struct connection *connection = malloc(sizeof(*connection));
+        pthread_t thread;
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+        pthread_mutex_lock(&server.mutex);
+        server.connections++;
+        pthread_mutex_unlock(&server.mutex);
+        if (connection != NULL) {
+            connection->server = &server;
+            connection->fd = fd;
+        }
+        if (connection == NULL || pthread_create(&thread, &attributes, connection_main, connection) != 0) {
+            reply(fd, "error", "server busy");
+            close(fd);
+            free(connection);
+            pthread_mutex_lock(&server.mutex);
+            server.connections--;
+            pthread_mutex_unlock(&server.mutex);
+        }
+        pthread_attr_destroy(&attributes);
+    }
+
+    // Let the jobs in progress finish before the process exits under them
+    pthread_mutex_lock(&server.mutex);
+    while (server.connections > 0) {
+        pthread_cond_wait(&server.idle, &server.mutex);
+    }
+    pthread_mutex_unlock(&server.mutex);
+
+    close(server.listen_fd);
+    unlink(socket_path);
+    gg_set_buffer_cache(0);
+    printf("Server on %s stopped\n", socket_path);
+    return 0;
+}
+
+// Send one request, with passed_fd attached when it is not -1, and read the
+// reply line into reply_line. Returns 0 once a reply has been read.
+static int exchange(const char *socket_path, const char *request, int passed_fd, char *reply_line) {
+    if (strchr(request, '\n') != NULL || strlen(request) + 1 >= SERVER_MAX_LINE) {
+        printf("Error: Request must be a single line shorter than %d bytes.\n", SERVER_MAX_LINE);
+        return 1;
+    }
+
+    int fd = connect_socket(socket_path);
+    if (fd < 0) {
+        printf("Error: No server is listening on %s.\n", socket_path);
+        return 1;
+    }
+
+    char line[SERVER_MAX_LINE];
+    snprintf(line, sizeof(line), "%s\n", request);
+    size_t length = strlen(line);
+    size_t sent = 0;
+    if (passed_fd >= 0) {
+        // The descriptor travels with the first bytes of the request
+        union {
+            struct cmsghdr header;
+            char space[CMSG_SPACE(sizeof(int))];
+        } control;
+        memset(&control, 0, sizeof(control));
+        struct iovec iov = {line, length};
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.space;
+        message.msg_controllen = sizeof(control.space);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+        ssize_t written;
+        do {
+            written = sendmsg(fd, &message, MSG_NOSIGNAL);
+        } while (written < 0 && errno == EINTR);
+        sent = written > 0 ? (size_t)written : length + 1;
+    }
+
+    FILE *in = NULL;
+    int result = 1;
+    if (sent <= length && send_all(fd, line + sent, length - sent) == 0 && (in = fdopen(fd, "r")) != NULL &&
+        fgets(reply_line, SERVER_MAX_LINE, in) != NULL) {
+        result = 0;
+    } else {
+        printf("Error: No reply from the server on %s.\n", socket_path);
+    }
+
+    if (in != NULL) {
+        fclose(in);
+    } else {
+        close(fd);
+    }
+    return result;
+}
+
+int submit_request(const char *socket_path, const char *request) {
+    char line[SERVER_MAX_LINE];
+    if (exchange(socket_path, request, -1, line) != 0) {
+        return 1;
+    }
+    printf("%s", line);
+    return strncmp(line, "ok", 2) == 0 && (line[2] == '\n' || line[2] == ' ') ? 0 : 1;
+}
+
+int submit_shared(const char *socket_path, const char *stages, int fd, int *width, int *height, int channels) {
+    if (strpbrk(stages, "\t\n") != NULL) {
+        printf("Error: Stages may not contain tabs or newlines.\n");
+        return 1;
+    }
+
+    char request[SERVER_MAX_LINE];
+    if (snprintf(request, sizeof(request), "shm\t%s\t-\t%d\t%d\t%d", stages, *width, *height, channels) >=
+        (int)sizeof(request)) {
+        printf("Error: Request too long.\n");
+        return 1;
+    }
+
+    char line[SERVER_MAX_LINE];
+    if (exchange(socket_path, request, fd, line) != 0) {
+        return 1;
+    }
+    int new_width, new_height, new_channels;
+    if (sscanf(line, "ok %d %d %d", &new_width, &new_height, &new_channels) != 3) {
+        printf("%s", line);
+        return 1;
+    }
+    *width = new_width;
+    *height = new_height;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Longest request or reply line, newline included
+#define SERVER_MAX_LINE 4096
+// Freed pixel buffers the server keeps for the next jobs to reuse
+#define SERVER_BUFFER_CACHE_BYTES ((size_t)256 << 20)
+
+// Serve jobs on a UNIX domain socket until a client asks the server to stop.
+// Each connection sends one request per line and gets one reply line back:
+//   run\t<stages>\t<input>\t<output>  ->  ok <output path> | error <reason>
+//   shm\t<stages>\t<segment>\t<width>\t<height>\t<channels>
+//                                     ->  ok <width> <height> <channels> | error <reason>
+//   ping                              ->  ok
+//   stop                              ->  ok, then the server exits once the
+//                                         jobs in progress have finished
+// Stages use the --pipeline syntax. Relative paths are resolved against
+// base_dir and an empty output means default_output. Connections are served
+// concurrently; the process, thread pool, configuration and pixel buffers stay
+// warm between jobs. Returns nonzero if the socket could not be set up.
+//
+// shm jobs run on contiguous 8-bit pixels in a shared-memory segment without
+// touching the filesystem: segment is a POSIX shm_open name, or "-" for a
+// memfd (or any mappable descriptor) sent with the request as SCM_RIGHTS.
+// Pipelines that keep the size run directly on the mapping; rotations and
+// pixelation write their result back to the start of the segment, which must
+// be large enough for it, and the reply gives the new size.
+int serve_jobs(const char *socket_path, const char *base_dir, const char *default_output);
+
+// Send one request line (without the newline) to a server and print the
+// reply. Returns 0 if the reply was "ok".
+int submit_request(const char *socket_path, const char *request);
+
+// Run stages on width x height x channels pixels at the start of the
+// shared-memory descriptor fd through a server, in place. On success width and
+// height hold the size of the result. Returns 0 on success.
+int submit_shared(const char *socket_path, const char *stages, int fd, int *width, int *height, int channels);
+
+#endif
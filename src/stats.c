@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+#define STATS_MAX_NAME 48
+#define STATS_MAX_STAGES 64
+
+// Sum of every stage recorded under one name
+typedef struct {
+    char name[STATS_MAX_NAME];
+    long count;
+    double wall;
+    double cpu;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    long peak_rss_kb;
+} stage_total;
+
+// One stage as it appears in the trace
+typedef struct {
+    char name[STATS_MAX_NAME];
+    double start;
+    double wall;
+    double cpu;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    long peak_rss_kb;
+    int thread;
+} trace_event;
+
+static int report_mode = STATS_OFF;
+static int enabled = 0;
+static const char *trace_file = NULL;
+static double start_wall;
+static double start_cpu;
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stage_total totals[STATS_MAX_STAGES];
+static int total_count = 0;
+static trace_event *events = NULL;
+static size_t event_count = 0;
+static size_t event_capacity = 0;
+static int events_dropped = 0;
+
+static __thread int thread_number = 0;
+static int threads_seen = 0;
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+static void print_table(double wall, double cpu, long rss) {
+    fprintf(stderr, "%-28s %7s %11s %11s %11s %11s %12s\n", "Stage", "Count", "Wall ms", "CPU ms", "Read MB",
+            "Written MB", "Peak RSS MB");
+    for (int i = 0; i < total_count; i++) {
+        const stage_total *t = &totals[i];
+        fprintf(stderr, "%-28s %7ld %11.2f %11.2f %11.2f %11.2f %12.1f\n", t->name, t->count, t->wall * 1e3,
+                t->cpu * 1e3, (double)t->bytes_read / (1 << 20), (double)t->bytes_written / (1 << 20),
+                (double)t->peak_rss_kb / 1024);
+    }
+    fprintf(stderr, "Total: %.2f ms wall, %.2f ms CPU, peak RSS %.1f MB\n", wall * 1e3, cpu * 1e3,
+            (double)rss / 1024);
+}
+
+static void print_json(double wall, double cpu, long rss) {
+    fprintf(stderr, "{\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"peak_rss_kb\": %ld, \"stages\": [", wall * 1e3,
+            cpu * 1e3, rss);
+    for (int i = 0; i < total_count; i++) {
+        const stage_total *t = &totals[i];
+        fprintf(stderr,
+                "%s\n  {\"name\": \"%s\", \"count\": %ld, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                "\"bytes_read\": %llu, \"bytes_written\": %llu, \"peak_rss_kb\": %ld}",
+                i > 0 ? "," : "", t->name, t->count, t->wall * 1e3, t->cpu * 1e3, t->bytes_read,
+                t->bytes_written, t->peak_rss_kb);
+    }
+    fprintf(stderr, "\n]}\n");
+}
+
+static void write_trace(void) {
+    FILE *out = fopen(trace_file, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: Could not write the trace to %s.\n", trace_file);
+        return;
+    }
+
+    int pid = (int)getpid();
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (size_t i = 0; i < event_count; i++) {
+        const trace_event *e = &events[i];
+        fprintf(out,
+                "%s\n{\"name\": \"%s\", \"cat\": \"ggpicture\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                "\"pid\": %d, \"tid\": %d, \"args\": {\"cpu_ms\": %.3f, \"bytes_read\": %llu, "
+                "\"bytes_written\": %llu, \"peak_rss_kb\": %ld}}",
+                i > 0 ? "," : "", e->name, e->start * 1e6, e->wall * 1e6, pid, e->thread, e->cpu * 1e3,
+                e->bytes_read, e->bytes_written, e->peak_rss_kb);
+    }
+    fprintf(out, "\n]}\n");
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error: Could not write the trace to %s.\n", trace_file);
+    }
+}
+
+static void write_report(void) {
+    pthread_mutex_lock(&stats_mutex);
+    double wall = clock_seconds(CLOCK_MONOTONIC) - start_wall;
+    double cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - start_cpu;
+    long rss = peak_rss_kb();
+
+    fflush(stdout);
+    if (report_mode == STATS_TABLE) {
+        print_table(wall, cpu, rss);
+    } else if (report_mode == STATS_JSON) {
+        print_json(wall, cpu, rss);
+    }
+    if (trace_file != NULL) {
+        if (events_dropped) {
+            fprintf(stderr, "Warning: Out of memory for trace events; the trace is incomplete.\n");
+        }
+        write_trace();
+    }
+    free(events);
+    events = NULL;
+    event_count = event_capacity = 0;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void stats_enable(int report, const char *trace_path) {
+    report_mode = report;
+    trace_file = trace_path;
+    enabled = report != STATS_OFF || trace_path != NULL;
+    if (enabled) {
+        start_wall = clock_seconds(CLOCK_MONOTONIC);
+        start_cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+        atexit(write_report);
+    }
+}
+
+void stats_begin(stats_span *span) {
+    if (!enabled) {
+        return;
+    }
+    span->wall = clock_seconds(CLOCK_MONOTONIC);
+    span->cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_end(const stats_span *span, const char *name, size_t bytes_read, size_t bytes_written) {
+    if (!enabled) {
+        return;
+    }
+    // CPU time is the whole process's, so stages that overlap (as in --batch)
+    // each include the others'
+    double wall = clock_seconds(CLOCK_MONOTONIC) - span->wall;
+    double cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - span->cpu;
+    long rss = peak_rss_kb();
+    if (thread_number == 0) {
+        thread_number = __atomic_add_fetch(&threads_seen, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    int i = 0;
+    while (i < total_count && strcmp(totals[i].name, name) != 0) {
+        i++;
+    }
+    if (i == total_count && total_count < STATS_MAX_STAGES) {
+        memset(&totals[i], 0, sizeof(totals[i]));
+        snprintf(totals[i].name, sizeof(totals[i].name), "%s", name);
+        total_count++;
+    }
+    if (i < total_count) {
+        stage_total *t = &totals[i];
+        t->count++;
+        t->wall += wall;
+        t->cpu += cpu;
+        t->bytes_read += bytes_read;
+        t->bytes_written += bytes_written;
+        t->peak_rss_kb = rss > t->peak_rss_kb ? rss : t->peak_rss_kb;
+    }
+
+    if (trace_file != NULL && event_count == event_capacity) {
+        size_t capacity = event_capacity > 0 ? event_capacity * 2 : 256;
+        trace_event *grown = realloc(events, capacity * sizeof(*events));
+        if (grown != NULL) {
+            events = grown;
+            event_capacity = capacity;
+        } else {
+            events_dropped = 1;
+        }
+    }
+    if (trace_file != NULL && event_count < event_capacity) {
+        trace_event *e = &events[event_count++];
+        snprintf(e->name, sizeof(e->name), "%s", name);
+        e->start = span->wall - start_wall;
+        e->wall = wall;
+        e->cpu = cpu;
+        e->bytes_read = bytes_read;
+        e->bytes_written = bytes_written;
+        e->peak_rss_kb = rss;
+        e->thread = thread_number;
+    }
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+struct step_timer {
+    stats_span span;
+    size_t bytes_read;
+};
+
+static size_t image_bytes(const gg_image *img) {
+    return (size_t)img->width * img->height * img->channels;
+}
+
+static void step_before(void *ctx, const pipeline *p, int first, int last, const gg_image *img) {
+    struct step_timer *timer = ctx;
+    (void)p;
+    (void)first;
+    (void)last;
+    timer->bytes_read = image_bytes(img);
+    stats_begin(&timer->span);
+}
+
+// Folded point stages are named together, e.g. "setbright+setcontr"
+static void step_after(void *ctx, const pipeline *p, int first, int last, const gg_image *img) {
+    struct step_timer *timer = ctx;
+    char name[STATS_MAX_NAME] = "";
+    for (int i = first; i <= last; i++) {
+        size_t used = strlen(name);
+        snprintf(name + used, sizeof(name) - used, "%s%s", i > first ? "+" : "", pipeline_stage_name(&p->stages[i]));
+    }
+    stats_end(&timer->span, name, timer->bytes_read, image_bytes(img));
+}
+
+int stats_run_pipeline(const pipeline *p, gg_image *img) {
+    if (!enabled) {
+        return run_pipeline(p, img);
+    }
+    struct step_timer timer;
+    pipeline_observer observer = {step_before, step_after, &timer};
+    return run_pipeline_observed(p, img, &observer);
+}
@@ -0,0 +1,33 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include "ggpicture.h"
+#include "pipeline.h"
+
+#define STATS_OFF 0
+#define STATS_TABLE 1
+#define STATS_JSON 2
+
+// Start of a timed stage
+typedef struct {
+    double wall;
+    double cpu;
+} stats_span;
+
+// Record decode, filter and encode stages from now on. report is STATS_TABLE
+// or STATS_JSON for a per-stage summary on stderr at exit (STATS_OFF for
+// none); a non-NULL trace_path also writes every stage as a Chrome
+// trace-event file at exit.
+void stats_enable(int report, const char *trace_path);
+
+// Time a stage: wall and process CPU time between the two calls, bytes it
+// read and wrote, and the peak resident set size at its end. Stages with the
+// same name are summed in the report. Cheap no-ops while stats are off.
+void stats_begin(stats_span *span);
+void stats_end(const stats_span *span, const char *name, size_t bytes_read, size_t bytes_written);
+
+// run_pipeline recording a stage per step while stats are on
+int stats_run_pipeline(const pipeline *p, gg_image *img);
+
+#endif
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include "bmp.h"
+#include "stats.h"
+
+// The stages before a pixelation are split at every flip into segments that
+// run on the band in place; between two segments the band is turned by 180
+// degrees. A vertical mirror is a flip followed by a horizontal mirror.
+// halos[s] is the number of rows segment s reads above and below a row.
+typedef struct {
+    pipeline segments[MAX_PIPELINE_STAGES + 1];
+    int halos[MAX_PIPELINE_STAGES + 1];
+    int segment_count;
+    int halo;
+    int pixel_size; // 0 without a pixelation
+    pipeline after; // color stages after the pixelation
+} stream_plan;
+
+// Stages whose output rows each depend only on the same input row
+static int is_row_stage(const pipeline_stage *stage) {
+    if (stage->type == STAGE_MIRROR) {
+        return stage->value == GG_MIRROR_HORIZONTAL;
+    }
+    return stage->type != STAGE_ROTATE && stage->type != STAGE_ROTATE_ANGLE && stage->type != STAGE_PIXELATE &&
+           stage->type != STAGE_BLUR;
+}
+
+static int plan_stream(const pipeline *p, stream_plan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->segment_count = 1;
+
+    for (int i = 0; i < p->count; i++) {
+        const pipeline_stage *stage = &p->stages[i];
+        if (plan->pixel_size > 0) {
+            if (!is_row_stage(stage)) {
+                printf("Error: Only color stages and mirror:h can follow makepixel when streaming.\n");
+                return 1;
+            }
+            plan->after.stages[plan->after.count++] = *stage;
+            continue;
+        }
+
+        if (stage->type == STAGE_ROTATE) {
+            if (stage->value != GG_ROTATE_FLIP) {
+                printf("Error: rotate:r and rotate:l need the whole image and cannot be streamed.\n");
+                return 1;
+            }
+            plan->segment_count++;
+            continue;
+        }
+        if (stage->type == STAGE_ROTATE_ANGLE) {
+            printf("Error: Rotations by an angle need the whole image and cannot be streamed.\n");
+            return 1;
+        }
+        if (stage->type == STAGE_MIRROR && stage->value == GG_MIRROR_VERTICAL) {
+            pipeline *segment = &plan->segments[plan->segment_count++];
+            segment->stages[segment->count++] = *stage;
+            segment->stages[segment->count - 1].value = GG_MIRROR_HORIZONTAL;
+            continue;
+        }
+        if (stage->type == STAGE_PIXELATE) {
+            plan->pixel_size = stage->value;
+            continue;
+        }
+
+        pipeline *segment = &plan->segments[plan->segment_count - 1];
+        if (stage->type == STAGE_BLUR) {
+            int halo = gg_blur_halo(stage->value, stage->mode);
+            plan->halos[plan->segment_count - 1] += halo;
+            plan->halo += halo;
+        }
+        segment->stages[segment->count++] = *stage;
+    }
+    return 0;
+}
+
+// Turn [*lo, *hi) into the same rows counted from the other end
+static void flip_interval(int height, int *lo, int *hi) {
+    int flipped_lo = height - *hi;
+    *hi = height - *lo;
+    *lo = flipped_lo;
+}
+
+int stream_pipeline(const char *file_name, const pipeline *p, const char *output_file_name, size_t band_bytes,
+                    int write_flags) {
+    stream_plan plan;
+    if (plan_stream(p, &plan) != 0) {
+        return 1;
+    }
+
+    // The output is created at full size before the first band is read
+    if (bmp_same_file(file_name, output_file_name)) {
+        printf("Error: Cannot stream %s into itself; choose another output file.\n", file_name);
+        return 1;
+    }
+
+    bmp_reader reader;
+    if (bmp_reader_open(file_name, &reader) != 0) {
+        printf("Error: Could not stream %s; only uncompressed 24-bit BMP files can be streamed.\n", file_name);
+        return 1;
+    }
+
+    int width = reader.width;
+    int height = reader.height;
+    int out_width = width, out_height = height;
+    int step = 1;
+    if (plan.pixel_size > 0) {
+        gg_image shape = {width, height, 3, 0, NULL};
+        int err = gg_pixelated_size(&shape, plan.pixel_size, &out_width, &out_height);
+        if (err != GG_OK) {
+            printf("Error: Could not pixelate the image: %s.\n", gg_strerror(err));
+            bmp_reader_close(&reader);
+            return 1;
+        }
+        // Bands hold whole rows of blocks
+        step = plan.pixel_size;
+    }
+
+    // The band budget covers the output rows and the halo on both sides
+    size_t row_size = reader.row_size;
+    long budget_rows = (long)(band_bytes / row_size) - 2L * plan.halo;
+    int band_rows = budget_rows < step ? step : (budget_rows > out_height ? out_height : (int)budget_rows);
+    band_rows -= band_rows % step;
+    int max_rows = band_rows + 2 * plan.halo < height ? band_rows + 2 * plan.halo : height;
+
+    unsigned char *buffer = malloc((size_t)max_rows * row_size);
+    gg_image pixelated = {0, 0, 0, 0, NULL};
+    if (buffer == NULL || (plan.pixel_size > 0 && gg_image_create(&pixelated, out_width, band_rows, 3) != GG_OK)) {
+        printf("Error: Memory allocation failed.\n");
+        free(buffer);
+        bmp_reader_close(&reader);
+        return 1;
+    }
+
+    bmp_writer writer;
+    if (bmp_writer_open(output_file_name, out_width, out_height, 3, write_flags, &writer) != 0) {
+        printf("Error: Could not save the processed image to %s.\n", output_file_name);
+        free(buffer);
+        gg_image_free(&pixelated);
+        bmp_reader_close(&reader);
+        return 1;
+    }
+
+    int result = 0;
+    int bands = 0;
+    for (int first = 0; first < out_height && result == 0; first += band_rows, bands++) {
+        int last = first + band_rows < out_height ? first + band_rows : out_height;
+
+        // Walk back through the segments to the source rows this band depends on
+        int lo = first, hi = last;
+        for (int s = plan.segment_count - 1; s >= 0; s--) {
+            lo = lo - plan.halos[s] > 0 ? lo - plan.halos[s] : 0;
+            hi = hi + plan.halos[s] < height ? hi + plan.halos[s] : height;
+            if (s > 0) {
+                flip_interval(height, &lo, &hi);
+            }
+        }
+
+        gg_image band;
+        stats_span span;
+        stats_begin(&span);
+        if (bmp_read_rows(&reader, lo, hi - lo, buffer, &band) != 0) {
+            printf("Error: Could not read rows %d to %d of %s.\n", lo, hi - 1, file_name);
+            result = 1;
+            break;
+        }
+        stats_end(&span, "decode", (size_t)(hi - lo) * row_size, (size_t)(hi - lo) * row_size);
+
+        // Rows within a segment's halo of a band edge inside the image come out
+        // wrong, but every row a later stage or the output reads is exact
+        int err = GG_OK;
+        for (int s = 0; s < plan.segment_count && err == GG_OK; s++) {
+            if (s > 0) {
+                stats_begin(&span);
+                err = gg_mirror(&band, GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL);
+                stats_end(&span, "rotate", (size_t)(hi - lo) * row_size, (size_t)(hi - lo) * row_size);
+                flip_interval(height, &lo, &hi);
+            }
+            if (err == GG_OK && plan.segments[s].count > 0) {
+                err = stats_run_pipeline(&plan.segments[s], &band);
+            }
+        }
+
+        gg_image rows;
+        gg_image_wrap(&rows, band.pixels + (ptrdiff_t)(first - lo) * band.stride, width, last - first, 3, band.stride);
+        if (err == GG_OK && plan.pixel_size > 0) {
+            gg_image blocks;
+            gg_image_wrap(&blocks, pixelated.pixels, out_width, last - first, 3, pixelated.stride);
+            stats_begin(&span);
+            err = gg_pixelate(&rows, &blocks, plan.pixel_size);
+            stats_end(&span, "makepixel", (size_t)(last - first) * row_size, (size_t)out_width * blocks.height * 3);
+            if (err == GG_OK && plan.after.count > 0) {
+                err = stats_run_pipeline(&plan.after, &blocks);
+            }
+            rows = blocks;
+        }
+        if (err != GG_OK) {
+            printf("Error: %s.\n", gg_strerror(err));
+            result = 1;
+            break;
+        }
+
+        stats_begin(&span);
+        if (bmp_write_rows(&writer, first, &rows) != 0) {
+            printf("Error: Could not save the processed image to %s.\n", output_file_name);
+            result = 1;
+        }
+        stats_end(&span, "encode", (size_t)rows.width * rows.height * 3, (size_t)rows.width * rows.height * 3);
+    }
+
+    if (bmp_writer_close(&writer) != 0 && result == 0) {
+        printf("Error: Could not save the processed image to %s.\n", output_file_name);
+        result = 1;
+    }
+    free(buffer);
+    gg_image_free(&pixelated);
+    bmp_reader_close(&reader);
+
+    if (result == 0) {
+        printf("Streamed image saved to %s (%d bands of up to %d rows)\n", output_file_name, bands, band_rows);
+    }
+    return result;
+}
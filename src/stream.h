@@ -0,0 +1,19 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include "pipeline.h"
+
+#define STREAM_DEFAULT_BAND_MB 64
+
+// Run a pipeline on an uncompressed 24-bit BMP one band of rows at a time, so
+// memory use follows band_bytes rather than the image size. Each band is read
+// together with the halo rows its blur stages need, and the output is byte for
+// byte what run_pipeline and bmp_write give for the whole image. Left and right
+// rotations need the whole image and are rejected, as is anything but color
+// stages and horizontal mirrors after a pixelation. Flips and vertical mirrors
+// turn each band in place. write_flags are passed to the BMP writer.
+int stream_pipeline(const char *file_name, const pipeline *p, const char *output_file_name, size_t band_bytes,
+                    int write_flags);
+
+#endif
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "ggpicture_internal.h"
+
+// A fixed set of workers that sleep on a condition variable between jobs. One
+// job runs at a time: its range is handed out in chunks through an atomic
+// counter, and the submitting thread works on it too.
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+// Held for the whole lifetime of a job so jobs never overlap
+static pthread_mutex_t submit_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t *workers;
+static int worker_count;
+static int requested_threads; // 0 means one per available CPU
+static int shutting_down;
+static unsigned long generation;
+static int busy_workers;
+
+static gg_range_fn job_fn;
+static void *job_ctx;
+static int job_count;
+static int job_chunk;
+static int job_next;
+
+// Set in pool workers and in a thread that is running a job, so nested
+// parallel loops run inline instead of waiting on themselves
+static __thread int inside_pool;
+
+static void run_chunks(void) {
+    for (;;) {
+        int start = __atomic_fetch_add(&job_next, job_chunk, __ATOMIC_RELAXED);
+        if (start >= job_count) {
+            break;
+        }
+        int end = start + job_chunk < job_count ? start + job_chunk : job_count;
+        job_fn(job_ctx, start, end);
+    }
+}
+
+static void *worker_main(void *arg) {
+    unsigned long seen = 0;
+    (void)arg;
+
+    inside_pool = 1;
+    pthread_mutex_lock(&pool_mutex);
+    for (;;) {
+        while (generation == seen && !shutting_down) {
+            pthread_cond_wait(&pool_wake, &pool_mutex);
+        }
+        if (shutting_down) {
+            break;
+        }
+        seen = generation;
+        pthread_mutex_unlock(&pool_mutex);
+
+        run_chunks();
+
+        pthread_mutex_lock(&pool_mutex);
+        if (--busy_workers == 0) {
+            pthread_cond_signal(&pool_done);
+        }
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+static void stop_workers(void) {
+    pthread_mutex_lock(&pool_mutex);
+    shutting_down = 1;
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    shutting_down = 0;
+}
+
+// Start count workers unless they are already running. On failure the pool
+// keeps whatever it managed to start; fewer workers only means less speedup.
+static void start_workers(int count) {
+    if (worker_count == count) {
+        return;
+    }
+    if (worker_count > 0) {
+        stop_workers();
+    }
+
+    workers = malloc(count * sizeof(*workers));
+    if (workers == NULL) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&workers[worker_count], NULL, worker_main, NULL) != 0) {
+            break;
+        }
+        worker_count++;
+    }
+}
+
+static int available_cpus(void) {
+#ifdef CPU_COUNT
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        return CPU_COUNT(&set);
+    }
+#endif
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (int)online : 1;
+}
+
+void gg_set_threads(int threads) {
+    pthread_mutex_lock(&submit_mutex);
+    requested_threads = threads > 0 ? threads : 0;
+    if (worker_count > 0) {
+        stop_workers();
+    }
+    pthread_mutex_unlock(&submit_mutex);
+}
+
+int gg_threads(void) {
+    return requested_threads > 0 ? requested_threads : available_cpus();
+}
+
+void gg_parallel_for(int count, int grain, gg_range_fn fn, void *ctx) {
+    if (count <= 0) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+
+    int threads = gg_threads();
+    if (threads <= 1 || count <= grain || inside_pool || pthread_mutex_trylock(&submit_mutex) != 0) {
+        fn(ctx, 0, count);
+        return;
+    }
+
+    start_workers(threads - 1);
+    if (worker_count == 0) {
+        pthread_mutex_unlock(&submit_mutex);
+        fn(ctx, 0, count);
+        return;
+    }
+
+    // A few chunks per thread so uneven rows still balance out
+    int chunk = count / (threads * 4);
+    if (chunk < grain) {
+        chunk = grain;
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    job_fn = fn;
+    job_ctx = ctx;
+    job_count = count;
+    job_chunk = chunk;
+    job_next = 0;
+    busy_workers = worker_count;
+    generation++;
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_mutex);
+
+    inside_pool = 1;
+    run_chunks();
+    inside_pool = 0;
+
+    pthread_mutex_lock(&pool_mutex);
+    while (busy_workers > 0) {
+        pthread_cond_wait(&pool_done, &pool_mutex);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    pthread_mutex_unlock(&submit_mutex);
+}
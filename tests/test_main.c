@@ -2,9 +2,19 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "../src/stb_image.h"
 #include "../src/stb_image_write.h"
 #include "../src/image_processing.h"
+#include "../src/pipeline.h"
+#include "../src/batch.h"
+#include "../src/bmp.h"
+#include "../src/stream.h"
+#include "../src/server.h"
 
 #define TEST_WORKING_DIR "./tests/"
 #define TEST_OUTPUT_FILE "test.bmp"
@@ -277,10 +287,1399 @@ static void test_adjustment_commands() {
     }
 }
 
+static void test_pipeline() {
+    const char *chained_file = TEST_WORKING_DIR "chained.bmp";
 
+    // Four right rotations in one invocation give back the original image
+    int result = system("./build/ggpicture --pipeline \"rotate:r,rotate:r,rotate:r,rotate:r\" input.bmp");
+    assert(result == 0);
+    assert(compare_images(TEST_WORKING_DIR "input.bmp", TEST_WORKING_DIR TEST_OUTPUT_FILE));
+
+    // A single stage matches the standalone command
+    result = system("./build/ggpicture --pipeline setbright:-20 input.bmp");
+    assert(result == 0);
+    assert(compare_images(TEST_WORKING_DIR TEST_OUTPUT_FILE, "./tests/br_input.bmp"));
+
+    // A chain matches the same commands run one after another
+    result = system("./build/ggpicture --rotate -r input.bmp");
+    assert(result == 0);
+    remove(chained_file);
+    rename(TEST_WORKING_DIR TEST_OUTPUT_FILE, chained_file);
+    result = system("./build/ggpicture --makepixel 10 chained.bmp");
+    assert(result == 0);
+    remove(chained_file);
+    rename(TEST_WORKING_DIR TEST_OUTPUT_FILE, chained_file);
+
+    result = system("./build/ggpicture --pipeline \"rotate:r, makepixel:10\" input.bmp");
+    assert(result == 0);
+    assert(compare_images(chained_file, TEST_WORKING_DIR TEST_OUTPUT_FILE));
+
+    // Malformed specs are rejected
+    pipeline stages;
+    assert(parse_pipeline("rotate:x", &stages) != 0);
+    assert(parse_pipeline("blur:0", &stages) != 0);
+    assert(parse_pipeline("makebw,unknown", &stages) != 0);
+    assert(parse_pipeline("rotate:r,setbright:+10,blur:3", &stages) == 0);
+    assert(stages.count == 3);
+
+    printf("Test pipeline passed!\n");
+
+    remove(chained_file);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+}
+static void test_library_api() {
+    // A 5x3 RGB image stored with 4 bytes of padding per row
+    const int width = 5, height = 3, channels = 3, stride = 5 * 3 + 4;
+    unsigned char buffer[3 * (5 * 3 + 4)];
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (unsigned char)(i * 7);
+    }
+
+    gg_image padded;
+    gg_image_wrap(&padded, buffer, width, height, channels, stride);
+
+    // Four right rotations give back the original pixels
+    gg_image current, next;
+    int w, h;
+    assert(gg_rotated_size(&padded, GG_ROTATE_RIGHT, &w, &h) == GG_OK);
+    assert(w == height && h == width);
+    assert(gg_image_create(&current, w, h, channels) == GG_OK);
+    assert(gg_rotate(&padded, &current, GG_ROTATE_RIGHT) == GG_OK);
+    for (int i = 0; i < 3; i++) {
+        assert(gg_rotated_size(&current, GG_ROTATE_RIGHT, &w, &h) == GG_OK);
+        assert(gg_image_create(&next, w, h, channels) == GG_OK);
+        assert(gg_rotate(&current, &next, GG_ROTATE_RIGHT) == GG_OK);
+        gg_image_free(&current);
+        current = next;
+    }
+    for (int y = 0; y < height; y++) {
+        assert(memcmp(current.pixels + y * current.stride, buffer + y * stride, width * channels) == 0);
+    }
+    gg_image_free(&current);
+
+    // In-place kernels leave the row padding alone
+    assert(gg_brightness(&padded, 50) == GG_OK);
+    for (int y = 0; y < height; y++) {
+        for (int i = width * channels; i < stride; i++) {
+            assert(buffer[y * stride + i] == (unsigned char)((y * stride + i) * 7));
+        }
+    }
+
+    // Errors are reported through return codes
+    gg_image gray;
+    assert(gg_image_create(&gray, 4, 4, 1) == GG_OK);
+    assert(gg_black_and_white(&gray) == GG_ERR_CHANNELS);
+    assert(gg_rotate(&padded, &gray, GG_ROTATE_LEFT) == GG_ERR_SIZE);
+    gg_image_free(&gray);
+    assert(gg_image_create(&gray, 0, 4, 3) == GG_ERR_SIZE);
+
+    printf("Test library API passed!\n");
+}
+static void test_buffer_cache() {
+    gg_set_buffer_cache(16 << 20);
+
+    // A freed image buffer comes back for the next image of the same size
+    gg_image first, second, other;
+    assert(gg_image_create(&first, 512, 512, 3) == GG_OK);
+    unsigned char *pixels = first.pixels;
+    gg_image_free(&first);
+    assert(gg_image_create(&second, 512, 512, 3) == GG_OK);
+    assert(second.pixels == pixels);
+    assert(gg_image_create(&other, 512, 512, 3) == GG_OK);
+    assert(other.pixels != pixels);
+
+    // and for a somewhat smaller one, but not for one it would dwarf
+    gg_image_free(&second);
+    assert(gg_image_create(&second, 512, 400, 3) == GG_OK);
+    assert(second.pixels == pixels);
+    gg_image_free(&second);
+    assert(gg_image_create(&second, 256, 256, 3) == GG_OK);
+    assert(second.pixels != pixels);
+    gg_image_free(&second);
+    gg_image_free(&other);
+
+    // Cached blocks are plain malloc blocks in both directions
+    unsigned char *plain = malloc(1 << 20);
+    assert(plain != NULL);
+    gg_buffer_free(plain);
+    unsigned char *reused = gg_buffer_alloc(1 << 20);
+    assert(reused == plain);
+    memset(reused, 1, 1 << 20);
+    free(reused);
+
+    // Turning the cache off releases what it holds
+    gg_set_buffer_cache(0);
+    assert(gg_image_create(&first, 512, 512, 3) == GG_OK);
+    gg_image_free(&first);
+
+    printf("Test buffer cache passed!\n");
+}
+static void test_point_lut() {
+    const int width = 37, height = 5, channels = 3;
+    gg_image fused, reference;
+    assert(gg_image_create(&fused, width, height, channels) == GG_OK);
+    assert(gg_image_create(&reference, width, height, channels) == GG_OK);
+    for (int i = 0; i < width * height * channels; i++) {
+        fused.pixels[i] = reference.pixels[i] = (unsigned char)(i * 13 + 5);
+    }
+
+    // A fused chain gives exactly the same bytes as one pass per operation
+    pipeline stages;
+    assert(parse_pipeline("setbright:-20,setcontr:35,setbright:+25,setcontr:-10", &stages) == 0);
+    assert(run_pipeline(&stages, &fused) == GG_OK);
+
+    int percentages[] = {-20, 35, 25, -10};
+    for (int step = 0; step < 4; step++) {
+        for (int i = 0; i < width * height * channels; i++) {
+            int v = reference.pixels[i];
+            if (step % 2 == 0) {
+                v = v + (v * percentages[step] / 100);
+            } else {
+                v = 128 + (v - 128) * (1.0f + percentages[step] / 100.0f);
+            }
+            reference.pixels[i] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+    assert(memcmp(fused.pixels, reference.pixels, width * height * channels) == 0);
+
+    gg_lut lut;
+    gg_lut_identity(&lut);
+    assert(gg_lut_is_identity(&lut));
+    gg_lut_brightness(&lut, 0);
+    assert(gg_lut_is_identity(&lut));
+
+    gg_image_free(&fused);
+    gg_image_free(&reference);
+    printf("Test point LUT passed!\n");
+}
+static void test_tiled_rotation() {
+    // Odd sizes that leave partial tiles on both edges
+    const int width = 71, height = 45;
+    const int rotations[] = {GG_ROTATE_RIGHT, GG_ROTATE_LEFT, GG_ROTATE_FLIP};
+
+    for (int channels = 1; channels <= 4; channels++) {
+        gg_image src;
+        assert(gg_image_create(&src, width, height, channels) == GG_OK);
+        for (int i = 0; i < width * height * channels; i++) {
+            src.pixels[i] = (unsigned char)(i * 31 + i / 7);
+        }
+
+        for (size_t r = 0; r < sizeof(rotations) / sizeof(rotations[0]); r++) {
+            int w, h;
+            gg_image dst;
+            assert(gg_rotated_size(&src, rotations[r], &w, &h) == GG_OK);
+            assert(gg_image_create(&dst, w, h, channels) == GG_OK);
+            assert(gg_rotate(&src, &dst, rotations[r]) == GG_OK);
+
+            // Same index mapping as the original per-pixel loops
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int out;
+                    if (rotations[r] == GG_ROTATE_RIGHT) {
+                        out = x * height + (height - y - 1);
+                    } else if (rotations[r] == GG_ROTATE_LEFT) {
+                        out = (width - x - 1) * height + y;
+                    } else {
+                        out = (height - y - 1) * width + (width - x - 1);
+                    }
+                    assert(memcmp(dst.pixels + out * channels, src.pixels + (y * width + x) * channels, channels) == 0);
+                }
+            }
+            gg_image_free(&dst);
+        }
+        gg_image_free(&src);
+    }
+
+    printf("Test tiled rotation passed!\n");
+}
+
+static void test_mirror() {
+    // Widths around every register size, plus a padded and a bottom-up layout
+    const int widths[] = {1, 2, 15, 33, 64, 131};
+    const int axes[] = {GG_MIRROR_HORIZONTAL, GG_MIRROR_VERTICAL, GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL};
+
+    for (int channels = 1; channels <= 4; channels++) {
+        for (size_t wi = 0; wi < sizeof(widths) / sizeof(widths[0]); wi++) {
+            for (int height = 6; height <= 7; height++) {
+                int width = widths[wi];
+                ptrdiff_t stride = (ptrdiff_t)width * channels + 3;
+                unsigned char *original = malloc(stride * height);
+                unsigned char *buffer = malloc(stride * height);
+                assert(original != NULL && buffer != NULL);
+                for (ptrdiff_t i = 0; i < stride * height; i++) {
+                    original[i] = (unsigned char)(i * 53 + i / 11);
+                }
+
+                for (size_t a = 0; a < sizeof(axes) / sizeof(axes[0]); a++) {
+                    for (int isa = GG_ISA_SCALAR; isa <= GG_ISA_AVX512; isa++) {
+                        for (int bottom_up = 0; bottom_up <= 1; bottom_up++) {
+                            memcpy(buffer, original, stride * height);
+                            gg_image img;
+                            if (bottom_up) {
+                                gg_image_wrap(&img, buffer + (height - 1) * stride, width, height, channels, -stride);
+                            } else {
+                                gg_image_wrap(&img, buffer, width, height, channels, stride);
+                            }
+                            gg_set_max_isa(isa);
+                            assert(gg_mirror(&img, axes[a]) == GG_OK);
+
+                            // Pixels move to the mirrored position and row padding stays
+                            for (int y = 0; y < height; y++) {
+                                int row = bottom_up ? height - 1 - y : y;
+                                for (int x = 0; x < width; x++) {
+                                    int sx = axes[a] & GG_MIRROR_HORIZONTAL ? width - 1 - x : x;
+                                    int sy = axes[a] & GG_MIRROR_VERTICAL ? height - 1 - y : y;
+                                    int source_row = bottom_up ? height - 1 - sy : sy;
+                                    assert(memcmp(buffer + row * stride + x * channels,
+                                                  original + source_row * stride + sx * channels, channels) == 0);
+                                }
+                                assert(memcmp(buffer + row * stride + width * channels,
+                                              original + row * stride + width * channels, 3) == 0);
+                            }
+                        }
+                    }
+                }
+                gg_set_max_isa(-1);
+                free(original);
+                free(buffer);
+            }
+        }
+    }
+
+    gg_image img;
+    assert(gg_image_create(&img, 4, 4, 3) == GG_OK);
+    assert(gg_mirror(&img, 0) == GG_ERR_ARGUMENT);
+    assert(gg_mirror(&img, 4) == GG_ERR_ARGUMENT);
+    gg_image_free(&img);
+
+    pipeline stages;
+    assert(parse_pipeline("mirror:h,mirror:v", &stages) == 0);
+    assert(stages.stages[0].type == STAGE_MIRROR && stages.stages[0].value == GG_MIRROR_HORIZONTAL);
+    assert(stages.stages[1].type == STAGE_MIRROR && stages.stages[1].value == GG_MIRROR_VERTICAL);
+    assert(parse_pipeline("mirror", &stages) != 0);
+    assert(parse_pipeline("mirror:d", &stages) != 0);
+
+    // Both mirrors in a pipeline are a flip, done in place
+    gg_image flipped, mirrored;
+    assert(gg_image_create(&flipped, 29, 17, 3) == GG_OK);
+    assert(gg_image_create(&mirrored, 29, 17, 3) == GG_OK);
+    for (int i = 0; i < 29 * 17 * 3; i++) {
+        flipped.pixels[i] = mirrored.pixels[i] = (unsigned char)(i * 7 + i / 5);
+    }
+    unsigned char *pixels = mirrored.pixels;
+    assert(parse_pipeline("rotate:f", &stages) == 0);
+    assert(run_pipeline(&stages, &flipped) == GG_OK);
+    assert(parse_pipeline("mirror:v,mirror:h", &stages) == 0);
+    assert(run_pipeline(&stages, &mirrored) == GG_OK);
+    assert(mirrored.pixels == pixels);
+    assert(memcmp(flipped.pixels, mirrored.pixels, 29 * 17 * 3) == 0);
+    gg_image_free(&flipped);
+    gg_image_free(&mirrored);
+
+    printf("Test mirror passed!\n");
+}
+static void test_rotate_angle() {
+    const double angles[] = {7.5, -33, 100.25, 245};
+    const int bounds[] = {GG_BOUNDS_EXPAND, GG_BOUNDS_KEEP, GG_BOUNDS_INNER};
+    const unsigned char fill[4] = {10, 200, 30, 255};
+
+    // Every level gives the scalar bytes, top-down or bottom-up
+    for (int channels = 1; channels <= 4; channels++) {
+        const int width = 150, height = 91;
+        ptrdiff_t stride = (ptrdiff_t)width * channels + 5;
+        unsigned char *buffer = malloc(stride * height);
+        assert(buffer != NULL);
+        for (ptrdiff_t i = 0; i < stride * height; i++) {
+            buffer[i] = (unsigned char)(i * 29 + i / 13);
+        }
+
+        for (size_t a = 0; a < sizeof(angles) / sizeof(angles[0]); a++) {
+            for (int interp = GG_INTERP_BILINEAR; interp <= GG_INTERP_BICUBIC; interp++) {
+                for (int bottom_up = 0; bottom_up <= 1; bottom_up++) {
+                    gg_image src;
+                    if (bottom_up) {
+                        gg_image_wrap(&src, buffer + (height - 1) * stride, width, height, channels, -stride);
+                    } else {
+                        gg_image_wrap(&src, buffer, width, height, channels, stride);
+                    }
+                    int w, h;
+                    gg_image reference;
+                    assert(gg_angle_rotated_size(&src, angles[a], bounds[a % 3], &w, &h) == GG_OK);
+                    assert(gg_image_create(&reference, w, h, channels) == GG_OK);
+                    gg_set_max_isa(GG_ISA_SCALAR);
+                    assert(gg_rotate_angle(&src, &reference, angles[a], interp, fill) == GG_OK);
+
+                    for (int isa = GG_ISA_SSE2; isa <= GG_ISA_AVX512; isa++) {
+                        gg_image dst;
+                        assert(gg_image_create(&dst, w, h, channels) == GG_OK);
+                        gg_set_max_isa(isa);
+                        assert(gg_rotate_angle(&src, &dst, angles[a], interp, fill) == GG_OK);
+                        assert(memcmp(dst.pixels, reference.pixels, (size_t)w * h * channels) == 0);
+                        gg_image_free(&dst);
+                    }
+                    gg_set_max_isa(-1);
+                    gg_image_free(&reference);
+                }
+            }
+        }
+        free(buffer);
+    }
+
+    gg_image src;
+    assert(gg_image_create(&src, 100, 50, 3) == GG_OK);
+    for (int i = 0; i < 100 * 50 * 3; i++) {
+        src.pixels[i] = (unsigned char)(i * 7 + i / 3);
+    }
+
+    // Output sizes
+    int w, h;
+    assert(gg_angle_rotated_size(&src, 90, GG_BOUNDS_EXPAND, &w, &h) == GG_OK && w == 50 && h == 100);
+    assert(gg_angle_rotated_size(&src, -180, GG_BOUNDS_INNER, &w, &h) == GG_OK && w == 100 && h == 50);
+    assert(gg_angle_rotated_size(&src, 90, GG_BOUNDS_KEEP, &w, &h) == GG_OK && w == 100 && h == 50);
+    assert(gg_angle_rotated_size(&src, 30, GG_BOUNDS_EXPAND, &w, &h) == GG_OK && w == 112 && h == 94);
+    assert(gg_angle_rotated_size(&src, 30, GG_BOUNDS_INNER, &w, &h) == GG_OK && w == 50 && h == 28);
+    assert(gg_angle_rotated_size(&src, 5, GG_BOUNDS_INNER, &w, &h) == GG_OK && w == 96 && h == 41);
+    assert(gg_angle_rotated_size(&src, 5, 3, &w, &h) == GG_ERR_ARGUMENT);
+    assert(gg_angle_rotated_size(&src, NAN, GG_BOUNDS_EXPAND, &w, &h) == GG_ERR_ARGUMENT);
+
+    // Quarter turns at their natural size are the exact rotations
+    const double quarters[] = {90, -90, 180, 720};
+    const int rotations[] = {GG_ROTATE_RIGHT, GG_ROTATE_LEFT, GG_ROTATE_FLIP, 0};
+    for (int q = 0; q < 4; q++) {
+        gg_image expected, rotated;
+        assert(gg_angle_rotated_size(&src, quarters[q], GG_BOUNDS_EXPAND, &w, &h) == GG_OK);
+        assert(gg_image_create(&expected, w, h, 3) == GG_OK);
+        assert(gg_image_create(&rotated, w, h, 3) == GG_OK);
+        if (rotations[q] != 0) {
+            assert(gg_rotate(&src, &expected, rotations[q]) == GG_OK);
+        } else {
+            memcpy(expected.pixels, src.pixels, 100 * 50 * 3);
+        }
+        assert(gg_rotate_angle(&src, &rotated, quarters[q], GG_INTERP_BICUBIC, fill) == GG_OK);
+        assert(memcmp(rotated.pixels, expected.pixels, (size_t)w * h * 3) == 0);
+        gg_image_free(&expected);
+        gg_image_free(&rotated);
+    }
+
+    // Flat areas stay flat, and corners outside the source take the fill
+    memset(src.pixels, 77, 100 * 50 * 3);
+    for (int interp = GG_INTERP_BILINEAR; interp <= GG_INTERP_BICUBIC; interp++) {
+        const unsigned char gray[3] = {77, 77, 77};
+        gg_image rotated;
+        assert(gg_angle_rotated_size(&src, 45, GG_BOUNDS_EXPAND, &w, &h) == GG_OK);
+        assert(gg_image_create(&rotated, w, h, 3) == GG_OK);
+        assert(gg_rotate_angle(&src, &rotated, 45, interp, gray) == GG_OK);
+        for (int i = 0; i < w * h * 3; i++) {
+            assert(rotated.pixels[i] == 77);
+        }
+        assert(gg_rotate_angle(&src, &rotated, 45, interp, fill) == GG_OK);
+        assert(memcmp(rotated.pixels, fill, 3) == 0);
+        assert(memcmp(rotated.pixels + ((h / 2) * w + w / 2) * 3, gray, 3) == 0);
+        gg_image_free(&rotated);
+    }
+
+    // Positive angles turn clockwise: a bright spot right of the center moves down
+    gg_image spot, rotated;
+    assert(gg_image_create(&spot, 41, 41, 1) == GG_OK);
+    assert(gg_image_create(&rotated, 41, 41, 1) == GG_OK);
+    memset(spot.pixels, 0, 41 * 41);
+    for (int y = 19; y <= 21; y++) {
+        memset(spot.pixels + y * 41 + 29, 255, 3);
+    }
+    assert(gg_rotate_angle(&spot, &rotated, 30, GG_INTERP_BILINEAR, NULL) == GG_OK);
+    assert(rotated.pixels[25 * 41 + 29] > 128 && rotated.pixels[15 * 41 + 29] == 0);
+    assert(gg_rotate_angle(&spot, &rotated, 30, 2, NULL) == GG_ERR_ARGUMENT);
+    assert(gg_rotate_angle(&spot, &rotated, INFINITY, GG_INTERP_BILINEAR, NULL) == GG_ERR_ARGUMENT);
+    assert(gg_rotate_angle(&src, &rotated, 30, GG_INTERP_BILINEAR, NULL) == GG_ERR_SIZE);
+    gg_image_free(&spot);
+    gg_image_free(&rotated);
+    gg_image_free(&src);
+
+    pipeline stages;
+    assert(parse_pipeline("rotate:-12.5:bicubic:inner:00ff0080", &stages) == 0);
+    const pipeline_stage *stage = &stages.stages[0];
+    assert(stage->type == STAGE_ROTATE_ANGLE && stage->degrees == -12.5);
+    assert(stage->mode == GG_INTERP_BICUBIC && stage->value == GG_BOUNDS_INNER);
+    assert(stage->fill[0] == 0 && stage->fill[1] == 255 && stage->fill[2] == 0 && stage->fill[3] == 128);
+    assert(parse_pipeline("rotate:3", &stages) == 0);
+    assert(stage->mode == GG_INTERP_BILINEAR && stage->value == GG_BOUNDS_EXPAND && stage->fill[0] == 255);
+    assert(parse_pipeline("rotate:abc", &stages) != 0);
+    assert(parse_pipeline("rotate:3:zoom", &stages) != 0);
+    assert(parse_pipeline("rotate:3:fffff", &stages) != 0);
+    assert(parse_pipeline("rotate:nan", &stages) != 0);
+
+    printf("Test rotate angle passed!\n");
+}
+
+static void test_blur_isa_levels() {
+    // Widths that exercise the vector body, the scalar tail and tiny images
+    const int widths[] = {3, 17, 64, 101};
+    const int radii[] = {1, 3, 9};
+
+    for (size_t wi = 0; wi < sizeof(widths) / sizeof(widths[0]); wi++) {
+        for (size_t ri = 0; ri < sizeof(radii) / sizeof(radii[0]); ri++) {
+            for (int channels = 3; channels <= 4; channels++) {
+                int width = widths[wi], height = 23;
+                gg_image reference;
+                assert(gg_image_create(&reference, width, height, channels) == GG_OK);
+                for (int i = 0; i < width * height * channels; i++) {
+                    reference.pixels[i] = (unsigned char)((i * 37) ^ (i >> 3));
+                }
+
+                gg_image original;
+                assert(gg_image_create(&original, width, height, channels) == GG_OK);
+                memcpy(original.pixels, reference.pixels, width * height * channels);
+
+                gg_set_max_isa(GG_ISA_SCALAR);
+                assert(gg_blur(&reference, radii[ri]) == GG_OK);
+
+                // Every SIMD level gives the same bytes as the scalar path
+                for (int isa = GG_ISA_SSE2; isa <= GG_ISA_AVX512; isa++) {
+                    gg_image candidate;
+                    assert(gg_image_create(&candidate, width, height, channels) == GG_OK);
+                    memcpy(candidate.pixels, original.pixels, width * height * channels);
+                    gg_set_max_isa(isa);
+                    assert(gg_blur(&candidate, radii[ri]) == GG_OK);
+                    assert(memcmp(candidate.pixels, reference.pixels, width * height * channels) == 0);
+                    gg_image_free(&candidate);
+                }
+
+                gg_set_max_isa(-1);
+                gg_image_free(&reference);
+                gg_image_free(&original);
+            }
+        }
+    }
+
+    printf("Test blur ISA levels passed (running on level %d)!\n", gg_cpu_isa());
+}
+static void test_color_matrix() {
+    // Widths that exercise the vector body, the scalar tail and several plane chunks
+    const int widths[] = {5, 47, 300};
+    gg_color_matrix matrices[3];
+    gg_color_matrix_black_and_white(&matrices[0]);
+    gg_color_matrix_vintage(&matrices[1]);
+    assert(parse_color_matrix("-1 0 0 255; 0.5 0.5 0.5 -40; 7.5 -7.5 0 1000", &matrices[2]) == 0);
+
+    for (size_t wi = 0; wi < sizeof(widths) / sizeof(widths[0]); wi++) {
+        for (int channels = 3; channels <= 4; channels++) {
+            for (int mi = 0; mi < 3; mi++) {
+                int width = widths[wi], height = 7;
+                size_t bytes = (size_t)width * height * channels;
+                gg_image original, reference;
+                assert(gg_image_create(&original, width, height, channels) == GG_OK);
+                assert(gg_image_create(&reference, width, height, channels) == GG_OK);
+                for (size_t i = 0; i < bytes; i++) {
+                    original.pixels[i] = (unsigned char)((i * 53) ^ (i >> 4));
+                }
+                memcpy(reference.pixels, original.pixels, bytes);
+                gg_set_max_isa(GG_ISA_SCALAR);
+                assert(gg_apply_color_matrix(&reference, &matrices[mi]) == GG_OK);
+
+                // Within a level of the floating-point result, alpha untouched
+                const gg_color_matrix *m = &matrices[mi];
+                for (int i = 0; i < width * height; i++) {
+                    const unsigned char *in = original.pixels + i * channels;
+                    const unsigned char *out = reference.pixels + i * channels;
+                    for (int c = 0; c < 3; c++) {
+                        double value = m->m[c][0] * in[0] + m->m[c][1] * in[1] + m->m[c][2] * in[2] + m->m[c][3];
+                        value = value < 0 ? 0 : (value > 255 ? 255 : value);
+                        assert(fabs(out[c] - value) <= 1.5);
+                    }
+                    if (channels == 4) {
+                        assert(out[3] == in[3]);
+                    }
+                }
+
+                // Every SIMD level gives the same bytes as the scalar path
+                for (int isa = GG_ISA_SSE2; isa <= GG_ISA_AVX512; isa++) {
+                    gg_image candidate;
+                    assert(gg_image_create(&candidate, width, height, channels) == GG_OK);
+                    memcpy(candidate.pixels, original.pixels, bytes);
+                    gg_set_max_isa(isa);
+                    assert(gg_apply_color_matrix(&candidate, &matrices[mi]) == GG_OK);
+                    assert(memcmp(candidate.pixels, reference.pixels, bytes) == 0);
+                    gg_image_free(&candidate);
+                }
+
+                gg_set_max_isa(-1);
+                gg_image_free(&original);
+                gg_image_free(&reference);
+            }
+        }
+    }
+
+    // Malformed and out-of-range matrices are rejected
+    gg_color_matrix matrix;
+    assert(parse_color_matrix("1 0 0 0 1 0 0 0", &matrix) != 0);
+    assert(parse_color_matrix("1 0 0 0 1 0 0 0 1 0 0 0 1", &matrix) != 0);
+    assert(parse_color_matrix("1 0 0 0 1 0 0 0 x", &matrix) != 0);
+    assert(parse_color_matrix("8 0 0 0 1 0 0 0 1", &matrix) != 0);
+    assert(parse_color_matrix("1 0 0 1024 0 1 0 0 0 0 1 0", &matrix) != 0);
+    gg_image img;
+    assert(gg_image_create(&img, 4, 4, 3) == GG_OK);
+    matrix.m[0][0] = 100.0f;
+    assert(gg_apply_color_matrix(&img, &matrix) == GG_ERR_ARGUMENT);
+    gg_image_free(&img);
+
+    // The black-and-white matrix from the command line matches --makebw
+    const char *bw_file = TEST_WORKING_DIR "bw_matrix.bmp";
+    int result = system("./build/ggpicture --makebw input.bmp");
+    assert(result == 0);
+    rename(TEST_WORKING_DIR TEST_OUTPUT_FILE, bw_file);
+    result = system("./build/ggpicture --colormatrix \"0.299 0.587 0.114, 0.299 0.587 0.114, 0.299 0.587 0.114\" input.bmp");
+    assert(result == 0);
+    assert(compare_images(bw_file, TEST_WORKING_DIR TEST_OUTPUT_FILE));
+    result = system("./build/ggpicture --pipeline \"colormatrix:0 0 1 0 1 0 1 0 0,colormatrix:0 0 1 0 1 0 1 0 0\" input.bmp");
+    assert(result == 0);
+    assert(compare_images(TEST_WORKING_DIR "input.bmp", TEST_WORKING_DIR TEST_OUTPUT_FILE));
+    assert(system("./build/ggpicture --colormatrix \"1 2 3\" input.bmp") != 0);
+
+    remove(bw_file);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+    printf("Test color matrix passed (running on level %d)!\n", gg_cpu_isa());
+}
+
+// The original per-pixel HSL round trip, kept as the reference for gg_saturation
+static void saturation_reference(unsigned char *px, float factor) {
+    float r = px[0] / 255.0f, g = px[1] / 255.0f, b = px[2] / 255.0f;
+    float max = fmaxf(r, fmaxf(g, b)), min = fminf(r, fminf(g, b));
+    float delta = max - min;
+    float h = 0.0f, s = 0.0f, l = (max + min) / 2.0f;
+
+    if (delta != 0.0f) {
+        s = l < 0.5f ? (delta / (max + min)) : (delta / (2.0f - max - min));
+        if (max == r) {
+            h = (g - b) / delta + (g < b ? 6.0f : 0.0f);
+        } else if (max == g) {
+            h = (b - r) / delta + 2.0f;
+        } else {
+            h = (r - g) / delta + 4.0f;
+        }
+        h /= 6.0f;
+    }
+
+    s *= factor;
+    s = s > 1.0f ? 1.0f : (s < 0.0f ? 0.0f : s);
+    float c = (1.0f - fabsf(2.0f * l - 1.0f)) * s;
+    float x = c * (1.0f - fabsf(fmodf(h * 6.0f, 2.0f) - 1.0f));
+    float m = l - c / 2.0f;
+    float out[3];
+    int sector = h < 1.0f / 6.0f ? 0 : h < 2.0f / 6.0f ? 1 : h < 3.0f / 6.0f ? 2 : h < 4.0f / 6.0f ? 3 : h < 5.0f / 6.0f ? 4 : 5;
+    const int order[6][3] = {{0, 1, 2}, {1, 0, 2}, {2, 0, 1}, {2, 1, 0}, {1, 2, 0}, {0, 2, 1}};
+    float values[3] = {c, x, 0.0f};
+    for (int i = 0; i < 3; i++) {
+        out[i] = values[order[sector][i]];
+        px[i] = (unsigned char)((out[i] + m) * 255.0f);
+    }
+}
+
+static void test_saturation() {
+    const int percentages[] = {-100, -30, 0, 40, 250};
+    // Every fifth level of each channel, with an alpha channel to keep
+    const int levels = 52, count = levels * levels * levels;
+
+    for (size_t p = 0; p < sizeof(percentages) / sizeof(percentages[0]); p++) {
+        gg_image original, reference;
+        assert(gg_image_create(&original, count, 1, 4) == GG_OK);
+        assert(gg_image_create(&reference, count, 1, 4) == GG_OK);
+        for (int i = 0; i < count; i++) {
+            unsigned char *px = original.pixels + i * 4;
+            px[0] = (unsigned char)(i / (levels * levels) * 5);
+            px[1] = (unsigned char)(i / levels % levels * 5);
+            px[2] = (unsigned char)(i % levels * 5);
+            px[3] = (unsigned char)i;
+        }
+        memcpy(reference.pixels, original.pixels, (size_t)count * 4);
+        gg_set_max_isa(GG_ISA_SCALAR);
+        assert(gg_saturation(&reference, percentages[p]) == GG_OK);
+
+        // Within one level of the HSL round trip
+        for (int i = 0; i < count; i++) {
+            unsigned char expected[3];
+            memcpy(expected, original.pixels + i * 4, 3);
+            saturation_reference(expected, 1.0f + percentages[p] / 100.0f);
+            for (int c = 0; c < 3; c++) {
+                assert(abs(reference.pixels[i * 4 + c] - expected[c]) <= 1);
+            }
+            assert(reference.pixels[i * 4 + 3] == original.pixels[i * 4 + 3]);
+        }
+
+        // Every SIMD level gives the same bytes as the scalar path
+        for (int isa = GG_ISA_SSE2; isa <= GG_ISA_AVX512; isa++) {
+            gg_image candidate;
+            assert(gg_image_create(&candidate, count, 1, 4) == GG_OK);
+            memcpy(candidate.pixels, original.pixels, (size_t)count * 4);
+            gg_set_max_isa(isa);
+            assert(gg_saturation(&candidate, percentages[p]) == GG_OK);
+            assert(memcmp(candidate.pixels, reference.pixels, (size_t)count * 4) == 0);
+            gg_image_free(&candidate);
+        }
+
+        gg_set_max_isa(-1);
+        gg_image_free(&original);
+        gg_image_free(&reference);
+    }
+
+    printf("Test saturation passed!\n");
+}
+
+static void test_pixelate_blocks() {
+    const int sizes[] = {1, 2, 3, 7, 16};
+
+    for (int channels = 1; channels <= 4; channels++) {
+        for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); si++) {
+            // A padded source whose size is not a multiple of the block size
+            int width = 53, height = 38, pixel_size = sizes[si];
+            ptrdiff_t stride = (ptrdiff_t)width * channels + 5;
+            unsigned char *buffer = malloc(stride * height);
+            assert(buffer != NULL);
+            for (ptrdiff_t i = 0; i < stride * height; i++) {
+                buffer[i] = (unsigned char)((i * 71) ^ (i >> 3));
+            }
+            gg_image src, dst;
+            gg_image_wrap(&src, buffer, width, height, channels, stride);
+            int w, h;
+            assert(gg_pixelated_size(&src, pixel_size, &w, &h) == GG_OK);
+            assert(gg_image_create(&dst, w, h, channels) == GG_OK);
+
+            // Every pixel holds the truncated average of its block, with every
+            // kernel version
+            for (int isa = GG_ISA_SCALAR; isa <= GG_ISA_AVX512; isa++) {
+                gg_set_max_isa(isa);
+                memset(dst.pixels, 0, (size_t)w * h * channels);
+                assert(gg_pixelate(&src, &dst, pixel_size) == GG_OK);
+                for (int y = 0; y < h; y++) {
+                    for (int x = 0; x < w; x++) {
+                        int bx = x / pixel_size * pixel_size, by = y / pixel_size * pixel_size;
+                        for (int c = 0; c < channels; c++) {
+                            int sum = 0;
+                            for (int dy = 0; dy < pixel_size; dy++) {
+                                for (int dx = 0; dx < pixel_size; dx++) {
+                                    sum += buffer[(by + dy) * stride + (bx + dx) * channels + c];
+                                }
+                            }
+                            assert(dst.pixels[((size_t)y * w + x) * channels + c] ==
+                                   sum / (pixel_size * pixel_size));
+                        }
+                    }
+                }
+            }
+            gg_set_max_isa(-1);
+
+            gg_image_free(&dst);
+            free(buffer);
+        }
+    }
+
+    printf("Test pixelate blocks passed!\n");
+}
+
+static void test_blur_approximation() {
+    const int width = 160, height = 90, channels = 3;
+    const int radii[] = {5, 30, 60};
+
+    for (size_t ri = 0; ri < sizeof(radii) / sizeof(radii[0]); ri++) {
+        gg_image exact, approx;
+        assert(gg_image_create(&exact, width, height, channels) == GG_OK);
+        assert(gg_image_create(&approx, width, height, channels) == GG_OK);
+        for (int i = 0; i < width * height * channels; i++) {
+            // Vertical stripes plus a little texture
+            int x = (i / channels) % width;
+            exact.pixels[i] = approx.pixels[i] = (unsigned char)((x / 20) % 2 * 200 + (i * 7) % 31);
+        }
+
+        assert(gg_blur_ex(&exact, radii[ri], GG_BLUR_EXACT) == GG_OK);
+        assert(gg_blur_ex(&approx, radii[ri], GG_BLUR_APPROX) == GG_OK);
+
+        // The box cascade stays close to the Gaussian everywhere, borders included
+        for (int i = 0; i < width * height * channels; i++) {
+            assert(abs(exact.pixels[i] - approx.pixels[i]) <= 10);
+        }
+
+        // Every kernel version computes the same cascade
+        for (int isa = GG_ISA_SCALAR; isa <= GG_ISA_AVX512; isa++) {
+            gg_image copy;
+            assert(gg_image_create(&copy, width, height, channels) == GG_OK);
+            for (int i = 0; i < width * height * channels; i++) {
+                int x = (i / channels) % width;
+                copy.pixels[i] = (unsigned char)((x / 20) % 2 * 200 + (i * 7) % 31);
+            }
+            gg_set_max_isa(isa);
+            assert(gg_blur_ex(&copy, radii[ri], GG_BLUR_APPROX) == GG_OK);
+            assert(memcmp(copy.pixels, approx.pixels, (size_t)width * height * channels) == 0);
+            gg_image_free(&copy);
+        }
+        gg_set_max_isa(-1);
+
+        gg_image_free(&exact);
+        gg_image_free(&approx);
+    }
+
+    // Channels are blurred independently by the 3- and 4-channel versions alike
+    const int modes[] = {GG_BLUR_EXACT, GG_BLUR_APPROX};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        gg_image rgb, rgba;
+        assert(gg_image_create(&rgb, width, height, 3) == GG_OK);
+        assert(gg_image_create(&rgba, width, height, 4) == GG_OK);
+        for (int i = 0; i < width * height; i++) {
+            for (int c = 0; c < 3; c++) {
+                rgb.pixels[i * 3 + c] = rgba.pixels[i * 4 + c] = (unsigned char)(i * 13 + c * 101 + i / 97);
+            }
+            rgba.pixels[i * 4 + 3] = 0x5a;
+        }
+        assert(gg_blur_ex(&rgb, 12, modes[m]) == GG_OK);
+        assert(gg_blur_ex(&rgba, 12, modes[m]) == GG_OK);
+        for (int i = 0; i < width * height; i++) {
+            assert(memcmp(rgba.pixels + i * 4, rgb.pixels + i * 3, 3) == 0);
+            assert(rgba.pixels[i * 4 + 3] <= 0x5a);
+        }
+        gg_image_free(&rgb);
+        gg_image_free(&rgba);
+    }
+
+    gg_image img;
+    assert(gg_image_create(&img, 4, 4, 3) == GG_OK);
+    assert(gg_blur_ex(&img, 3, 42) == GG_ERR_ARGUMENT);
+    gg_image_free(&img);
+
+    pipeline stages;
+    assert(parse_pipeline("blur:40:exact,blur:40:approx,blur:3", &stages) == 0);
+    assert(stages.stages[0].mode == GG_BLUR_EXACT);
+    assert(stages.stages[1].mode == GG_BLUR_APPROX);
+    assert(stages.stages[2].mode == GG_BLUR_AUTO);
+    assert(parse_pipeline("blur:40:fast", &stages) != 0);
+
+    int result = system("./build/ggpicture --blur 40 --approx input.bmp");
+    assert(result == 0);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+
+    printf("Test blur approximation passed!\n");
+}
+
+// Run every kernel once on a copy of src and return the concatenated results
+static unsigned char *run_all_kernels(const gg_image *src, size_t *size) {
+    size_t bytes = (size_t)src->width * src->height * src->channels;
+    int rw, rh, pw, ph;
+    assert(gg_rotated_size(src, GG_ROTATE_RIGHT, &rw, &rh) == GG_OK);
+    assert(gg_pixelated_size(src, 7, &pw, &ph) == GG_OK);
+    size_t pixel_bytes = (size_t)pw * ph * src->channels;
+
+    *size = bytes * 10 + pixel_bytes;
+    unsigned char *out = malloc(*size);
+    assert(out != NULL);
+
+    for (int k = 0; k < 10; k++) {
+        gg_image img;
+        gg_image_wrap(&img, out + k * bytes, src->width, src->height, src->channels, src->stride);
+        if (k < 3) {
+            const int rotations[] = {GG_ROTATE_RIGHT, GG_ROTATE_LEFT, GG_ROTATE_FLIP};
+            gg_image dst;
+            int w, h;
+            assert(gg_rotated_size(src, rotations[k], &w, &h) == GG_OK);
+            gg_image_wrap(&dst, img.pixels, w, h, src->channels, (ptrdiff_t)w * src->channels);
+            assert(gg_rotate(src, &dst, rotations[k]) == GG_OK);
+            continue;
+        }
+
+        memcpy(img.pixels, src->pixels, bytes);
+        switch (k) {
+        case 3: assert(gg_brightness(&img, 25) == GG_OK); break;
+        case 4: assert(gg_contrast(&img, -30) == GG_OK); break;
+        case 5: assert(gg_black_and_white(&img) == GG_OK); break;
+        case 6: assert(gg_vintage(&img) == GG_OK); break;
+        case 7: assert(gg_saturation(&img, 40) == GG_OK); break;
+        case 8: assert(gg_blur_ex(&img, 4, GG_BLUR_EXACT) == GG_OK); break;
+        case 9: assert(gg_blur_ex(&img, 30, GG_BLUR_APPROX) == GG_OK); break;
+        }
+    }
+
+    gg_image pixelated;
+    gg_image_wrap(&pixelated, out + 10 * bytes, pw, ph, src->channels, (ptrdiff_t)pw * src->channels);
+    assert(gg_pixelate(src, &pixelated, 7) == GG_OK);
+    return out;
+}
+
+static void test_thread_counts() {
+    // Tall enough that every kernel is split into several bands
+    const int width = 333, height = 517, channels = 3;
+    gg_image src;
+    assert(gg_image_create(&src, width, height, channels) == GG_OK);
+    for (int i = 0; i < width * height * channels; i++) {
+        src.pixels[i] = (unsigned char)((i * 41) ^ (i >> 5));
+    }
+
+    size_t reference_size, candidate_size;
+    gg_set_threads(1);
+    assert(gg_threads() == 1);
+    unsigned char *reference = run_all_kernels(&src, &reference_size);
+
+    // Work is split by rows only, so any thread count gives the same bytes
+    const int thread_counts[] = {2, 3, 8, 0};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        gg_set_threads(thread_counts[t]);
+        assert(gg_threads() >= 1);
+        unsigned char *candidate = run_all_kernels(&src, &candidate_size);
+        assert(candidate_size == reference_size);
+        assert(memcmp(candidate, reference, reference_size) == 0);
+        free(candidate);
+    }
+
+    free(reference);
+    gg_image_free(&src);
+
+    int result = system("./build/ggpicture --threads 4 --blur 3 input.bmp");
+    assert(result == 0);
+    result = system("./build/ggpicture --rotate --threads 2 -r input.bmp");
+    assert(result == 0);
+    result = system("./build/ggpicture --threads x --blur 3 input.bmp");
+    assert(result != 0);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+
+    printf("Test thread counts passed (auto-detected %d threads)!\n", gg_threads());
+}
+
+static unsigned char *read_file(const char *path, long *size) {
+    FILE *file = fopen(path, "rb");
+    assert(file != NULL);
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *data = malloc(*size);
+    assert(data != NULL && fread(data, 1, *size, file) == (size_t)*size);
+    fclose(file);
+    return data;
+}
+
+static void test_batch() {
+    const char *names[] = {"b0.bmp", "b1.bmp", "b2.png"};
+    char path[256];
+
+    mkdir(TEST_WORKING_DIR "batch_in", 0755);
+    mkdir(TEST_WORKING_DIR "batch_out", 0755);
+    for (int i = 0; i < 3; i++) {
+        unsigned char pixels[8 * 5 * 3];
+        memset(pixels, 40 * i, sizeof(pixels));
+        snprintf(path, sizeof(path), TEST_WORKING_DIR "batch_in/%s", names[i]);
+        assert(stbi_write_bmp(path, 8, 5, 3, pixels));
+    }
+    // Not an image; the directory scan must skip it
+    FILE *notes = fopen(TEST_WORKING_DIR "batch_in/notes.txt", "w");
+    assert(notes != NULL);
+    fclose(notes);
+
+    int result = system("./build/ggpicture --batch batch_in \"rotate:r,setbright:+10\" batch_out/{name}_{index}.{ext}");
+    assert(result == 0);
+    for (int i = 0; i < 3; i++) {
+        int width, height, channels;
+        snprintf(path, sizeof(path), TEST_WORKING_DIR "batch_out/%.2s_%d.%s", names[i], i, names[i] + 3);
+        get_image_dimensions(path, &width, &height, &channels);
+        assert(width == 5 && height == 8);
+        remove(path);
+    }
+
+    // Manifest with a comment, a blank line and paths relative to the working directory
+    FILE *manifest = fopen(TEST_WORKING_DIR "batch_in/list.txt", "w");
+    assert(manifest != NULL);
+    fprintf(manifest, "# inputs\nbatch_in/b1.bmp\n\n  batch_in/b0.bmp  \n");
+    fclose(manifest);
+
+    result = system("./build/ggpicture --batch batch_in/list.txt makebw batch_out/m{index}.bmp");
+    assert(result == 0);
+    assert(access(TEST_WORKING_DIR "batch_out/m0.bmp", F_OK) == 0);
+    assert(access(TEST_WORKING_DIR "batch_out/m1.bmp", F_OK) == 0);
+    assert(access(TEST_WORKING_DIR "batch_out/m2.bmp", F_OK) != 0);
+    remove(TEST_WORKING_DIR "batch_out/m0.bmp");
+    remove(TEST_WORKING_DIR "batch_out/m1.bmp");
+
+    // A file that fails to decode is reported without stopping the other stages
+    FILE *broken = fopen(TEST_WORKING_DIR "batch_in/broken.bmp", "w");
+    assert(broken != NULL);
+    fprintf(broken, "not a bitmap");
+    fclose(broken);
+    result = system("./build/ggpicture --threads 3 --batch batch_in setcontr:+20 batch_out/s{index}.bmp");
+    assert(result != 0);
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), TEST_WORKING_DIR "batch_out/s%d.bmp", i);
+        assert(access(path, F_OK) == 0);
+        remove(path);
+    }
+    assert(access(TEST_WORKING_DIR "batch_out/s3.bmp", F_OK) != 0); // broken.bmp sorts last
+    remove(TEST_WORKING_DIR "batch_in/broken.bmp");
+
+    // Several inputs on one output, unknown placeholders and missing sources are refused
+    assert(system("./build/ggpicture --batch batch_in makebw batch_out/same.bmp") != 0);
+    assert(system("./build/ggpicture --batch batch_in makebw batch_out/{stem}.bmp") != 0);
+    assert(system("./build/ggpicture --batch no_such_dir makebw") != 0);
+    assert(access(TEST_WORKING_DIR "batch_out/same.bmp", F_OK) != 0);
+
+    batch_list list;
+    assert(batch_collect("batch_in", TEST_WORKING_DIR, &list) == 0);
+    assert(list.count == 3);
+    assert(batch_name_outputs(&list, "batch_in/{name}.{ext}", TEST_WORKING_DIR) != 0); // Would overwrite the inputs
+    batch_list_free(&list);
+    assert(batch_collect("batch_in", TEST_WORKING_DIR, &list) == 0);
+    assert(batch_name_outputs(&list, "batch_in//./{name}.{ext}", TEST_WORKING_DIR) != 0);
+    batch_list_free(&list);
+
+    // The manifest lists b1 first, so output 0 would be the other input b0
+    assert(batch_collect("batch_in/list.txt", TEST_WORKING_DIR, &list) == 0);
+    assert(batch_name_outputs(&list, "batch_in/b{index}.bmp", TEST_WORKING_DIR) != 0);
+    batch_list_free(&list);
+    long before_size, after_size;
+    unsigned char *before = read_file(TEST_WORKING_DIR "batch_in/b0.bmp", &before_size);
+    assert(system("./build/ggpicture --batch batch_in/list.txt makebw batch_in/b{index}.bmp") != 0);
+    unsigned char *after = read_file(TEST_WORKING_DIR "batch_in/b0.bmp", &after_size);
+    assert(after_size == before_size && memcmp(after, before, before_size) == 0);
+    free(before);
+    free(after);
+
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), TEST_WORKING_DIR "batch_in/%s", names[i]);
+        remove(path);
+    }
+    remove(TEST_WORKING_DIR "batch_in/notes.txt");
+    remove(TEST_WORKING_DIR "batch_in/list.txt");
+    rmdir(TEST_WORKING_DIR "batch_in");
+    rmdir(TEST_WORKING_DIR "batch_out");
+
+    printf("Test batch passed!\n");
+}
+
+static void test_bmp_mapping() {
+    // 7 * 3 bytes per row leaves a byte of padding
+    const int width = 7, height = 5;
+    const char *path = TEST_WORKING_DIR "mapped.bmp";
+    unsigned char pixels[7 * 5 * 3];
+    for (int i = 0; i < width * height * 3; i++) {
+        pixels[i] = (unsigned char)(i * 13 + 1);
+    }
+    assert(stbi_write_bmp(path, width, height, 3, pixels));
+
+    // Bottom-up file: negative stride, B, G, R order, identical pixels to stb
+    bmp_mapping map;
+    assert(bmp_map(path, &map) == 0);
+    assert(map.image.width == width && map.image.height == height && map.image.channels == 3);
+    assert(map.image.stride == -8 * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const unsigned char *mapped = map.image.pixels + y * map.image.stride + x * 3;
+            const unsigned char *expected = pixels + (y * width + x) * 3;
+            assert(mapped[0] == expected[2] && mapped[1] == expected[1] && mapped[2] == expected[0]);
+        }
+    }
+    bmp_unmap(&map);
+
+    // Rotating the mapped file gives the same result as rotating the decoded pixels
+    int result = system("./build/ggpicture --rotate -l mapped.bmp");
+    assert(result == 0);
+    int w, h, c;
+    unsigned char *rotated = stbi_load(TEST_WORKING_DIR TEST_OUTPUT_FILE, &w, &h, &c, 0);
+    assert(rotated != NULL && w == height && h == width && c == 3);
+    gg_image src, expected;
+    gg_image_wrap(&src, pixels, width, height, 3, width * 3);
+    assert(gg_image_create(&expected, height, width, 3) == GG_OK);
+    assert(gg_rotate(&src, &expected, GG_ROTATE_LEFT) == GG_OK);
+    assert(memcmp(rotated, expected.pixels, width * height * 3) == 0);
+    stbi_image_free(rotated);
+    gg_image_free(&expected);
+
+    // Other formats are left to stb
+    assert(stbi_write_png(TEST_WORKING_DIR "mapped.png", width, height, 3, pixels, width * 3));
+    assert(bmp_map(TEST_WORKING_DIR "mapped.png", &map) != 0);
+    assert(bmp_map(TEST_WORKING_DIR "missing.bmp", &map) != 0);
+
+    remove(path);
+    remove(TEST_WORKING_DIR "mapped.png");
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+    printf("Test BMP mapping passed!\n");
+}
+
+
+static void test_bmp_writer() {
+    const char *expected_path = TEST_WORKING_DIR "stb.bmp";
+    const char *path = TEST_WORKING_DIR "native.bmp";
+    const int widths[] = {1, 5, 8, 11, 37};
+    const int flags[] = {0, BMP_WRITE_DIRECT, BMP_WRITE_DONTNEED};
+
+    for (int channels = 1; channels <= 4; channels++) {
+        for (size_t wi = 0; wi < sizeof(widths) / sizeof(widths[0]); wi++) {
+            int width = widths[wi], height = 9;
+            gg_image img;
+            assert(gg_image_create(&img, width, height, channels) == GG_OK);
+            for (int i = 0; i < width * height * channels; i++) {
+                img.pixels[i] = (unsigned char)(i * 29 + 3);
+            }
+            assert(stbi_write_bmp(expected_path, width, height, channels, img.pixels));
+            long expected_size;
+            unsigned char *expected = read_file(expected_path, &expected_size);
+
+            // Same bytes as stb for every swizzle level and write mode
+            for (int isa = GG_ISA_SCALAR; isa <= GG_ISA_AVX512; isa++) {
+                for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+                    gg_set_max_isa(isa);
+                    assert(bmp_write(path, &img, flags[f]) == 0);
+                    long size;
+                    unsigned char *written = read_file(path, &size);
+                    assert(size == expected_size && memcmp(written, expected, size) == 0);
+                    free(written);
+                }
+            }
+            gg_set_max_isa(-1);
+
+            // Pixels that are already B, G, R go out unchanged
+            if (channels >= 3) {
+                for (int i = 0; i < width * height; i++) {
+                    unsigned char *px = img.pixels + i * channels;
+                    unsigned char red = px[0];
+                    px[0] = px[2];
+                    px[2] = red;
+                }
+                for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+                    assert(bmp_write(path, &img, flags[f] | BMP_WRITE_BGR) == 0);
+                    long size;
+                    unsigned char *written = read_file(path, &size);
+                    assert(size == expected_size && memcmp(written, expected, size) == 0);
+                    free(written);
+                }
+            }
+
+            free(expected);
+            gg_image_free(&img);
+        }
+    }
+
+    gg_image img;
+    assert(gg_image_create(&img, 4, 4, 3) == GG_OK);
+    assert(bmp_write(TEST_WORKING_DIR "no_such_dir/out.bmp", &img, 0) != 0);
+    gg_image_free(&img);
+
+    remove(path);
+    remove(expected_path);
+    printf("Test BMP writer passed!\n");
+}
+
+static void test_mirror_output() {
+    // The larger image is written in several bands
+    const int sizes[][2] = {{7, 5}, {1000, 400}};
+    const char *commands[] = {"--rotate -f", "--mirror -h", "--mirror -v"};
+    const int axes[] = {GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL, GG_MIRROR_HORIZONTAL, GG_MIRROR_VERTICAL};
+    const char *inputs[] = {"mirror_in.bmp", "mirror_in.png"};
+    const char *expected_path = TEST_WORKING_DIR "mirror_expected.bmp";
+    const char *self_path = TEST_WORKING_DIR "mirror_self.bmp";
+
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); si++) {
+        int width = sizes[si][0], height = sizes[si][1];
+        gg_image img;
+        assert(gg_image_create(&img, width, height, 3) == GG_OK);
+        for (int i = 0; i < width * height * 3; i++) {
+            img.pixels[i] = (unsigned char)(i * 13 + i / 1001);
+        }
+        assert(stbi_write_bmp(TEST_WORKING_DIR "mirror_in.bmp", width, height, 3, img.pixels));
+        assert(stbi_write_png(TEST_WORKING_DIR "mirror_in.png", width, height, 3, img.pixels, width * 3));
+
+        for (size_t c = 0; c < sizeof(commands) / sizeof(commands[0]); c++) {
+            gg_image mirrored;
+            assert(gg_image_create(&mirrored, width, height, 3) == GG_OK);
+            memcpy(mirrored.pixels, img.pixels, (size_t)width * height * 3);
+            assert(gg_mirror(&mirrored, axes[c]) == GG_OK);
+            assert(stbi_write_bmp(expected_path, width, height, 3, mirrored.pixels));
+            long expected_size;
+            unsigned char *expected = read_file(expected_path, &expected_size);
+
+            // Mapped BMP and decoded PNG input give the same file
+            for (size_t in = 0; in < sizeof(inputs) / sizeof(inputs[0]); in++) {
+                char command[256];
+                snprintf(command, sizeof(command), "./build/ggpicture %s %s > /dev/null", commands[c], inputs[in]);
+                assert(system(command) == 0);
+                long size;
+                unsigned char *written = read_file(TEST_WORKING_DIR TEST_OUTPUT_FILE, &size);
+                assert(size == expected_size && memcmp(written, expected, size) == 0);
+                free(written);
+            }
+
+            // A BMP mirrored onto itself is read before it is overwritten
+            assert(stbi_write_bmp(self_path, width, height, 3, img.pixels));
+            if (axes[c] == (GG_MIRROR_HORIZONTAL | GG_MIRROR_VERTICAL)) {
+                assert(process_image(self_path, ROTATE_FLIP, TEST_WORKING_DIR "./mirror_self.bmp") == 0);
+            } else {
+                assert(mirror_image(self_path, axes[c], self_path) == 0);
+            }
+            long size;
+            unsigned char *written = read_file(self_path, &size);
+            assert(size == expected_size && memcmp(written, expected, size) == 0);
+            free(written);
+
+            free(expected);
+            gg_image_free(&mirrored);
+        }
+        gg_image_free(&img);
+    }
+
+    assert(system("./build/ggpicture --mirror -d mirror_in.bmp > /dev/null") != 0);
+
+    remove(TEST_WORKING_DIR "mirror_in.bmp");
+    remove(TEST_WORKING_DIR "mirror_in.png");
+    remove(expected_path);
+    remove(self_path);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+    printf("Test mirror output passed!\n");
+}
+
+static void test_rotate_angle_output() {
+    const int width = 120, height = 70;
+    const unsigned char fill[3] = {0, 0, 255};
+    const char *inputs[] = {"angle_in.bmp", "angle_in.png"};
+    const char *expected_path = TEST_WORKING_DIR "angle_expected.bmp";
+
+    gg_image img;
+    assert(gg_image_create(&img, width, height, 3) == GG_OK);
+    for (int i = 0; i < width * height * 3; i++) {
+        img.pixels[i] = (unsigned char)(i * 13 + i / 1001);
+    }
+    assert(stbi_write_bmp(TEST_WORKING_DIR "angle_in.bmp", width, height, 3, img.pixels));
+    assert(stbi_write_png(TEST_WORKING_DIR "angle_in.png", width, height, 3, img.pixels, width * 3));
+
+    int w, h;
+    gg_image rotated;
+    assert(gg_angle_rotated_size(&img, 20, GG_BOUNDS_EXPAND, &w, &h) == GG_OK);
+    assert(gg_image_create(&rotated, w, h, 3) == GG_OK);
+    assert(gg_rotate_angle(&img, &rotated, 20, GG_INTERP_BICUBIC, fill) == GG_OK);
+    assert(stbi_write_bmp(expected_path, w, h, 3, rotated.pixels));
+    long expected_size;
+    unsigned char *expected = read_file(expected_path, &expected_size);
+
+    // Mapped BMP and decoded PNG input give the same file, fill color included
+    for (size_t in = 0; in < sizeof(inputs) / sizeof(inputs[0]); in++) {
+        char command[256];
+        snprintf(command, sizeof(command), "./build/ggpicture --rotate 20 --bicubic --fill 0000ff %s > /dev/null",
+                 inputs[in]);
+        assert(system(command) == 0);
+        long size;
+        unsigned char *written = read_file(TEST_WORKING_DIR TEST_OUTPUT_FILE, &size);
+        assert(size == expected_size && memcmp(written, expected, size) == 0);
+        free(written);
+    }
+    free(expected);
+    gg_image_free(&rotated);
+    gg_image_free(&img);
+
+    assert(system("./build/ggpicture --rotate 20 --zoom angle_in.bmp > /dev/null") != 0);
+    assert(system("./build/ggpicture --rotate 20 --fill 00ff angle_in.bmp > /dev/null") != 0);
+    assert(system("./build/ggpicture --stream --rotate 20 angle_in.bmp > /dev/null") != 0);
+
+    remove(TEST_WORKING_DIR "angle_in.bmp");
+    remove(TEST_WORKING_DIR "angle_in.png");
+    remove(expected_path);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+    printf("Test rotate angle output passed!\n");
+}
+
+static void test_streaming() {
+    const char *input = TEST_WORKING_DIR "stream_in.bmp";
+    const char *expected_path = TEST_WORKING_DIR "stream_expected.bmp";
+    const char *path = TEST_WORKING_DIR "stream_out.bmp";
+    const char *specs[] = {"setbright:+10,makebw,setsatur:-30", "blur:3",
+                           "blur:40:approx,setcontr:+20", "blur:2,rotate:f,blur:5,rotate:f",
+                           "blur:4,makepixel:4,makevintage", "rotate:f,makepixel:5",
+                           "blur:3,mirror:v,setbright:+5,mirror:h", "mirror:v,makepixel:3,mirror:h"};
+    const size_t band_sizes[] = {1, 8 * 40 * 3, (size_t)1 << 20};
+
+    // 37 * 3 bytes per row leaves padding; 53 rows is not a multiple of any pixel size
+    gg_image img;
+    assert(gg_image_create(&img, 37, 53, 3) == GG_OK);
+    for (int i = 0; i < 37 * 53 * 3; i++) {
+        img.pixels[i] = (unsigned char)((i * 37) ^ (i >> 5));
+    }
+    assert(bmp_write(input, &img, 0) == 0);
+
+    // Any band size gives the bytes of the whole-image pipeline
+    for (size_t s = 0; s < sizeof(specs) / sizeof(specs[0]); s++) {
+        pipeline p;
+        assert(parse_pipeline(specs[s], &p) == 0);
+        gg_image whole;
+        assert(gg_image_create(&whole, img.width, img.height, 3) == GG_OK);
+        memcpy(whole.pixels, img.pixels, 37 * 53 * 3);
+        assert(run_pipeline(&p, &whole) == GG_OK);
+        assert(bmp_write(expected_path, &whole, 0) == 0);
+        gg_image_free(&whole);
+        long expected_size;
+        unsigned char *expected = read_file(expected_path, &expected_size);
+
+        for (size_t b = 0; b < sizeof(band_sizes) / sizeof(band_sizes[0]); b++) {
+            assert(stream_pipeline(input, &p, path, band_sizes[b], 0) == 0);
+            long size;
+            unsigned char *written = read_file(path, &size);
+            assert(size == expected_size && memcmp(written, expected, size) == 0);
+            free(written);
+        }
+        free(expected);
+    }
+
+    // The command line routes single commands through the same engine
+    int result = system("./build/ggpicture --stream --band-mb 1 --blur 3 stream_in.bmp");
+    assert(result == 0);
+    pipeline p;
+    assert(parse_pipeline("blur:3", &p) == 0);
+    assert(stream_pipeline(input, &p, path, (size_t)1 << 20, 0) == 0);
+    assert(compare_images(path, TEST_WORKING_DIR TEST_OUTPUT_FILE));
+
+    // Quarter turns and non-BMP input are refused
+    assert(parse_pipeline("rotate:r", &p) == 0);
+    assert(stream_pipeline(input, &p, path, (size_t)1 << 20, 0) != 0);
+    assert(parse_pipeline("blur:3", &p) == 0);
+    assert(stbi_write_png(TEST_WORKING_DIR "stream_in.png", 37, 53, 3, img.pixels, 37 * 3));
+    assert(stream_pipeline(TEST_WORKING_DIR "stream_in.png", &p, path, (size_t)1 << 20, 0) != 0);
 
+    // So is streaming a file onto itself, under any name, and the input survives
+    long input_size;
+    unsigned char *original = read_file(input, &input_size);
+    assert(stream_pipeline(input, &p, TEST_WORKING_DIR "./stream_in.bmp", (size_t)1 << 20, 0) != 0);
+    long size;
+    unsigned char *after = read_file(input, &size);
+    assert(size == input_size && memcmp(after, original, size) == 0);
+    free(original);
+    free(after);
+
+    gg_image_free(&img);
+    remove(input);
+    remove(expected_path);
+    remove(path);
+    remove(TEST_WORKING_DIR "stream_in.png");
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+    printf("Test streaming passed!\n");
+}
 
 /* Test runner */
+// read_file with a terminating NUL, for searching text output
+static char *read_text(const char *path, long *size) {
+    unsigned char *data = read_file(path, size);
+    char *text = realloc(data, *size + 1);
+    assert(text != NULL);
+    text[*size] = '\0';
+    return text;
+}
+
+static void test_stats() {
+    const char *report_path = TEST_WORKING_DIR "stats.json";
+    const char *trace_path = TEST_WORKING_DIR "trace.json";
+
+    // Folded point stages are one step; every stage lands in the report and trace
+    int result = system("./build/ggpicture --stats=json --trace tests/trace.json "
+                        "--pipeline \"setbright:+10,setcontr:5,blur:3,rotate:r\" input.bmp 2> tests/stats.json");
+    assert(result == 0);
+    const char *stages[] = {"\"decode\"", "\"setbright+setcontr\"", "\"blur\"", "\"rotate\"", "\"encode\""};
+    long size;
+    char *report = read_text(report_path, &size);
+    char *trace = read_text(trace_path, &size);
+    assert(strstr(report, "\"peak_rss_kb\"") != NULL && strstr(trace, "\"traceEvents\"") != NULL);
+    const char *previous = report;
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        const char *found = strstr(previous, stages[i]);
+        assert(found != NULL && strstr(trace, stages[i]) != NULL);
+        previous = found;
+    }
+    free(report);
+    free(trace);
+
+    // Without --stats nothing is reported
+    result = system("./build/ggpicture --blur 3 input.bmp 2> tests/stats.json");
+    assert(result == 0);
+    report = read_text(report_path, &size);
+    assert(size == 0);
+    free(report);
+
+    remove(report_path);
+    remove(trace_path);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+    printf("Test stats passed!\n");
+}
+
+static void test_server() {
+    const char *socket_path = TEST_WORKING_DIR "server.sock";
+    const char *served = TEST_WORKING_DIR "served.bmp";
+    struct stat st;
+    remove(socket_path);
+
+    int result = system("./build/ggpicture --threads 2 --serve tests/server.sock > /dev/null &");
+    assert(result == 0);
+    for (int i = 0; i < 500 && submit_request(socket_path, "ping") != 0; i++) {
+        usleep(10000);
+    }
+    assert(submit_request(socket_path, "ping") == 0);
+
+    // A second server may not take over a live socket
+    assert(serve_jobs(socket_path, "tests", TEST_WORKING_DIR TEST_OUTPUT_FILE) != 0);
+
+    // Served jobs write the same bytes as a --pipeline run
+    result = system("./build/ggpicture --submit tests/server.sock \"setbright:+10,blur:3,rotate:r\" input.bmp served.bmp");
+    assert(result == 0);
+    result = system("./build/ggpicture --pipeline \"setbright:+10,blur:3,rotate:r\" input.bmp");
+    assert(result == 0);
+    assert(compare_images(served, TEST_WORKING_DIR TEST_OUTPUT_FILE));
+
+    // Bad requests get an error reply and leave the server running
+    assert(submit_request(socket_path, "run\tblur:x\tinput.bmp\tserved.bmp") != 0);
+    assert(submit_request(socket_path, "run\tblur:3\tmissing.bmp\tserved.bmp") != 0);
+    assert(submit_request(socket_path, "run\tblur:3") != 0);
+    assert(submit_request(socket_path, "resize") != 0);
+    assert(submit_request(socket_path, "ping") == 0);
+
+    // Shared-memory jobs change the pixels in place, through a passed
+    // descriptor or a segment name
+    gg_image img, expected;
+    assert(gg_image_create(&img, 37, 53, 3) == GG_OK);
+    for (int i = 0; i < 37 * 53 * 3; i++) {
+        img.pixels[i] = (unsigned char)((i * 29) ^ (i >> 4));
+    }
+    size_t bytes = 37 * 53 * 3;
+    shm_unlink("/ggpicture_test");
+    int segment = shm_open("/ggpicture_test", O_RDWR | O_CREAT | O_EXCL, 0600);
+    assert(segment >= 0 && ftruncate(segment, bytes) == 0);
+    unsigned char *shared = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0);
+    assert(shared != MAP_FAILED);
+    memcpy(shared, img.pixels, bytes);
+
+    pipeline p;
+    assert(parse_pipeline("setbright:+10,blur:3,makevintage", &p) == 0);
+    assert(run_pipeline(&p, &img) == GG_OK);
+    int width = 37, height = 53;
+    assert(submit_shared(socket_path, "setbright:+10,blur:3,makevintage", segment, &width, &height, 3) == 0);
+    assert(width == 37 && height == 53 && memcmp(shared, img.pixels, bytes) == 0);
+
+    assert(gg_image_create(&expected, 37, 53, 3) == GG_OK);
+    memcpy(expected.pixels, img.pixels, bytes);
+    assert(parse_pipeline("blur:2,rotate:r,makepixel:3", &p) == 0);
+    assert(run_pipeline(&p, &expected) == GG_OK);
+    assert(submit_request(socket_path, "shm\tblur:2,rotate:r,makepixel:3\t/ggpicture_test\t37\t53\t3") == 0);
+    assert(memcmp(shared, expected.pixels, (size_t)expected.width * expected.height * 3) == 0);
+
+    // The segment must hold the image, and "-" needs a descriptor
+    assert(submit_request(socket_path, "shm\tblur:1\t/ggpicture_test\t100\t53\t3") != 0);
+    assert(submit_request(socket_path, "shm\tblur:1\t-\t37\t53\t3") != 0);
+    assert(submit_request(socket_path, "shm\tblur:1\t/ggpicture_missing\t37\t53\t3") != 0);
+    assert(submit_request(socket_path, "shm\tblur:1\t/ggpicture_test\t37\t53") != 0);
+
+    munmap(shared, bytes);
+    close(segment);
+    shm_unlink("/ggpicture_test");
+    gg_image_free(&img);
+    gg_image_free(&expected);
+
+    // Stopping removes the socket
+    result = system("./build/ggpicture --stop tests/server.sock");
+    assert(result == 0);
+    for (int i = 0; i < 500 && stat(socket_path, &st) == 0; i++) {
+        usleep(10000);
+    }
+    assert(stat(socket_path, &st) != 0);
+    assert(submit_request(socket_path, "ping") != 0);
+
+    remove(served);
+    remove(TEST_WORKING_DIR TEST_OUTPUT_FILE);
+    printf("Test server passed!\n");
+}
+
 int main(void) {
     printf("Running tests...\n");
 
@@ -296,6 +1695,27 @@ int main(void) {
     test_rotate_full_cycle();
     test_repeat_operations();
     test_adjustment_commands();
+    test_pipeline();
+    test_library_api();
+    test_buffer_cache();
+    test_point_lut();
+    test_tiled_rotation();
+    test_mirror();
+    test_rotate_angle();
+    test_blur_isa_levels();
+    test_color_matrix();
+    test_saturation();
+    test_pixelate_blocks();
+    test_blur_approximation();
+    test_thread_counts();
+    test_batch();
+    test_bmp_mapping();
+    test_bmp_writer();
+    test_mirror_output();
+    test_rotate_angle_output();
+    test_streaming();
+    test_stats();
+    test_server();
 
     printf("=================================================\n");
     printf("All tests passed successfully!\n");